@@ -37,7 +37,7 @@ mcsema-lift-3.9 \
     --arch amd64 \
     --cfg "${MAZE_DIR}/cfg/maze.amd64.cfg" \
     --output "${MAZE_DIR}/bc/maze.amd64.bc" \
-    --explicit_args \
+    --symbolic_profile \
     ${LIB_ARGS}
 
 if [[ $? -ne 0 ]] ; then
@@ -53,7 +53,7 @@ mcsema-lift-3.9 \
     --arch aarch64 \
     --cfg "${MAZE_DIR}/cfg/maze.aarch64.cfg" \
     --output "${MAZE_DIR}/bc/maze.aarch64.bc" \
-    --explicit_args \
+    --symbolic_profile \
     ${LIB_ARGS}
 
 if [[ $? -ne 0 ]] ; then
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cfenv>
+#include <cfloat>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#ifndef ADDRESS_SIZE_BITS
+# define ADDRESS_SIZE_BITS 64
+#endif
+
+#include "remill/Arch/AArch64/Runtime/State.h"
+
+extern "C" {
+
+Memory *__remill_sync_hyper_call(
+    State &, Memory *mem, SyncHyperCall::Name call) {
+  switch (call) {
+    case SyncHyperCall::kAArch64Breakpoint:
+      asm volatile("brk #0");
+      break;
+
+    default:
+      abort();
+  }
+
+  return mem;
+}
+
+Memory *__mcsema_reg_tracer(State &state, addr_t, Memory *memory) {
+  fprintf(
+      stderr,
+      "PC=%" PRIx64 ",X0=%" PRIx64 ",X1=%" PRIx64 ",X2=%" PRIx64
+      ",X3=%" PRIx64 ",X4=%" PRIx64 ",X5=%" PRIx64 ",X6=%" PRIx64
+      ",X7=%" PRIx64 ",X8=%" PRIx64 ",X19=%" PRIx64 ",X20=%" PRIx64
+      ",X21=%" PRIx64 ",X22=%" PRIx64 ",X23=%" PRIx64 ",X24=%" PRIx64
+      ",X25=%" PRIx64 ",X26=%" PRIx64 ",X27=%" PRIx64 ",X28=%" PRIx64
+      ",X29=%" PRIx64 ",X30=%" PRIx64 ",SP=%" PRIx64 "\n",
+      state.gpr.pc.qword, state.gpr.x0.qword, state.gpr.x1.qword,
+      state.gpr.x2.qword, state.gpr.x3.qword, state.gpr.x4.qword,
+      state.gpr.x5.qword, state.gpr.x6.qword, state.gpr.x7.qword,
+      state.gpr.x8.qword, state.gpr.x19.qword, state.gpr.x20.qword,
+      state.gpr.x21.qword, state.gpr.x22.qword, state.gpr.x23.qword,
+      state.gpr.x24.qword, state.gpr.x25.qword, state.gpr.x26.qword,
+      state.gpr.x27.qword, state.gpr.x28.qword, state.gpr.x29.qword,
+      state.gpr.x30.qword, state.gpr.sp.qword);
+  return memory;
+}
+
+// Memory read intrinsics.
+uint8_t __remill_read_memory_8(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint8_t *>(addr);
+}
+
+uint16_t __remill_read_memory_16(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint16_t *>(addr);
+}
+
+uint32_t __remill_read_memory_32(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint32_t *>(addr);
+}
+
+uint64_t __remill_read_memory_64(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint64_t *>(addr);
+}
+
+// Memory write intrinsics.
+Memory *__remill_write_memory_8(
+    Memory * memory, addr_t addr, uint8_t val) {
+  *reinterpret_cast<uint8_t *>(addr) = val;
+  return memory;
+}
+
+Memory *__remill_write_memory_16(
+    Memory * memory, addr_t addr, uint16_t val) {
+  *reinterpret_cast<uint16_t *>(addr) = val;
+  return memory;
+}
+
+Memory *__remill_write_memory_32(
+    Memory * memory, addr_t addr, uint32_t val) {
+  *reinterpret_cast<uint32_t *>(addr) = val;
+  return memory;
+}
+
+Memory *__remill_write_memory_64(
+    Memory * memory, addr_t addr, uint64_t val) {
+  *reinterpret_cast<uint64_t *>(addr) = val;
+  return memory;
+}
+
+float32_t __remill_read_memory_f32(
+    Memory *, addr_t addr, float32_t val) {
+  return *reinterpret_cast<float32_t *>(addr);
+}
+
+float64_t __remill_read_memory_f64(
+    Memory *, addr_t addr, float64_t val) {
+  return *reinterpret_cast<float64_t *>(addr);
+
+}
+
+Memory *__remill_write_memory_f32(
+    Memory * memory, addr_t addr, float32_t val) {
+  *reinterpret_cast<float32_t *>(addr) = val;
+  return memory;
+}
+
+Memory *__remill_write_memory_f64(
+    Memory * memory, addr_t addr, float64_t val) {
+  *reinterpret_cast<float64_t *>(addr) = val;
+  return memory;
+}
+
+// Memory barriers types, see: http://g.oswego.edu/dl/jmm/cookbook.html
+Memory *__remill_barrier_load_load(Memory * memory) {
+  return memory;
+}
+
+Memory *__remill_barrier_load_store(Memory * memory) {
+  return memory;
+}
+
+Memory *__remill_barrier_store_load(Memory * memory) {
+  return memory;
+}
+
+Memory *__remill_barrier_store_store(Memory * memory) {
+  return memory;
+}
+
+// Atomic operations. The address/size are hints, but the granularity of the
+// access can be bigger. These have implicit StoreLoad semantics.
+Memory *__remill_atomic_begin(Memory * memory) {
+  return memory;
+}
+
+Memory *__remill_atomic_end(Memory * memory) {
+  return memory;
+}
+
+Memory *__remill_compare_exchange_memory_8(
+    Memory *memory, addr_t addr, uint8_t &expected, uint8_t desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint8_t *>(addr), expected, desired);
+  return memory;
+}
+
+Memory *__remill_compare_exchange_memory_16(
+    Memory *memory, addr_t addr, uint16_t &expected, uint16_t desired) {
+  expected =  __sync_val_compare_and_swap(
+      reinterpret_cast<uint16_t *>(addr), expected, desired);
+  return memory;
+}
+
+Memory *__remill_compare_exchange_memory_32(
+    Memory *memory, addr_t addr, uint32_t &expected, uint32_t desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint32_t *>(addr), expected, desired);
+  return memory;
+}
+
+Memory *__remill_compare_exchange_memory_64(
+    Memory *memory, addr_t addr, uint64_t &expected, uint64_t desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint64_t *>(addr), expected, desired);
+  return memory;
+}
+
+#ifdef _GXX_EXPERIMENTAL_CXX0X__
+Memory *__remill_compare_exchange_memory_128(
+    Memory *memory, addr_t addr, uint128_t &expected, uint128_t &desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint128_t *>(addr), expected, desired);
+  return memory;
+}
+#endif
+
+Memory *__remill_fetch_and_add_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_add(reinterpret_cast<uint8_t*>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_add_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_add(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_add_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_add(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_add_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_add(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_sub_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_sub(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_sub_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_sub(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_sub_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_sub(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_sub_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_sub(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_or_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_or(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_or_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_or(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_or_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_or(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_or_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_or(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_and_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_and(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_and_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_and(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_and_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_and(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_and_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_and(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_xor_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_xor(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_xor_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_xor(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_xor_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_xor(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+Memory *__remill_fetch_and_xor_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_xor(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+int __remill_fpu_exception_test_and_clear(int read_mask, int clear_mask) {
+  auto except = std::fetestexcept(read_mask);
+  std::feclearexcept(clear_mask);
+  return except;
+}
+
+
+}  // extern C
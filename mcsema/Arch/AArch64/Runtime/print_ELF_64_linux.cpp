@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cinttypes>
+
+#define ADDRESS_SIZE_BITS 64
+
+#include <remill/Arch/AArch64/Runtime/State.h>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat"
+
+static const size_t kStackSize = 1UL << 20UL;
+
+// General purpose registers used to pass arguments (`X0` through `X7`, plus
+// the indirect result location register `X8`), and to return values, in the
+// AArch64 Procedure Call Standard.
+static const unsigned kNumArgRegs = 9;
+static const unsigned kNumRetRegs = 2;
+
+// Vector registers used to pass arguments, and to return values (up to four
+// for homogeneous floating-point aggregates). Only the low 64 bits of `V8`
+// through `V15` are callee-saved, so these are the only ones whose values are
+// meaningful across a native <-> lifted boundary.
+#ifdef MCSEMA_RUNTIME_SAVE_ALL_VEC_REGS
+static const unsigned kNumArgVecRegs = 32;
+static const unsigned kNumRetVecRegs = 32;
+#else
+static const unsigned kNumArgVecRegs = 8;
+static const unsigned kNumRetVecRegs = 4;
+#endif
+
+static const uintmax_t kGPROffsets[] = {
+  __builtin_offsetof(State, gpr.x0.qword),
+  __builtin_offsetof(State, gpr.x1.qword),
+  __builtin_offsetof(State, gpr.x2.qword),
+  __builtin_offsetof(State, gpr.x3.qword),
+  __builtin_offsetof(State, gpr.x4.qword),
+  __builtin_offsetof(State, gpr.x5.qword),
+  __builtin_offsetof(State, gpr.x6.qword),
+  __builtin_offsetof(State, gpr.x7.qword),
+  __builtin_offsetof(State, gpr.x8.qword),
+  __builtin_offsetof(State, gpr.x9.qword),
+  __builtin_offsetof(State, gpr.x10.qword),
+  __builtin_offsetof(State, gpr.x11.qword),
+  __builtin_offsetof(State, gpr.x12.qword),
+  __builtin_offsetof(State, gpr.x13.qword),
+  __builtin_offsetof(State, gpr.x14.qword),
+  __builtin_offsetof(State, gpr.x15.qword),
+  __builtin_offsetof(State, gpr.x16.qword),
+  __builtin_offsetof(State, gpr.x17.qword),
+  __builtin_offsetof(State, gpr.x18.qword),
+  __builtin_offsetof(State, gpr.x19.qword),
+  __builtin_offsetof(State, gpr.x20.qword),
+  __builtin_offsetof(State, gpr.x21.qword),
+  __builtin_offsetof(State, gpr.x22.qword),
+  __builtin_offsetof(State, gpr.x23.qword),
+  __builtin_offsetof(State, gpr.x24.qword),
+  __builtin_offsetof(State, gpr.x25.qword),
+  __builtin_offsetof(State, gpr.x26.qword),
+  __builtin_offsetof(State, gpr.x27.qword),
+  __builtin_offsetof(State, gpr.x28.qword),
+  __builtin_offsetof(State, gpr.x29.qword),
+  __builtin_offsetof(State, gpr.x30.qword),
+};
+
+static const uintmax_t kSPOffset = __builtin_offsetof(State, gpr.sp.qword);
+static const uintmax_t kPCOffset = __builtin_offsetof(State, gpr.pc.qword);
+static const uintmax_t kTPOffset = __builtin_offsetof(State, sr.tpidr_el0.qword);
+static const uintmax_t kVecOffset = __builtin_offsetof(State, simd.v[0]);
+
+static_assert(!(__builtin_offsetof(State, simd.v[0]) % 16),
+              "Vector registers must be 16-byte aligned in the State "
+              "structure for `LDR Qn` and `STR Qn` to encode.");
+
+// Load the address of the thread-local `State` structure into `X9`, and the
+// thread pointer into `X10`. Both registers are temporaries in the ABI, and
+// so are free at every boundary crossing.
+static void PrintGetStatePointer(FILE *out) {
+  fprintf(out, "  mrs x10, tpidr_el0\n");
+  fprintf(out, "  add x9, x10, #:tprel_hi12:__mcsema_reg_state, lsl #12\n");
+  fprintf(out, "  add x9, x9, #:tprel_lo12_nc:__mcsema_reg_state\n");
+}
+
+// Spill general purpose registers `[begin, end)` into the `State` structure
+// pointed to by `X9`.
+static void PrintSaveRegs(FILE *out, unsigned begin, unsigned end) {
+  for (unsigned i = begin; i < end; ++i) {
+    fprintf(out, "  str x%u, [x9, #%" PRIuMAX "]\n", i, kGPROffsets[i]);
+  }
+}
+
+// Reload general purpose registers `[begin, end)` from the `State` structure
+// pointed to by `X9`.
+static void PrintLoadRegs(FILE *out, unsigned begin, unsigned end) {
+  for (unsigned i = begin; i < end; ++i) {
+    fprintf(out, "  ldr x%u, [x9, #%" PRIuMAX "]\n", i, kGPROffsets[i]);
+  }
+}
+
+// Spill vector registers `[0, num_regs)` into the `State` structure pointed
+// to by `X9`.
+static void PrintSaveVecRegs(FILE *out, unsigned num_regs) {
+  for (unsigned i = 0; i < num_regs; ++i) {
+    fprintf(out, "  str q%u, [x9, #%" PRIuMAX "]\n", i, kVecOffset + i * 16);
+  }
+}
+
+// Reload vector registers `[0, num_regs)` from the `State` structure pointed
+// to by `X9`.
+static void PrintLoadVecRegs(FILE *out, unsigned num_regs) {
+  for (unsigned i = 0; i < num_regs; ++i) {
+    fprintf(out, "  ldr q%u, [x9, #%" PRIuMAX "]\n", i, kVecOffset + i * 16);
+  }
+}
+
+// Spill the low 64 bits of `V8` through `V15`, which are callee-saved, into
+// the `State` structure pointed to by `X9`.
+static void PrintSaveCalleeSavedVecRegs(FILE *out) {
+  for (unsigned i = 8; i < 16; ++i) {
+    fprintf(out, "  str d%u, [x9, #%" PRIuMAX "]\n", i, kVecOffset + i * 16);
+  }
+}
+
+// Reload the low 64 bits of `V8` through `V15` from the `State` structure
+// pointed to by `X9`.
+static void PrintLoadCalleeSavedVecRegs(FILE *out) {
+  for (unsigned i = 8; i < 16; ++i) {
+    fprintf(out, "  ldr d%u, [x9, #%" PRIuMAX "]\n", i, kVecOffset + i * 16);
+  }
+}
+
+// Exchange the machine stack pointer with `State::SP`. Clobbers `X11` and
+// `X12`.
+static void PrintSwapStacks(FILE *out) {
+  fprintf(out, "  ldr x11, [x9, #%" PRIuMAX "]\n", kSPOffset);
+  fprintf(out, "  mov x12, sp\n");
+  fprintf(out, "  str x12, [x9, #%" PRIuMAX "]\n", kSPOffset);
+  fprintf(out, "  mov sp, x11\n");
+}
+
+int main(void) {
+
+  FILE *out = fopen("runtime_aarch64.S", "w");
+
+  fprintf(out, "/* Auto-generated file! Don't modify! */\n\n");
+
+  // Thread-local state structure, named by `__mcsema_reg_state`.
+  fprintf(out, "  .type __mcsema_reg_state,@object\n");
+  fprintf(out, "  .section .tbss,\"awT\",@nobits\n");
+  fprintf(out, "  .p2align 4\n");
+  fprintf(out, "__mcsema_reg_state:\n");
+  fprintf(out, "  .zero %" PRIuMAX "\n", sizeof(State));
+  fprintf(out, "  .size __mcsema_reg_state, %" PRIuMAX "\n", sizeof(State));
+  fprintf(out, "\n");
+
+  // Thread-local stack structure, named by `__mcsema_stack`.
+  fprintf(out, "  .type __mcsema_stack,@object\n");
+  fprintf(out, "  .section .tbss,\"awT\",@nobits\n");
+  fprintf(out, "  .p2align 4\n");
+  fprintf(out, "__mcsema_stack:\n");
+  fprintf(out, "  .zero %" PRIuMAX "\n", kStackSize);  // 1 MiB.
+  fprintf(out, "  .size __mcsema_stack, %" PRIuMAX "\n", kStackSize);
+  fprintf(out, "\n");
+
+  fprintf(out, "  .text\n");
+  fprintf(out, "\n");
+
+  // Forward declarations.
+  fprintf(out, "  .globl __mcsema_detach_ret\n");
+  fprintf(out, "  .globl __mcsema_attach_ret\n");
+  fprintf(out, "\n");
+
+  // Implements `__mcsema_attach_call`. This goes from native state into lifted
+  // code. The native-to-lifted callback thunk (see `Callback.cpp`) branches
+  // here with:
+  //
+  //    X16   Address of the lifted function (from the bitcode).
+  //    X17   EA of the lifted function (from the CFG).
+  //    X30   Return address into native caller.
+  fprintf(out, "  .globl __mcsema_attach_call\n");
+  fprintf(out, "  .type __mcsema_attach_call,@function\n");
+  fprintf(out, "  .p2align 2\n");
+  fprintf(out, "__mcsema_attach_call:\n");
+  fprintf(out, "  .cfi_startproc\n");
+
+  PrintGetStatePointer(out);
+  fprintf(out, "  str x10, [x9, #%" PRIuMAX "]\n", kTPOffset);
+  fprintf(out, "  str x17, [x9, #%" PRIuMAX "]\n", kPCOffset);
+
+  // Argument registers, including the indirect result location register.
+  PrintSaveRegs(out, 0, kNumArgRegs);
+
+  // Callee-saved registers, the frame pointer, and the link register. These
+  // are only stored so that the lifted code sees the right values; the
+  // compiled lifted code itself preserves the native values, so they don't
+  // need to be reloaded in `__mcsema_detach_ret`.
+  PrintSaveRegs(out, 19, 31);
+
+  // Vector registers that may hold arguments.
+  PrintSaveVecRegs(out, kNumArgVecRegs);
+
+  // If `State::SP` is null then we need to initialize it to our new stack.
+  // Otherwise it holds where we left off in the lifted stack the last time
+  // that we detached.
+  fprintf(out, "  ldr x11, [x9, #%" PRIuMAX "]\n", kSPOffset);
+  fprintf(out, "  cbnz x11, .Lhave_stack\n");
+  fprintf(out, "  add x11, x10, #:tprel_hi12:__mcsema_stack, lsl #12\n");
+  fprintf(out, "  add x11, x11, #:tprel_lo12_nc:__mcsema_stack\n");
+  fprintf(out, "  ldr x12, =%" PRIuMAX "\n", (kStackSize - 16));
+  fprintf(out, "  add x11, x11, x12\n");
+  fprintf(out, ".Lhave_stack:\n");
+
+  // Swap onto the lifted stack. The emulated `SP` is now the native `SP`.
+  fprintf(out, "  mov x12, sp\n");
+  fprintf(out, "  str x12, [x9, #%" PRIuMAX "]\n", kSPOffset);
+  fprintf(out, "  mov sp, x11\n");
+
+  // Arguments to the lifted function: the `State` pointer, the program
+  // counter, and the memory pointer, which is (for now?) a nullptr. When
+  // the lifted function returns, it will go to `__mcsema_detach_ret`.
+  fprintf(out, "  mov x0, x9\n");
+  fprintf(out, "  mov x1, x17\n");
+  fprintf(out, "  mov x2, xzr\n");
+  fprintf(out, "  adr x30, __mcsema_detach_ret\n");
+  fprintf(out, "  br x16\n");
+  fprintf(out, "  .ltorg\n");
+
+  fprintf(out, ".Lfunc_end1:\n");
+  fprintf(out, "  .size __mcsema_attach_call,.Lfunc_end1-__mcsema_attach_call\n");
+  fprintf(out, "  .cfi_endproc\n");
+  fprintf(out, "\n");
+
+  // Implements `__mcsema_detach_ret`. This goes from lifted code into native
+  // code. The native return address is the emulated `X30`.
+  fprintf(out, "  .type __mcsema_detach_ret,@function\n");
+  fprintf(out, "  .p2align 2\n");
+  fprintf(out, "__mcsema_detach_ret:\n");
+  fprintf(out, "  .cfi_startproc\n");
+
+  // `X0` holds the memory pointer, which is null. Swap back to the native
+  // stack; when we swap, we save into `State::SP` where we are in the lifted
+  // stack, so that the next attach can continue on where we left off.
+  PrintGetStatePointer(out);
+  PrintSwapStacks(out);
+
+  // Registers that may hold return values.
+  PrintLoadRegs(out, 0, kNumRetRegs);
+  PrintLoadVecRegs(out, kNumRetVecRegs);
+
+  fprintf(out, "  ldr x30, [x9, #%" PRIuMAX "]\n", kGPROffsets[30]);
+  fprintf(out, "  ret\n");
+
+  fprintf(out, ".Lfunc_end3:\n");
+  fprintf(out, "  .size __mcsema_detach_ret,.Lfunc_end3-__mcsema_detach_ret\n");
+  fprintf(out, "  .cfi_endproc\n");
+  fprintf(out, "\n");
+
+  // Implements `__remill_function_call`. This is a fully generic form of
+  // function call detaching that is unaware of the ABI / calling convention
+  // of the target. It is called from the lifted code with:
+  //
+  //    X0    `State` pointer.
+  //    X1    Native target address.
+  //    X2    Memory pointer.
+  fprintf(out, "  .globl __remill_jump\n");
+  fprintf(out, "  .type __remill_jump,@function\n");
+  fprintf(out, "  .globl __remill_function_call\n");
+  fprintf(out, "  .type __remill_function_call,@function\n");
+  fprintf(out, "  .p2align 2\n");
+  fprintf(out, "__remill_jump:\n");
+  fprintf(out, "__remill_function_call:\n");
+  fprintf(out, ".Lfunc_begin5:\n");
+  fprintf(out, "  .cfi_startproc\n");
+
+  // Stash the callee-saved registers of the compiled lifted code on the
+  // lifted stack, along with the memory pointer, which is returned as is
+  // expected by the prototype of `__remill_function_call` (see
+  // remill/Arch/Runtime/Intrinsics.h).
+  fprintf(out, "  stp x29, x30, [sp, #-16]!\n");
+  fprintf(out, "  stp x27, x28, [sp, #-16]!\n");
+  fprintf(out, "  stp x25, x26, [sp, #-16]!\n");
+  fprintf(out, "  stp x23, x24, [sp, #-16]!\n");
+  fprintf(out, "  stp x21, x22, [sp, #-16]!\n");
+  fprintf(out, "  stp x19, x20, [sp, #-16]!\n");
+  fprintf(out, "  stp d14, d15, [sp, #-16]!\n");
+  fprintf(out, "  stp d12, d13, [sp, #-16]!\n");
+  fprintf(out, "  stp d10, d11, [sp, #-16]!\n");
+  fprintf(out, "  stp d8, d9, [sp, #-16]!\n");
+  fprintf(out, "  stp x2, xzr, [sp, #-16]!\n");
+
+  fprintf(out, "  mov x9, x0\n");
+  fprintf(out, "  mov x16, x1\n");
+
+  // Swap off-stack, stash the lifted stack pointer.
+  PrintSwapStacks(out);
+
+  // Argument registers, and the callee-saved registers with their emulated
+  // values. The latter matter if the native callee calls back into lifted
+  // code (e.g. `qsort` with a lifted comparator): `__mcsema_attach_call` then
+  // stores the native `X19` through `X29` into the `State` structure, which
+  // must not clobber the emulated values of the lifted caller. Loading `X29`
+  // also chains frame records through the emulated frames.
+  PrintLoadRegs(out, 0, kNumArgRegs);
+  PrintLoadRegs(out, 19, 30);
+
+  // Vector registers that may hold arguments, and the callee-saved ones.
+  PrintLoadVecRegs(out, kNumArgVecRegs);
+  PrintLoadCalleeSavedVecRegs(out);
+
+  // The native target returns into `__mcsema_attach_ret`.
+  fprintf(out, "  adr x30, __mcsema_attach_ret\n");
+  fprintf(out, "  br x16\n");
+
+  fprintf(out, ".Lfunc_end5:\n");
+  fprintf(out, "  .size __remill_function_call,.Lfunc_end5-__remill_function_call\n");
+  fprintf(out, "  .cfi_endproc\n");
+  fprintf(out, "\n");
+
+  // Implements `__mcsema_attach_ret`. This goes from native state back into
+  // lifted code, after a native function called by `__remill_function_call`
+  // returns.
+  fprintf(out, "  .type __mcsema_attach_ret,@function\n");
+  fprintf(out, "  .p2align 2\n");
+  fprintf(out, "__mcsema_attach_ret:\n");
+  fprintf(out, "  .cfi_startproc\n");
+
+  PrintGetStatePointer(out);
+
+  // Registers that may hold return values, and the callee-saved registers,
+  // which the native callee preserved, and which go back into the `State`
+  // structure before the compiled lifted code gets its own values back.
+  PrintSaveRegs(out, 0, kNumRetRegs);
+  PrintSaveRegs(out, 19, 30);
+  PrintSaveVecRegs(out, kNumRetVecRegs);
+  PrintSaveCalleeSavedVecRegs(out);
+
+  // Swap into the lifted stack.
+  PrintSwapStacks(out);
+
+  // Emulate the return: the emulated `PC` is the emulated link register.
+  fprintf(out, "  ldr x12, [x9, #%" PRIuMAX "]\n", kGPROffsets[30]);
+  fprintf(out, "  str x12, [x9, #%" PRIuMAX "]\n", kPCOffset);
+
+  // On the lifted stack:
+  //     0    stashed memory pointer (and padding)
+  //    16    stashed d8 through d15
+  //    80    stashed x19 through x28
+  //   160    stashed x29, x30
+  fprintf(out, "  ldp x0, xzr, [sp], #16\n");
+  fprintf(out, "  ldp d8, d9, [sp], #16\n");
+  fprintf(out, "  ldp d10, d11, [sp], #16\n");
+  fprintf(out, "  ldp d12, d13, [sp], #16\n");
+  fprintf(out, "  ldp d14, d15, [sp], #16\n");
+  fprintf(out, "  ldp x19, x20, [sp], #16\n");
+  fprintf(out, "  ldp x21, x22, [sp], #16\n");
+  fprintf(out, "  ldp x23, x24, [sp], #16\n");
+  fprintf(out, "  ldp x25, x26, [sp], #16\n");
+  fprintf(out, "  ldp x27, x28, [sp], #16\n");
+  fprintf(out, "  ldp x29, x30, [sp], #16\n");
+  fprintf(out, "  ret\n");
+
+  fprintf(out, ".Lfunc_end2:\n");
+  fprintf(out, "  .size __mcsema_attach_ret,.Lfunc_end2-__mcsema_attach_ret\n");
+  fprintf(out, "  .cfi_endproc\n");
+  fprintf(out, "\n");
+
+  // Implements `__mcsema_get_stack_pointer`. Returns the stack pointer register.
+  fprintf(out, "  .globl __mcsema_get_stack_pointer\n");
+  fprintf(out, "  .type __mcsema_get_stack_pointer,@function\n");
+  fprintf(out, "  .p2align 2\n");
+  fprintf(out, "__mcsema_get_stack_pointer:\n");
+  fprintf(out, "  .cfi_startproc\n");
+  PrintGetStatePointer(out);
+  fprintf(out, "  ldr x0, [x9, #%" PRIuMAX "]\n", kSPOffset);
+  fprintf(out, "  ret\n");
+  fprintf(out, ".Lfunc_end20:\n");
+  fprintf(out, "  .size __mcsema_get_stack_pointer,.Lfunc_end20-__mcsema_get_stack_pointer\n");
+  fprintf(out, "  .cfi_endproc\n");
+  fprintf(out, "\n");
+
+  // Implements `__mcsema_get_frame_pointer`. Returns the frame pointer register.
+  fprintf(out, "  .globl __mcsema_get_frame_pointer\n");
+  fprintf(out, "  .type __mcsema_get_frame_pointer,@function\n");
+  fprintf(out, "  .p2align 2\n");
+  fprintf(out, "__mcsema_get_frame_pointer:\n");
+  fprintf(out, "  .cfi_startproc\n");
+  PrintGetStatePointer(out);
+  fprintf(out, "  ldr x0, [x9, #%" PRIuMAX "]\n", kGPROffsets[29]);
+  fprintf(out, "  ret\n");
+  fprintf(out, ".Lfunc_end21:\n");
+  fprintf(out, "  .size __mcsema_get_frame_pointer,.Lfunc_end21-__mcsema_get_frame_pointer\n");
+  fprintf(out, "  .cfi_endproc\n");
+  fprintf(out, "\n");
+
+  // Implements `__mcsema_debug_get_reg_state`. This is useful when debugging in
+  // gdb.
+  fprintf(out, "  .globl __mcsema_debug_get_reg_state\n");
+  fprintf(out, "  .type __mcsema_debug_get_reg_state,@function\n");
+  fprintf(out, "  .p2align 2\n");
+  fprintf(out, "__mcsema_debug_get_reg_state:\n");
+  fprintf(out, "  .cfi_startproc\n");
+  PrintGetStatePointer(out);
+  fprintf(out, "  mov x0, x9\n");
+  fprintf(out, "  ret\n");
+  fprintf(out, ".Lfunc_end6:\n");
+  fprintf(out, "  .size __mcsema_debug_get_reg_state,.Lfunc_end6-__mcsema_debug_get_reg_state\n");
+  fprintf(out, "  .cfi_endproc\n");
+  fprintf(out, "\n");
+
+  // Error functions.
+  fprintf(out, "  .globl __remill_error\n");
+  fprintf(out, "  .type __remill_error,@function\n");
+
+  fprintf(out, "  .globl __remill_missing_block\n");
+  fprintf(out, "  .type __remill_missing_block,@function\n");
+
+  fprintf(out, "  .globl __remill_function_return\n");
+  fprintf(out, "  .type __remill_function_return,@function\n");
+
+  fprintf(out, "__remill_error:\n");
+  fprintf(out, "__remill_missing_block:\n");
+  fprintf(out, "__remill_function_return:\n");
+  fprintf(out, "  brk #0x3e8\n");
+
+  return 0;
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Bitcode runtime that is linked into lifted modules produced with
+// `--keep_memops` (see `--memops_runtime`), so that calls to the memory
+// intrinsics are inlined into direct loads and stores. Variants of this file
+// can call instrumentation hooks from within the accessors.
+
+#include <cstdint>
+
+#define HAS_FEATURE_AVX 1
+#define HAS_FEATURE_AVX512 0
+
+#ifndef ADDRESS_SIZE_BITS
+# define ADDRESS_SIZE_BITS 64
+#endif
+
+#include "remill/Arch/X86/Runtime/State.h"
+
+extern "C" {
+
+#define MCSEMA_MEMORY_INTRINSIC __attribute__((always_inline, used))
+#include "mcsema/Arch/X86/Runtime/MemoryIntrinsics.h"
+#undef MCSEMA_MEMORY_INTRINSIC
+
+}  // extern C
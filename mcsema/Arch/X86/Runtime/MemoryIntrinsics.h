@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Implementations of Remill's memory access, memory barrier, and atomic
+// intrinsics. These are included into the runtime, where they are regular
+// functions, and into the inline memory runtime, where they are always
+// inlined into lifted code that is produced with `--keep_memops`.
+//
+// This file must be included inside of an `extern "C"` block, after
+// `MCSEMA_MEMORY_INTRINSIC` is defined.
+
+#ifndef MCSEMA_MEMORY_INTRINSIC
+# error "MCSEMA_MEMORY_INTRINSIC must be defined."
+#endif
+
+// Memory read intrinsics.
+MCSEMA_MEMORY_INTRINSIC
+uint8_t __remill_read_memory_8(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint8_t *>(addr);
+}
+
+MCSEMA_MEMORY_INTRINSIC
+uint16_t __remill_read_memory_16(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint16_t *>(addr);
+}
+
+MCSEMA_MEMORY_INTRINSIC
+uint32_t __remill_read_memory_32(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint32_t *>(addr);
+}
+
+MCSEMA_MEMORY_INTRINSIC
+uint64_t __remill_read_memory_64(Memory *, addr_t addr) {
+  return *reinterpret_cast<uint64_t *>(addr);
+}
+
+// Memory write intrinsics.
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_write_memory_8(
+    Memory * memory, addr_t addr, uint8_t val) {
+  *reinterpret_cast<uint8_t *>(addr) = val;
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_write_memory_16(
+    Memory * memory, addr_t addr, uint16_t val) {
+  *reinterpret_cast<uint16_t *>(addr) = val;
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_write_memory_32(
+    Memory * memory, addr_t addr, uint32_t val) {
+  *reinterpret_cast<uint32_t *>(addr) = val;
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_write_memory_64(
+    Memory * memory, addr_t addr, uint64_t val) {
+  *reinterpret_cast<uint64_t *>(addr) = val;
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+float32_t __remill_read_memory_f32(Memory *, addr_t addr) {
+  return *reinterpret_cast<float32_t *>(addr);
+}
+
+MCSEMA_MEMORY_INTRINSIC
+float64_t __remill_read_memory_f64(Memory *, addr_t addr) {
+  return *reinterpret_cast<float64_t *>(addr);
+}
+
+MCSEMA_MEMORY_INTRINSIC
+float64_t __remill_read_memory_f80(Memory *, addr_t addr) {
+  return static_cast<float64_t>(*reinterpret_cast<long double *>(addr));
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_write_memory_f32(
+    Memory * memory, addr_t addr, float32_t val) {
+  *reinterpret_cast<float32_t *>(addr) = val;
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_write_memory_f64(
+    Memory * memory, addr_t addr, float64_t val) {
+  *reinterpret_cast<float64_t *>(addr) = val;
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_write_memory_f80(
+    Memory * memory, addr_t addr, float64_t val) {
+  *reinterpret_cast<long double *>(addr) = static_cast<long double>(val);
+  return memory;
+}
+
+// Memory barriers types, see: http://g.oswego.edu/dl/jmm/cookbook.html
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_barrier_load_load(Memory * memory) {
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_barrier_load_store(Memory * memory) {
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_barrier_store_load(Memory * memory) {
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_barrier_store_store(Memory * memory) {
+  return memory;
+}
+
+// Atomic operations. The address/size are hints, but the granularity of the
+// access can be bigger. These have implicit StoreLoad semantics.
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_atomic_begin(Memory * memory) {
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_atomic_end(Memory * memory) {
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_compare_exchange_memory_8(
+    Memory *memory, addr_t addr, uint8_t &expected, uint8_t desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint8_t *>(addr), expected, desired);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_compare_exchange_memory_16(
+    Memory *memory, addr_t addr, uint16_t &expected, uint16_t desired) {
+  expected =  __sync_val_compare_and_swap(
+      reinterpret_cast<uint16_t *>(addr), expected, desired);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_compare_exchange_memory_32(
+    Memory *memory, addr_t addr, uint32_t &expected, uint32_t desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint32_t *>(addr), expected, desired);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_compare_exchange_memory_64(
+    Memory *memory, addr_t addr, uint64_t &expected, uint64_t desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint64_t *>(addr), expected, desired);
+  return memory;
+}
+
+#ifdef _GXX_EXPERIMENTAL_CXX0X__
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_compare_exchange_memory_128(
+    Memory *memory, addr_t addr, uint128_t &expected, uint128_t &desired) {
+  expected = __sync_val_compare_and_swap(
+      reinterpret_cast<uint128_t *>(addr), expected, desired);
+  return memory;
+}
+#endif
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_add_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_add(reinterpret_cast<uint8_t*>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_add_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_add(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_add_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_add(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_add_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_add(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_sub_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_sub(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_sub_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_sub(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_sub_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_sub(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_sub_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_sub(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_or_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_or(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_or_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_or(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_or_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_or(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_or_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_or(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_and_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_and(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_and_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_and(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_and_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_and(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_and_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_and(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_xor_8(
+    Memory *memory, addr_t addr, uint8_t &value) {
+  value = __sync_fetch_and_xor(reinterpret_cast<uint8_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_xor_16(
+    Memory *memory, addr_t addr, uint16_t &value) {
+  value =  __sync_fetch_and_xor(reinterpret_cast<uint16_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_xor_32(
+    Memory *memory, addr_t addr, uint32_t &value) {
+  value = __sync_fetch_and_xor(reinterpret_cast<uint32_t *>(addr), value);
+  return memory;
+}
+
+MCSEMA_MEMORY_INTRINSIC
+Memory *__remill_fetch_and_xor_64(
+    Memory *memory, addr_t addr, uint64_t &value) {
+  value = __sync_fetch_and_xor(reinterpret_cast<uint64_t *>(addr), value);
+  return memory;
+}
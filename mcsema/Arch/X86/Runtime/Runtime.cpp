@@ -20,6 +20,11 @@
 #include <cfloat>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+# include <sys/mman.h>
+#endif
 
 #define HAS_FEATURE_AVX 1
 #define HAS_FEATURE_AVX512 0
@@ -191,269 +196,76 @@ Memory *__remill_write_io_port_32(Memory *, addr_t, uint32_t) {
   abort();
 }
 
-// Memory read intrinsics.
-uint8_t __remill_read_memory_8(Memory *, addr_t addr) {
-  return *reinterpret_cast<uint8_t *>(addr);
-}
-
-uint16_t __remill_read_memory_16(Memory *, addr_t addr) {
-  return *reinterpret_cast<uint16_t *>(addr);
-}
-
-uint32_t __remill_read_memory_32(Memory *, addr_t addr) {
-  return *reinterpret_cast<uint32_t *>(addr);
-}
-
-uint64_t __remill_read_memory_64(Memory *, addr_t addr) {
-  return *reinterpret_cast<uint64_t *>(addr);
-}
-
-// Memory write intrinsics.
-Memory *__remill_write_memory_8(
-    Memory * memory, addr_t addr, uint8_t val) {
-  *reinterpret_cast<uint8_t *>(addr) = val;
-  return memory;
-}
-
-Memory *__remill_write_memory_16(
-    Memory * memory, addr_t addr, uint16_t val) {
-  *reinterpret_cast<uint16_t *>(addr) = val;
-  return memory;
-}
-
-Memory *__remill_write_memory_32(
-    Memory * memory, addr_t addr, uint32_t val) {
-  *reinterpret_cast<uint32_t *>(addr) = val;
-  return memory;
-}
+#define MCSEMA_MEMORY_INTRINSIC
+#include "mcsema/Arch/X86/Runtime/MemoryIntrinsics.h"
+#undef MCSEMA_MEMORY_INTRINSIC
 
-Memory *__remill_write_memory_64(
-    Memory * memory, addr_t addr, uint64_t val) {
-  *reinterpret_cast<uint64_t *>(addr) = val;
-  return memory;
-}
-
-float32_t __remill_read_memory_f32(
-    Memory *, addr_t addr, float32_t val) {
-  return *reinterpret_cast<float32_t *>(addr);
-}
-
-float64_t __remill_read_memory_f64(
-    Memory *, addr_t addr, float64_t val) {
-  return *reinterpret_cast<float64_t *>(addr);
-
-}
-
-float64_t __remill_read_memory_f80(Memory *, addr_t addr) {
-  return static_cast<float64_t>(*reinterpret_cast<long double *>(addr));
-}
-
-Memory *__remill_write_memory_f32(
-    Memory * memory, addr_t addr, float32_t val) {
-  *reinterpret_cast<float32_t *>(addr) = val;
-  return memory;
-}
-
-Memory *__remill_write_memory_f64(
-    Memory * memory, addr_t addr, float64_t val) {
-  *reinterpret_cast<float64_t *>(addr) = val;
-  return memory;
-}
-
-Memory *__remill_write_memory_f80(
-    Memory * memory, addr_t addr, float64_t val) {
-  *reinterpret_cast<long double *>(addr) = static_cast<long double>(val);
-  return memory;
-}
-
-// Memory barriers types, see: http://g.oswego.edu/dl/jmm/cookbook.html
-Memory *__remill_barrier_load_load(Memory * memory) {
-  return memory;
-}
-
-Memory *__remill_barrier_load_store(Memory * memory) {
-  return memory;
-}
-
-Memory *__remill_barrier_store_load(Memory * memory) {
-  return memory;
-}
-
-Memory *__remill_barrier_store_store(Memory * memory) {
-  return memory;
-}
-
-// Atomic operations. The address/size are hints, but the granularity of the
-// access can be bigger. These have implicit StoreLoad semantics.
-Memory *__remill_atomic_begin(Memory * memory) {
-  return memory;
+int __remill_fpu_exception_test_and_clear(int read_mask, int clear_mask) {
+  auto except = std::fetestexcept(read_mask);
+  std::feclearexcept(clear_mask);
+  return except;
 }
 
-Memory *__remill_atomic_end(Memory * memory) {
-  return memory;
-}
+// Called by the constructor of bitcode lifted with `--huge_pages`. Moves the
+// 2 MiB-aligned part of `[begin, end)` onto anonymous memory backed by
+// transparent huge pages. File-backed mappings only get huge pages for code,
+// and only with `CONFIG_READ_ONLY_THP_FOR_FS`. This is best-effort; if
+// anything fails, then the original mapping stays. `kind` is `0` for
+// writable data, `1` for code, and `2` for read-only data.
+void __mcsema_remap_huge_pages(uint8_t *begin, uint8_t *end, int kind) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  const uintptr_t huge_page_size = 2UL << 20UL;
+  const auto aligned_begin = (reinterpret_cast<uintptr_t>(begin) +
+                              huge_page_size - 1) & ~(huge_page_size - 1);
+  const auto aligned_end = reinterpret_cast<uintptr_t>(end) &
+                           ~(huge_page_size - 1);
+  if (aligned_begin >= aligned_end) {
+    return;
+  }
 
-Memory *__remill_compare_exchange_memory_8(
-    Memory *memory, addr_t addr, uint8_t &expected, uint8_t desired) {
-  expected = __sync_val_compare_and_swap(
-      reinterpret_cast<uint8_t *>(addr), expected, desired);
-  return memory;
-}
+  const auto size = aligned_end - aligned_begin;
+  const auto addr = reinterpret_cast<void *>(aligned_begin);
 
-Memory *__remill_compare_exchange_memory_16(
-    Memory *memory, addr_t addr, uint16_t &expected, uint16_t desired) {
-  expected =  __sync_val_compare_and_swap(
-      reinterpret_cast<uint16_t *>(addr), expected, desired);
-  return memory;
-}
+  // Over-allocate so that the copy is huge page aligned, and so gets huge
+  // pages as it is written.
+  const auto alloc_size = size + huge_page_size;
+  auto alloc = mmap(nullptr, alloc_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (alloc == MAP_FAILED) {
+    return;
+  }
 
-Memory *__remill_compare_exchange_memory_32(
-    Memory *memory, addr_t addr, uint32_t &expected, uint32_t desired) {
-  expected = __sync_val_compare_and_swap(
-      reinterpret_cast<uint32_t *>(addr), expected, desired);
-  return memory;
-}
+  const auto alloc_begin = reinterpret_cast<uintptr_t>(alloc);
+  const auto copy_begin = (alloc_begin + huge_page_size - 1) &
+                          ~(huge_page_size - 1);
+  const auto copy = reinterpret_cast<void *>(copy_begin);
+  if (copy_begin != alloc_begin) {
+    munmap(alloc, copy_begin - alloc_begin);
+  }
+  if (copy_begin + size != alloc_begin + alloc_size) {
+    munmap(reinterpret_cast<void *>(copy_begin + size),
+           alloc_begin + alloc_size - copy_begin - size);
+  }
 
-Memory *__remill_compare_exchange_memory_64(
-    Memory *memory, addr_t addr, uint64_t &expected, uint64_t desired) {
-  expected = __sync_val_compare_and_swap(
-      reinterpret_cast<uint64_t *>(addr), expected, desired);
-  return memory;
-}
+  madvise(copy, size, MADV_HUGEPAGE);
+  memcpy(copy, addr, size);
 
-#ifdef _GXX_EXPERIMENTAL_CXX0X__
-Memory *__remill_compare_exchange_memory_128(
-    Memory *memory, addr_t addr, uint128_t &expected, uint128_t &desired) {
-  expected = __sync_val_compare_and_swap(
-      reinterpret_cast<uint128_t *>(addr), expected, desired);
-  return memory;
-}
+  int prot = PROT_READ | PROT_WRITE;
+  if (kind == 1) {
+    prot = PROT_READ | PROT_EXEC;
+  } else if (kind == 2) {
+    prot = PROT_READ;
+  }
+  if (mprotect(copy, size, prot) ||
+      MAP_FAILED == mremap(copy, size, size, MREMAP_MAYMOVE | MREMAP_FIXED,
+                           addr)) {
+    munmap(copy, size);
+  }
+#else
+  (void) begin;
+  (void) end;
+  (void) kind;
 #endif
-
-Memory *__remill_fetch_and_add_8(
-    Memory *memory, addr_t addr, uint8_t &value) {
-  value = __sync_fetch_and_add(reinterpret_cast<uint8_t*>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_add_16(
-    Memory *memory, addr_t addr, uint16_t &value) {
-  value =  __sync_fetch_and_add(reinterpret_cast<uint16_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_add_32(
-    Memory *memory, addr_t addr, uint32_t &value) {
-  value = __sync_fetch_and_add(reinterpret_cast<uint32_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_add_64(
-    Memory *memory, addr_t addr, uint64_t &value) {
-  value = __sync_fetch_and_add(reinterpret_cast<uint64_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_sub_8(
-    Memory *memory, addr_t addr, uint8_t &value) {
-  value = __sync_fetch_and_sub(reinterpret_cast<uint8_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_sub_16(
-    Memory *memory, addr_t addr, uint16_t &value) {
-  value =  __sync_fetch_and_sub(reinterpret_cast<uint16_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_sub_32(
-    Memory *memory, addr_t addr, uint32_t &value) {
-  value = __sync_fetch_and_sub(reinterpret_cast<uint32_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_sub_64(
-    Memory *memory, addr_t addr, uint64_t &value) {
-  value = __sync_fetch_and_sub(reinterpret_cast<uint64_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_or_8(
-    Memory *memory, addr_t addr, uint8_t &value) {
-  value = __sync_fetch_and_or(reinterpret_cast<uint8_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_or_16(
-    Memory *memory, addr_t addr, uint16_t &value) {
-  value =  __sync_fetch_and_or(reinterpret_cast<uint16_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_or_32(
-    Memory *memory, addr_t addr, uint32_t &value) {
-  value = __sync_fetch_and_or(reinterpret_cast<uint32_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_or_64(
-    Memory *memory, addr_t addr, uint64_t &value) {
-  value = __sync_fetch_and_or(reinterpret_cast<uint64_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_and_8(
-    Memory *memory, addr_t addr, uint8_t &value) {
-  value = __sync_fetch_and_and(reinterpret_cast<uint8_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_and_16(
-    Memory *memory, addr_t addr, uint16_t &value) {
-  value =  __sync_fetch_and_and(reinterpret_cast<uint16_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_and_32(
-    Memory *memory, addr_t addr, uint32_t &value) {
-  value = __sync_fetch_and_and(reinterpret_cast<uint32_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_and_64(
-    Memory *memory, addr_t addr, uint64_t &value) {
-  value = __sync_fetch_and_and(reinterpret_cast<uint64_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_xor_8(
-    Memory *memory, addr_t addr, uint8_t &value) {
-  value = __sync_fetch_and_xor(reinterpret_cast<uint8_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_xor_16(
-    Memory *memory, addr_t addr, uint16_t &value) {
-  value =  __sync_fetch_and_xor(reinterpret_cast<uint16_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_xor_32(
-    Memory *memory, addr_t addr, uint32_t &value) {
-  value = __sync_fetch_and_xor(reinterpret_cast<uint32_t *>(addr), value);
-  return memory;
-}
-
-Memory *__remill_fetch_and_xor_64(
-    Memory *memory, addr_t addr, uint64_t &value) {
-  value = __sync_fetch_and_xor(reinterpret_cast<uint64_t *>(addr), value);
-  return memory;
-}
-
-int __remill_fpu_exception_test_and_clear(int read_mask, int clear_mask) {
-  auto except = std::fetestexcept(read_mask);
-  std::feclearexcept(clear_mask);
-  return except;
 }
 
 
@@ -30,91 +30,29 @@
 
 static const size_t kStackSize = 1UL << 20UL;
 
+// The arithmetic flags are left in whatever state the lifted code put them
+// in. The ABI treats them as undefined across calls and returns, and only
+// requires that the direction flag be clear.
 static void PrintStoreFlags(FILE * out) {
   // FPU control.
   fprintf(out, "  fnstcw WORD PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, x87.fxsave.cwd));
-
-  fprintf(out, "  pushfd\n");
-  fprintf(out, "  mov edx, 0xcd5\n");
-  fprintf(out, "  not edx\n");
-  fprintf(out, "  and DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, CF));
-  fprintf(out, "  shl edx, 0\n");
-  fprintf(out, "  or DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, PF));
-  fprintf(out, "  shl edx, 2\n");
-  fprintf(out, "  or DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, AF));
-  fprintf(out, "  shl edx, 4\n");
-  fprintf(out, "  or DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, ZF));
-  fprintf(out, "  shl edx, 6\n");
-  fprintf(out, "  or DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, SF));
-  fprintf(out, "  shl edx, 7\n");
-  fprintf(out, "  or DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, DF));
-  fprintf(out, "  shl edx, 10\n");
-  fprintf(out, "  or DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, OF));
-  fprintf(out, "  shl edx, 11\n");
-  fprintf(out, "  or DWORD PTR [esp], edx\n");
-
-  fprintf(out, "  popfd\n");
+  fprintf(out, "  cld\n");
 }
 
+// The native EFlags are saved, packed, into `State::rflag`. They are not
+// marshaled into the `ArithFlags` struct here; instead, the lifted code
+// entered through `__mcsema_attach_call` unpacks only those flags that it
+// reads before writing.
 static void PrintLoadFlags(FILE * out) {
   // FPU control.
   fprintf(out, "  push dx\n");
   fprintf(out, "  fldcw WORD PTR [esp]\n");
   fprintf(out, "  pop WORD PTR [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, x87.fxsave.cwd));
 
-  // Clear our the `ArithFlags` struct, which is 16 bytes.
-  fprintf(out, "  mov DWORD PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, aflag));
-  fprintf(out, "  mov DWORD PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, aflag) + 4);
-  fprintf(out, "  mov DWORD PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, aflag) + 8);
-  fprintf(out, "  mov DWORD PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, aflag) + 12);
-
   // Get the EFlags.
   fprintf(out, "  pushfd\n");
   fprintf(out, "  pop edx\n");
   fprintf(out, "  mov DWORD PTR [edi + %" PRIuMAX "], edx\n", __builtin_offsetof(State, rflag));
-
-  // Marshal the EFlags into the ArithFlags struct.
-  fprintf(out, "  bt edx, 0\n");
-  fprintf(out, "  adc BYTE PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, CF));
-
-  fprintf(out, "  bt edx, 2\n");
-  fprintf(out, "  adc BYTE PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, PF));
-
-  fprintf(out, "  bt edx, 4\n");
-  fprintf(out, "  adc BYTE PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, AF));
-
-  fprintf(out, "  bt edx, 6\n");
-  fprintf(out, "  adc BYTE PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, ZF));
-
-  fprintf(out, "  bt edx, 7\n");
-  fprintf(out, "  adc BYTE PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, SF));
-
-  fprintf(out, "  bt edx, 10\n");
-  fprintf(out, "  adc BYTE PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, DF));
-
-  fprintf(out, "  bt edx, 11\n");
-  fprintf(out, "  adc BYTE PTR [edi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, OF));
 }
 
 int main(void) {
@@ -263,7 +201,7 @@ int main(void) {
   fprintf(out, "  sub DWORD PTR [edi + %" PRIuMAX "], 4\n", __builtin_offsetof(State, ESP));
   fprintf(out, "  xchg [edi + %" PRIuMAX "], esp\n", __builtin_offsetof(State, ESP));
 
-  PrintStoreFlags(out);  // Clobbers RDX.
+  PrintStoreFlags(out);
 
   // General purpose registers.
   fprintf(out, "  mov eax, [edi + %" PRIuMAX "]\n", __builtin_offsetof(State, EAX));
@@ -345,7 +283,7 @@ int main(void) {
   fprintf(out, "  sub esi, 4\n");
   fprintf(out, "  mov DWORD PTR [esi], ebx\n");
 
-  PrintStoreFlags(out);  // Clobbers EDX.
+  PrintStoreFlags(out);
 
   // Swap off-stack, stash the lifted stack pointer.
   fprintf(out, "  mov [edi + %" PRIuMAX "], esp\n", __builtin_offsetof(State, ESP));
@@ -17,6 +17,7 @@
 
 #include <cstdio>
 #include <cinttypes>
+#include <cstring>
 
 #define HAS_FEATURE_AVX 1
 #define HAS_FEATURE_AVX512 0
@@ -30,53 +31,86 @@
 
 static const size_t kStackSize = 1UL << 20UL;
 
+// Vector registers used to pass arguments, and to return values, in the
+// AMD64 System V ABI. All vector registers are caller-saved, so these are the
+// only ones whose values are meaningful across a native <-> lifted boundary.
+#ifdef MCSEMA_RUNTIME_SAVE_ALL_VEC_REGS
+static const unsigned kNumArgVecRegs = 16;
+static const unsigned kNumRetVecRegs = 16;
+#else
+static const unsigned kNumArgVecRegs = 8;
+static const unsigned kNumRetVecRegs = 2;
+#endif
+static const unsigned kNumVecRegs = 16;
+
+// Generate the position-independent runtime, which is linked into lifted
+// shared libraries instead of lifted executables.
+static bool gPIC = false;
+
+// Declare the global symbol `name`. Every lifted shared library links in its
+// own copy of the position-independent runtime, so there the symbols are
+// hidden. That way one library's thunks, `State` and lifted stack never get
+// interposed by those of another library, or of the main executable.
+static void PrintGlobal(FILE *out, const char *name) {
+  fprintf(out, "  .globl %s\n", name);
+  if (gPIC) {
+    fprintf(out, "  .hidden %s\n", name);
+  }
+}
+
+// Put the offset of this thread's `__mcsema_reg_state` from the thread
+// pointer into `RAX`, using its TLS descriptor. This only clobbers `RAX` and
+// the flags, and works no matter where the dynamic loader put the TLS block
+// of a `dlopen`ed library. The linker relaxes it into a constant if the
+// runtime ends up in an executable after all.
+static void PrintGetStateOffset(FILE *out) {
+  fprintf(out, "  lea rax, [rip + __mcsema_reg_state@TLSDESC]\n");
+  fprintf(out, "  call QWORD PTR [rax + __mcsema_reg_state@TLSCALL]\n");
+}
+
+// Spill vector registers `[0, num_regs)` into the `State` structure pointed
+// to by `RDI`. The `State` lines are read back almost immediately, so these
+// are ordinary (cache-resident) stores. With AVX, the full `YMM` register is
+// saved so that the upper halves survive the transition.
+static void PrintSaveVecRegs(FILE *out, unsigned num_regs) {
+  const auto stride = __builtin_offsetof(State, XMM1) -
+                      __builtin_offsetof(State, XMM0);
+  for (unsigned i = 0; i < num_regs; ++i) {
+#ifdef MCSEMA_RUNTIME_USE_AVX
+    fprintf(out, "  vmovdqu [rdi + %" PRIuMAX "], ymm%u\n", __builtin_offsetof(State, YMM0) + i * stride, i);
+#else
+    fprintf(out, "  movdqa [rdi + %" PRIuMAX "], xmm%u\n", __builtin_offsetof(State, XMM0) + i * stride, i);
+#endif
+  }
+}
+
+// Reload vector registers `[0, num_regs)` from the `State` structure pointed
+// to by `RDI`.
+static void PrintLoadVecRegs(FILE *out, unsigned num_regs) {
+  const auto stride = __builtin_offsetof(State, XMM1) -
+                      __builtin_offsetof(State, XMM0);
+  for (unsigned i = 0; i < num_regs; ++i) {
+#ifdef MCSEMA_RUNTIME_USE_AVX
+    fprintf(out, "  vmovdqu ymm%u, [rdi + %" PRIuMAX "]\n", i, __builtin_offsetof(State, YMM0) + i * stride);
+#else
+    fprintf(out, "  movdqa xmm%u, [rdi + %" PRIuMAX "]\n", i, __builtin_offsetof(State, XMM0) + i * stride);
+#endif
+  }
+}
+
+// The arithmetic flags are left in whatever state the lifted code put them
+// in. The ABI treats them as undefined across calls and returns, and only
+// requires that the direction flag be clear.
 static void PrintStoreFlags(FILE * out) {
   // FPU control.
   fprintf(out, "  fnstcw WORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, x87.fxsave.cwd));
-
-  fprintf(out, "  pushfq\n");
-  fprintf(out, "  mov edx, 0xcd5\n");
-  fprintf(out, "  not rdx\n");
-  fprintf(out, "  and QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, CF));
-  fprintf(out, "  shl edx, 0\n");
-  fprintf(out, "  or QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, PF));
-  fprintf(out, "  shl edx, 2\n");
-  fprintf(out, "  or QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, AF));
-  fprintf(out, "  shl edx, 4\n");
-  fprintf(out, "  or QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, ZF));
-  fprintf(out, "  shl edx, 6\n");
-  fprintf(out, "  or QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, SF));
-  fprintf(out, "  shl edx, 7\n");
-  fprintf(out, "  or QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, DF));
-  fprintf(out, "  shl edx, 10\n");
-  fprintf(out, "  or QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  mov edx, 1\n");
-  fprintf(out, "  and dl, BYTE PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, OF));
-  fprintf(out, "  shl edx, 11\n");
-  fprintf(out, "  or QWORD PTR [rsp], rdx\n");
-
-  fprintf(out, "  popfq\n");
+  fprintf(out, "  cld\n");
 }
 
+// The native RFlags are saved, packed, into `State::rflag`. They are not
+// marshaled into the `ArithFlags` struct here; instead, the lifted code
+// entered through `__mcsema_attach_call` unpacks only those flags that it
+// reads before writing.
 static void PrintLoadFlags(FILE * out) {
   // FPU control.
   fprintf(out, "  push dx\n");
@@ -87,37 +121,12 @@ static void PrintLoadFlags(FILE * out) {
   fprintf(out, "  pushfq\n");
   fprintf(out, "  pop rdx\n");
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rdx\n", __builtin_offsetof(State, rflag));
-
-  // Clear our the `ArithFlags` struct, which is 16 bytes.
-  fprintf(out, "  mov QWORD PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, aflag));
-  fprintf(out, "  mov QWORD PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, aflag) + 8);
-
-  // Marshal the RFlags into the ArithFlags struct.
-  fprintf(out, "  bt rdx, 0\n");
-  fprintf(out, "  adc BYTE PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, CF));
-
-  fprintf(out, "  bt rdx, 2\n");
-  fprintf(out, "  adc BYTE PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, PF));
-
-  fprintf(out, "  bt rdx, 4\n");
-  fprintf(out, "  adc BYTE PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, AF));
-
-  fprintf(out, "  bt rdx, 6\n");
-  fprintf(out, "  adc BYTE PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, ZF));
-
-  fprintf(out, "  bt rdx, 7\n");
-  fprintf(out, "  adc BYTE PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, SF));
-
-  fprintf(out, "  bt rdx, 10\n");
-  fprintf(out, "  adc BYTE PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, DF));
-
-  fprintf(out, "  bt rdx, 11\n");
-  fprintf(out, "  adc BYTE PTR [rdi + %" PRIuMAX "], 0\n", __builtin_offsetof(State, OF));
 }
 
-int main(void) {
+int main(int argc, char *argv[]) {
+  gPIC = argc > 1 && !strcmp(argv[1], "--pic");
 
-  FILE *out = fopen("runtime_64.S", "w");
+  FILE *out = fopen(gPIC ? "runtime_64_pic.S" : "runtime_64.S", "w");
 
   fprintf(out, "/* Auto-generated file! Don't modify! */\n\n");
   fprintf(out, "  .intel_syntax noprefix\n");
@@ -126,6 +135,9 @@ int main(void) {
 
   // Thread-local state structure, named by `__mcsema_reg_state`.
   fprintf(out, "  .type __mcsema_reg_state,@object\n");
+  if (gPIC) {
+    fprintf(out, "  .hidden __mcsema_reg_state\n");
+  }
   fprintf(out, "  .section .tbss,\"awT\",@nobits\n");
   fprintf(out, "  .align 16\n");
   fprintf(out, "__mcsema_reg_state:\n");
@@ -135,6 +147,9 @@ int main(void) {
 
   // Thread-local stack structure, named by `__mcsema_stack`.
   fprintf(out, "  .type __mcsema_stack,@object\n");
+  if (gPIC) {
+    fprintf(out, "  .hidden __mcsema_stack\n");
+  }
   fprintf(out, "  .section .tbss,\"awT\",@nobits\n");
   fprintf(out, "  .align 16\n");
   fprintf(out, "__mcsema_stack:\n");
@@ -146,39 +161,70 @@ int main(void) {
   fprintf(out, "\n");
 
   // Forward declarations.
-  fprintf(out, "  .globl __mcsema_detach_ret\n");
+  PrintGlobal(out, "__mcsema_detach_ret");
   fprintf(out, "\n");
 
   // Implements `__mcsema_attach_call`. This goes from native state into lifted
   // code.
-  fprintf(out, "  .globl __mcsema_attach_call\n");
+  PrintGlobal(out, "__mcsema_attach_call");
   fprintf(out, "  .type __mcsema_attach_call,@function\n");
   fprintf(out, "__mcsema_attach_call:\n");
   fprintf(out, "  .cfi_startproc\n");
 
-  // Save off the first three args of the ABI.
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, RDI));
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdx\n", __builtin_offsetof(State, RDX));
+  // The return address into the native caller is above the two words that
+  // the callback thunk pushed.
+  fprintf(out, "  .cfi_def_cfa_offset 24\n");
 
   // On the stack:
   //     0  EA of the lifted function (from the CFG).
   //     8  Address of the lifted function (from the bitcode).
   //    16  Return address into native caller.
 
-  // Set up the `FS` segment register so that TLS works :-)
-  fprintf(out, "  mov rsi, QWORD PTR fs:[0]\n");
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, FS_BASE));
+  if (gPIC) {
+
+    // Keep `RAX` on the stack while the TLS descriptor is called.
+    fprintf(out, "  push rax\n");
+    fprintf(out, "  .cfi_def_cfa_offset 32\n");
+    PrintGetStateOffset(out);
+
+    // Save off the first three args of the ABI.
+    fprintf(out, "  mov fs:[rax + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
+    fprintf(out, "  mov fs:[rax + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, RDI));
+    fprintf(out, "  mov fs:[rax + %" PRIuMAX "], rdx\n", __builtin_offsetof(State, RDX));
+
+    // Set up the `FS` segment register so that TLS works :-)
+    fprintf(out, "  mov rsi, QWORD PTR fs:[0]\n");
+    fprintf(out, "  mov fs:[rax + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, FS_BASE));
+
+    // Get arg (rdi) to contain the State pointer.
+    fprintf(out, "  lea rdi, QWORD PTR [rsi + rax]\n");
+    fprintf(out, "  pop QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RAX));
+    fprintf(out, "  .cfi_def_cfa_offset 24\n");
+
+  } else {
 
-  // Get arg (rdi) to contain the State pointer.
-  fprintf(out, "  lea rdi, QWORD PTR [__mcsema_reg_state@TPOFF]\n");
-  fprintf(out, "  lea rdi, QWORD PTR [rsi + rdi]\n");
+    // Save off the first three args of the ABI.
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, RDI));
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdx\n", __builtin_offsetof(State, RDX));
+
+    // Set up the `FS` segment register so that TLS works :-)
+    fprintf(out, "  mov rsi, QWORD PTR fs:[0]\n");
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, FS_BASE));
+
+    // Get arg (rdi) to contain the State pointer.
+    fprintf(out, "  lea rdi, QWORD PTR [__mcsema_reg_state@TPOFF]\n");
+    fprintf(out, "  lea rdi, QWORD PTR [rsi + rdi]\n");
+  }
 
   // Get the program counter off of the stack.
   fprintf(out, "  pop QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RIP));
+  fprintf(out, "  .cfi_def_cfa_offset 16\n");
 
   // Remaining general purpose registers.
-  fprintf(out, "  mov [rdi + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RAX));
+  if (!gPIC) {
+    fprintf(out, "  mov [rdi + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RAX));
+  }
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rbx\n", __builtin_offsetof(State, RBX));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rcx\n", __builtin_offsetof(State, RCX));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rbp\n", __builtin_offsetof(State, RBP));
@@ -193,45 +239,39 @@ int main(void) {
 
   PrintLoadFlags(out);  // Note: Clobbers RDX.
 
-  // XMM registers.
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm0\n", __builtin_offsetof(State, XMM0));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm1\n", __builtin_offsetof(State, XMM1));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm2\n", __builtin_offsetof(State, XMM2));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm3\n", __builtin_offsetof(State, XMM3));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm4\n", __builtin_offsetof(State, XMM4));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm5\n", __builtin_offsetof(State, XMM5));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm6\n", __builtin_offsetof(State, XMM6));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm7\n", __builtin_offsetof(State, XMM7));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm8\n", __builtin_offsetof(State, XMM8));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm9\n", __builtin_offsetof(State, XMM9));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm10\n", __builtin_offsetof(State, XMM10));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm11\n", __builtin_offsetof(State, XMM11));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm12\n", __builtin_offsetof(State, XMM12));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm13\n", __builtin_offsetof(State, XMM13));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm14\n", __builtin_offsetof(State, XMM14));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm15\n", __builtin_offsetof(State, XMM15));
+  // Vector registers that may hold arguments.
+  PrintSaveVecRegs(out, kNumArgVecRegs);
 
   // If `RSP` is null then we need to initialize it to our new stack.
   fprintf(out, "  mov rdx, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
   fprintf(out, "  cmp rdx, 0\n");
   fprintf(out, "  jnz .Lhave_stack\n");
-  fprintf(out, "  lea r8, QWORD PTR [__mcsema_stack@TPOFF]\n");
-  fprintf(out, "  mov rsi, fs:[0];\n");
-  fprintf(out, "  lea rdx, QWORD PTR [rsi + r8 + %" PRIuMAX "]\n", (kStackSize - 16));
+  if (gPIC) {
+
+    // Both are in this object's `.tbss`, so their distance is a constant.
+    fprintf(out, "  lea rdx, QWORD PTR [rdi + __mcsema_stack - __mcsema_reg_state + %" PRIuMAX "]\n", (kStackSize - 16));
+  } else {
+    fprintf(out, "  lea r8, QWORD PTR [__mcsema_stack@TPOFF]\n");
+    fprintf(out, "  mov rsi, fs:[0];\n");
+    fprintf(out, "  lea rdx, QWORD PTR [rsi + r8 + %" PRIuMAX "]\n", (kStackSize - 16));
+  }
   fprintf(out, ".Lhave_stack:\n");
 
-  // Set up a return address so that when the lifted function returns, it will
-  // go to `__mcsema_detach_ret`, which will return to native code.
-  fprintf(out, "  lea rax, [rip + __mcsema_detach_ret]\n");
-  fprintf(out, "  mov [rdx - 8], rax\n");
-
-  // Put the address of the lifted function onto the lifted stack, so that we
-  // can `RET` into the lifted function.
-  fprintf(out, "  pop QWORD PTR [rdx - 16]\n");
+  // Get the address of the lifted function off of the stack.
+  fprintf(out, "  pop rax\n");
+  fprintf(out, "  .cfi_def_cfa_offset 8\n");
 
-  // Swap onto the lifted stack. The native `RSP` is now where it should be.
+  // Swap onto the lifted stack. The native `RSP` is now where it should be,
+  // i.e. pointing at the return address into the native caller.
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rsp\n", __builtin_offsetof(State, RSP));
-  fprintf(out, "  lea rsp, [rdx - 16]\n");
+  fprintf(out, "  mov rsp, rdx\n");
+
+  // The lifted code moves `State::RSP` around, so keep the native stack
+  // pointer on the lifted stack where unwinders can find it. Two copies keep
+  // the lifted stack aligned. From here on, the CFA is `[rsp] + 8`.
+  fprintf(out, "  push QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
+  fprintf(out, "  push QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
+  fprintf(out, "  .cfi_escape 0x0f, 0x05, 0x77, 0x00, 0x06, 0x23, 0x08\n");
 
   // Set up arg2 as the program counter.
   fprintf(out, "  mov rsi, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RIP));
@@ -239,14 +279,14 @@ int main(void) {
   // Set up arg3 as the memory pointer, which is (for now?) a nullptr.
   fprintf(out, "  xor rdx, rdx\n");
 
-  // The address of the lifted function is still on the stack, and `RDX` holds
-  // the native PC of the original function.
-
-  // RDX currently holds the address of the lifted function (where we want to
-  // go). Inside of the lifted function, RDX (arg3 of AMD64 ABI) needs to hold
-  // the same thing as State::RIP. So, push on the address of the lifted
-  // function, get RDX right, then `RET` to the lifted function.
-  fprintf(out, "  ret\n");
+  // Enter the lifted function with a real `call`, so that its `ret` is
+  // paired with it in the CPU's return stack buffer. Once the lifted function
+  // returns, `__mcsema_detach_ret` goes back to native code. The stashed
+  // native stack pointer stays readable in the red zone, at `[rsp - 16]`.
+  fprintf(out, "  call rax\n");
+  fprintf(out, "  add rsp, 16\n");
+  fprintf(out, "  .cfi_escape 0x0f, 0x05, 0x77, 0x70, 0x06, 0x23, 0x08\n");
+  fprintf(out, "  jmp __mcsema_detach_ret\n");
 
   fprintf(out, ".Lfunc_end1:\n");
   fprintf(out, "  .size __mcsema_attach_call,.Lfunc_end1-__mcsema_attach_call\n");
@@ -256,14 +296,29 @@ int main(void) {
   // Implements `__mcsema_detach_ret`. This goes from lifted code into native code.
   // The native code pointer is located at the native `[State::RSP - 8]`
   // address.
-  fprintf(out, "  .globl __mcsema_detach_ret\n");
+  PrintGlobal(out, "__mcsema_detach_ret");
   fprintf(out, "  .type __mcsema_detach_ret,@function\n");
   fprintf(out, "__mcsema_detach_ret:\n");
   fprintf(out, "  .cfi_startproc\n");
 
+  // Only ever reached from `__mcsema_attach_call`, which left the native
+  // stack pointer at `[rsp - 16]`.
+  fprintf(out, "  .cfi_escape 0x0f, 0x05, 0x77, 0x70, 0x06, 0x23, 0x08\n");
+
   // RAX holds the memory pointer, which is null.
+  if (gPIC) {
+
+    // Move the stashed native stack pointer out of the way of the TLS
+    // descriptor call.
+    fprintf(out, "  sub rsp, 16\n");
+    fprintf(out, "  .cfi_escape 0x0f, 0x05, 0x77, 0x00, 0x06, 0x23, 0x08\n");
+    PrintGetStateOffset(out);
+    fprintf(out, "  add rsp, 16\n");
+    fprintf(out, "  .cfi_escape 0x0f, 0x05, 0x77, 0x70, 0x06, 0x23, 0x08\n");
+  } else {
+    fprintf(out, "  lea rax, QWORD PTR [__mcsema_reg_state@TPOFF]\n");
+  }
   fprintf(out, "  mov rdi, QWORD PTR fs:[0]\n");
-  fprintf(out, "  lea rax, QWORD PTR [__mcsema_reg_state@TPOFF]\n");
   fprintf(out, "  lea rdi, QWORD PTR [rdi + rax]\n");
 
   // The lifted code emulated a ret, which incremented `rsp` by 8.
@@ -272,8 +327,9 @@ int main(void) {
   // next attach can continue on where we left off.
   fprintf(out, "  sub QWORD PTR [rdi + %" PRIuMAX "], 8\n", __builtin_offsetof(State, RSP));
   fprintf(out, "  xchg [rdi + %" PRIuMAX "], rsp\n", __builtin_offsetof(State, RSP));
+  fprintf(out, "  .cfi_def_cfa rsp, 8\n");
 
-  PrintStoreFlags(out);  // Clobbers RDX.
+  PrintStoreFlags(out);
 
   // General purpose registers.
   fprintf(out, "  mov rax, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RAX));
@@ -291,23 +347,8 @@ int main(void) {
   fprintf(out, "  mov r14, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, R14));
   fprintf(out, "  mov r15, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, R15));
 
-  // XMM registers.
-  fprintf(out, "  movntdqa xmm0, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM0));
-  fprintf(out, "  movntdqa xmm1, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM1));
-  fprintf(out, "  movntdqa xmm2, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM2));
-  fprintf(out, "  movntdqa xmm3, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM3));
-  fprintf(out, "  movntdqa xmm4, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM4));
-  fprintf(out, "  movntdqa xmm5, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM5));
-  fprintf(out, "  movntdqa xmm6, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM6));
-  fprintf(out, "  movntdqa xmm7, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM7));
-  fprintf(out, "  movntdqa xmm8, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM8));
-  fprintf(out, "  movntdqa xmm9, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM9));
-  fprintf(out, "  movntdqa xmm10, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM10));
-  fprintf(out, "  movntdqa xmm11, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM11));
-  fprintf(out, "  movntdqa xmm12, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM12));
-  fprintf(out, "  movntdqa xmm13, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM13));
-  fprintf(out, "  movntdqa xmm14, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM14));
-  fprintf(out, "  movntdqa xmm15, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM15));
+  // Vector registers that may hold return values.
+  PrintLoadVecRegs(out, kNumRetVecRegs);
 
   fprintf(out, "  mov rdi, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RDI));
   fprintf(out, "  ret\n");
@@ -319,60 +360,70 @@ int main(void) {
 
   // Implements `__remill_function_call`. This is a fully generic form of function
   // call detaching that is unaware of the ABI / calling convention of the target.
-  fprintf(out, "  .globl __remill_jump\n");
+  PrintGlobal(out, "__remill_jump");
   fprintf(out, "  .type __remill_jump,@function\n");
 
   fprintf(out, "__remill_jump:\n");
-  fprintf(out, "  .globl __remill_function_call\n");
+  PrintGlobal(out, "__remill_function_call");
   fprintf(out, "  .type __remill_function_call,@function\n");
   fprintf(out, "__remill_function_call:\n");
   fprintf(out, ".Lfunc_begin5:\n");
   fprintf(out, "  .cfi_startproc\n");
 
-  // Stash the memory pointer. This is probably actually nothing. But for
-  // generality, we will store and return it, as is expected by the prototype
-  // of `__remill_function_call` (see remill/Arch/Runtime/Intrinsics.h).
-  fprintf(out, "  push rdx\n");  // Alignment.
-  fprintf(out, "  push rdx\n");
+  // Build a frame record, so that frame pointer-based unwinders can walk from
+  // the native target back into lifted code. `RBP` keeps pointing at it for
+  // the whole native call, and everything below is at a fixed offset from it.
+  fprintf(out, "  push rbp\n");
+  fprintf(out, "  .cfi_def_cfa_offset 16\n");
+  fprintf(out, "  .cfi_offset rbp, -16\n");
+  fprintf(out, "  mov rbp, rsp\n");
+  fprintf(out, "  .cfi_def_cfa_register rbp\n");
 
   // Stash the callee-saved registers (amd64 ABI). These registers need to
   // be restored later so that things are as they should be when we return
   // back onto the lifted stack.
   fprintf(out, "  push rbx\n");
-  fprintf(out, "  push rbp\n");
+  fprintf(out, "  .cfi_offset rbx, -24\n");
   fprintf(out, "  push r12\n");
+  fprintf(out, "  .cfi_offset r12, -32\n");
   fprintf(out, "  push r13\n");
+  fprintf(out, "  .cfi_offset r13, -40\n");
   fprintf(out, "  push r14\n");
+  fprintf(out, "  .cfi_offset r14, -48\n");
   fprintf(out, "  push r15\n");
+  fprintf(out, "  .cfi_offset r15, -56\n");
 
-//  fprintf(out, "  push rcx\n");
-//  fprintf(out, "  push rdx\n");
-//  fprintf(out, "  push r8\n");
-//  fprintf(out, "  push r9\n");
-//  fprintf(out, "  push r10\n");
-//  fprintf(out, "  push r11\n");
-
+  // Stash the memory pointer. This is probably actually nothing. But for
+  // generality, we will store and return it, as is expected by the prototype
+  // of `__remill_function_call` (see remill/Arch/Runtime/Intrinsics.h).
+  fprintf(out, "  push rdx\n");
 
-  // Stash the return address stored on the native stack, the replace it
-  // with the re-attach function.
+  // Stash the emulated return address stored on the native stack, then pop
+  // it off of the native stack. The native `call` below puts a real return
+  // address into the same stack slot, so the target sees the same stack.
   fprintf(out, "  mov r15, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
   fprintf(out, "  push QWORD PTR [r15]\n");
-  fprintf(out, "  lea r14, [rip + __mcsema_attach_ret]\n");
-  fprintf(out, "  mov QWORD PTR [r15], r14\n");
+  fprintf(out, "  add r15, 8\n");
+
+  // The target gets our frame record in `RBP` instead of the emulated `RBP`.
+  // It is callee-saved, so nobody but unwinders looks at its value, but a
+  // callback into lifted code would overwrite `State::RBP` with it.
+  fprintf(out, "  push QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RBP));
 
-  // Emulate a push of the target address onto the native stack. We will
-  // `ret` to the target later on.
+  // Stash the `State` pointer and the target address in the frame, where
+  // `RBP` lets the `call` below and `__mcsema_attach_ret` reach them without
+  // needing a register, or going through TLS.
   //
   // Note: The target address is passed as arg2 (pc) to `__remill_function_call`
   //       which is `RSI` in the AMD64 ABI.
-  fprintf(out, "  sub r15, 8\n");
-  fprintf(out, "  mov QWORD PTR [r15], rsi\n");
+  fprintf(out, "  push rdi\n");
+  fprintf(out, "  push rsi\n");
 
   // Swap off-stack, stash the lifted stack pointer.
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rsp\n", __builtin_offsetof(State, RSP));
   fprintf(out, "  mov rsp, r15\n");
 
-  PrintStoreFlags(out);  // Clobbers RDX.
+  PrintStoreFlags(out);
 
   // (Most) General purpose registers.
   fprintf(out, "  mov rax, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RAX));
@@ -380,7 +431,6 @@ int main(void) {
   fprintf(out, "  mov rcx, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RCX));
   fprintf(out, "  mov rdx, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RDX));
   fprintf(out, "  mov rsi, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RSI));
-  fprintf(out, "  mov rbp, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RBP));
   fprintf(out, "  mov r8, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, R8));
   fprintf(out, "  mov r9, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, R9));
   fprintf(out, "  mov r10, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, R10));
@@ -390,33 +440,19 @@ int main(void) {
   fprintf(out, "  mov r14, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, R14));
   fprintf(out, "  mov r15, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, R15));
 
-  // XMM registers.
-  fprintf(out, "  movntdqa xmm0, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM0));
-  fprintf(out, "  movntdqa xmm1, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM1));
-  fprintf(out, "  movntdqa xmm2, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM2));
-  fprintf(out, "  movntdqa xmm3, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM3));
-  fprintf(out, "  movntdqa xmm4, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM4));
-  fprintf(out, "  movntdqa xmm5, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM5));
-  fprintf(out, "  movntdqa xmm6, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM6));
-  fprintf(out, "  movntdqa xmm7, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM7));
-  fprintf(out, "  movntdqa xmm8, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM8));
-  fprintf(out, "  movntdqa xmm9, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM9));
-  fprintf(out, "  movntdqa xmm10, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM10));
-  fprintf(out, "  movntdqa xmm11, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM11));
-  fprintf(out, "  movntdqa xmm12, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM12));
-  fprintf(out, "  movntdqa xmm13, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM13));
-  fprintf(out, "  movntdqa xmm14, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM14));
-  fprintf(out, "  movntdqa xmm15, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, XMM15));
+  // Vector registers that may hold arguments.
+  PrintLoadVecRegs(out, kNumArgVecRegs);
 
   // Swap out RDI.
   fprintf(out, "  mov rdi, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RDI));
 
-  // Code above put the native target address (stored in RDI on entry to
-  // `__remill_function_call`) on the stack, just below the return address,
-  // which is now `__mcsema_attach_ret`), so we can `ret` and go to our
-  // intended target.
+  // Call the target with a real `call`, instead of returning into it, so
+  // that every native call and return stays paired in the CPU's return stack
+  // buffer. When the target returns, `__mcsema_attach_ret` goes back into
+  // lifted code.
   fprintf(out, ".Ltmp1000:\n");
-  fprintf(out, "  ret\n");
+  fprintf(out, "  call QWORD PTR [rbp - 80]\n");
+  fprintf(out, "  jmp __mcsema_attach_ret\n");
 
   fprintf(out, ".Lfunc_end5:\n");
   fprintf(out, "  .size __remill_function_call,.Lfunc_end5-__remill_function_call\n");
@@ -425,28 +461,37 @@ int main(void) {
 
   // Implements `__mcsema_attach_ret`. This goes from native state into lifted
   // code.
-  fprintf(out, "  .globl __mcsema_attach_ret\n");
+  PrintGlobal(out, "__mcsema_attach_ret");
   fprintf(out, "  .type __mcsema_attach_ret,@function\n");
   fprintf(out, "__mcsema_attach_ret:\n");
   fprintf(out, "  .cfi_startproc\n");
 
-  // Copy RSI, then store the address of the reg state struct into RSI for
-  // easier indexing later on. Also set up the `FS` segment register so that
-  // TLS works :-)
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, RDI));
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
+  // Only ever reached from `__remill_function_call`, whose frame record is
+  // still in `RBP`.
+  fprintf(out, "  .cfi_def_cfa rbp, 16\n");
+  fprintf(out, "  .cfi_offset rbp, -16\n");
+  fprintf(out, "  .cfi_offset rbx, -24\n");
+  fprintf(out, "  .cfi_offset r12, -32\n");
+  fprintf(out, "  .cfi_offset r13, -40\n");
+  fprintf(out, "  .cfi_offset r14, -48\n");
+  fprintf(out, "  .cfi_offset r15, -56\n");
+
+  // Get the address of the reg state struct into RDI from the frame of
+  // `__remill_function_call`, after saving RDI. Also set up the `FS` segment
+  // register so that TLS works :-)
+  fprintf(out, "  push rdi\n");
+  fprintf(out, "  mov rdi, [rbp - 72]\n");
+  fprintf(out, "  pop QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RDI));
+  fprintf(out, "  mov [rdi + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
 
-  fprintf(out, "  mov rdi, QWORD PTR fs:[0]\n");
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, FS_BASE));
-  fprintf(out, "  lea rsi, [__mcsema_reg_state@TPOFF]\n");
-  fprintf(out, "  lea rdi, QWORD PTR [rsi + rdi]\n");
+  fprintf(out, "  mov rsi, QWORD PTR fs:[0]\n");
+  fprintf(out, "  mov [rdi + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, FS_BASE));
 
   // General purpose registers.
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RAX));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rbx\n", __builtin_offsetof(State, RBX));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rcx\n", __builtin_offsetof(State, RCX));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rdx\n", __builtin_offsetof(State, RDX));
-  fprintf(out, "  mov [rdi + %" PRIuMAX "], rbp\n", __builtin_offsetof(State, RBP));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], r8\n", __builtin_offsetof(State, R8));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], r9\n", __builtin_offsetof(State, R9));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], r10\n", __builtin_offsetof(State, R10));
@@ -459,58 +504,46 @@ int main(void) {
   // Swap into the mcsema stack.
   fprintf(out, "  xchg rsp, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
 
-  // XMM registers.
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm0\n", __builtin_offsetof(State, XMM0));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm1\n", __builtin_offsetof(State, XMM1));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm2\n", __builtin_offsetof(State, XMM2));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm3\n", __builtin_offsetof(State, XMM3));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm4\n", __builtin_offsetof(State, XMM4));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm5\n", __builtin_offsetof(State, XMM5));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm6\n", __builtin_offsetof(State, XMM6));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm7\n", __builtin_offsetof(State, XMM7));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm8\n", __builtin_offsetof(State, XMM8));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm9\n", __builtin_offsetof(State, XMM9));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm10\n", __builtin_offsetof(State, XMM10));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm11\n", __builtin_offsetof(State, XMM11));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm12\n", __builtin_offsetof(State, XMM12));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm13\n", __builtin_offsetof(State, XMM13));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm14\n", __builtin_offsetof(State, XMM14));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm15\n", __builtin_offsetof(State, XMM15));
+  // Vector registers that may hold return values.
+  PrintSaveVecRegs(out, kNumRetVecRegs);
 
   PrintLoadFlags(out);  // Note: Clobbers RDX.
 
   // On the mcsema stack:
-  //     0    emulated return address.
-  //     8    stashed r15
-  //    16    stashed r14
-  //    24    stashed r13
-  //    32    stashed r12
-  //    40    stashed rbp
-  //    48    stashed rbx
-
-  // Restore emulated return address.
+  //     0    target address
+  //     8    state pointer
+  //    16    emulated rbp
+  //    24    emulated return address.
+  //    32    stashed memory pointer
+  //    40    stashed r15
+  //    48    stashed r14
+  //    56    stashed r13
+  //    64    stashed r12
+  //    72    stashed rbx
+  //    80    stashed rbp (frame record)
+
+  // Restore the emulated `RBP` and return address.
+  fprintf(out, "  add rsp, 16\n");
+  fprintf(out, "  pop QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RBP));
   fprintf(out, "  pop QWORD PTR [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RIP));
 
-//
-//  fprintf(out, "  pop r11\n");
-//  fprintf(out, "  pop r10\n");
-//  fprintf(out, "  pop r9\n");
-//  fprintf(out, "  pop r8\n");
-//  fprintf(out, "  pop rdx\n");
-//  fprintf(out, "  pop rcx\n");
-
+  // Stashed memory pointer (for returning).
+  fprintf(out, "  pop rax\n");
 
   // Callee-saved registers.
   fprintf(out, "  pop r15\n");
+  fprintf(out, "  .cfi_restore r15\n");
   fprintf(out, "  pop r14\n");
+  fprintf(out, "  .cfi_restore r14\n");
   fprintf(out, "  pop r13\n");
+  fprintf(out, "  .cfi_restore r13\n");
   fprintf(out, "  pop r12\n");
-  fprintf(out, "  pop rbp\n");
+  fprintf(out, "  .cfi_restore r12\n");
   fprintf(out, "  pop rbx\n");
-
-  // Stashed memory pointer (for returning).
-  fprintf(out, "  pop rax\n");  // Alignment.
-  fprintf(out, "  pop rax\n");
+  fprintf(out, "  .cfi_restore rbx\n");
+  fprintf(out, "  pop rbp\n");
+  fprintf(out, "  .cfi_restore rbp\n");
+  fprintf(out, "  .cfi_def_cfa rsp, 8\n");
   fprintf(out, "  ret\n");
 
   fprintf(out, ".Lfunc_end2:\n");
@@ -524,19 +557,30 @@ int main(void) {
   // Arguments: RDI -> stack pointer
   //            RSI -> base pointer
 
-  fprintf(out, "  .globl __mcsema_exception_ret\n");
+  PrintGlobal(out, "__mcsema_exception_ret");
   fprintf(out, "  .type __mcsema_exception_ret,@function\n");
   fprintf(out, "__mcsema_exception_ret:\n");
   fprintf(out, ".Lfunc_begin10:\n");
   fprintf(out, ".cfi_startproc\n");
 
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, RDI));
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
+  if (gPIC) {
+    PrintGetStateOffset(out);  // `RAX` is not saved.
+    fprintf(out, "  mov fs:[rax + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, RDI));
+    fprintf(out, "  mov fs:[rax + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
 
-  fprintf(out, "  mov rdi, QWORD PTR fs:[0]\n");
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, FS_BASE));
-  fprintf(out, "  lea rsi, [__mcsema_reg_state@TPOFF]\n");
-  fprintf(out, "  lea rdi, QWORD PTR [rsi + rdi]\n");
+    fprintf(out, "  mov rdi, QWORD PTR fs:[0]\n");
+    fprintf(out, "  mov fs:[rax + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, FS_BASE));
+    fprintf(out, "  lea rdi, QWORD PTR [rax + rdi]\n");
+
+  } else {
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, RDI));
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rsi\n", __builtin_offsetof(State, RSI));
+
+    fprintf(out, "  mov rdi, QWORD PTR fs:[0]\n");
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rdi\n", __builtin_offsetof(State, FS_BASE));
+    fprintf(out, "  lea rsi, [__mcsema_reg_state@TPOFF]\n");
+    fprintf(out, "  lea rdi, QWORD PTR [rsi + rdi]\n");
+  }
 
   // General purpose registers.
   //fprintf(out, "  mov [rdi + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RAX));
@@ -545,10 +589,10 @@ int main(void) {
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rdx\n", __builtin_offsetof(State, RDX));
 
   // Sets the native stack and base pointers
-  fprintf(out, "  mov rax, fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "]\n", __builtin_offsetof(State, RDI));
+  fprintf(out, "  mov rax, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RDI));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RSP));
   fprintf(out, "  add QWORD PTR [rdi + %" PRIuMAX "], 8\n", __builtin_offsetof(State, RSP));
-  fprintf(out, "  mov rax, fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "]\n", __builtin_offsetof(State, RSI));
+  fprintf(out, "  mov rax, [rdi + %" PRIuMAX "]\n", __builtin_offsetof(State, RSI));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RBP));
 
 
@@ -561,23 +605,9 @@ int main(void) {
   fprintf(out, "  mov [rdi + %" PRIuMAX "], r14\n", __builtin_offsetof(State, R14));
   fprintf(out, "  mov [rdi + %" PRIuMAX "], r15\n", __builtin_offsetof(State, R15));
 
-  // XMM registers.
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm0\n", __builtin_offsetof(State, XMM0));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm1\n", __builtin_offsetof(State, XMM1));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm2\n", __builtin_offsetof(State, XMM2));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm3\n", __builtin_offsetof(State, XMM3));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm4\n", __builtin_offsetof(State, XMM4));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm5\n", __builtin_offsetof(State, XMM5));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm6\n", __builtin_offsetof(State, XMM6));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm7\n", __builtin_offsetof(State, XMM7));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm8\n", __builtin_offsetof(State, XMM8));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm9\n", __builtin_offsetof(State, XMM9));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm10\n", __builtin_offsetof(State, XMM10));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm11\n", __builtin_offsetof(State, XMM11));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm12\n", __builtin_offsetof(State, XMM12));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm13\n", __builtin_offsetof(State, XMM13));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm14\n", __builtin_offsetof(State, XMM14));
-  fprintf(out, "  movntdq [rdi + %" PRIuMAX "], xmm15\n", __builtin_offsetof(State, XMM15));
+  // Vector registers. The landing pad may be anywhere in the function, so
+  // save all of them.
+  PrintSaveVecRegs(out, kNumVecRegs);
 
   fprintf(out, "  ret\n");
   fprintf(out, "  ud2\n");
@@ -587,11 +617,16 @@ int main(void) {
   fprintf(out, "\n");
 
   // Implements `__mcsema_get_stack_pointer`. Returns the stack pointer register.
-  fprintf(out, "  .globl __mcsema_get_stack_pointer\n");
+  PrintGlobal(out, "__mcsema_get_stack_pointer");
   fprintf(out, "  .type __mcsema_get_stack_pointer,@function\n");
   fprintf(out, "__mcsema_get_stack_pointer:\n");
   fprintf(out, "  .cfi_startproc\n");
-  fprintf(out, "  mov rax, fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
+  if (gPIC) {
+    PrintGetStateOffset(out);
+    fprintf(out, "  mov rax, fs:[rax + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
+  } else {
+    fprintf(out, "  mov rax, fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "]\n", __builtin_offsetof(State, RSP));
+  }
   fprintf(out, "  ret\n");
   fprintf(out, ".Lfunc_end20:\n");
   fprintf(out, "  .size __mcsema_get_stack_pointer,.Lfunc_end20-__mcsema_get_stack_pointer\n");
@@ -599,11 +634,16 @@ int main(void) {
   fprintf(out, "\n");
 
   // Implements `__mcsema_get_frame_pointer`. Returns the base pointer register.
-  fprintf(out, "  .globl __mcsema_get_frame_pointer\n");
+  PrintGlobal(out, "__mcsema_get_frame_pointer");
   fprintf(out, "  .type __mcsema_get_frame_pointer,@function\n");
   fprintf(out, "__mcsema_get_frame_pointer:\n");
   fprintf(out, "  .cfi_startproc\n");
-  fprintf(out, "  mov rax, fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "]\n", __builtin_offsetof(State, RBP));
+  if (gPIC) {
+    PrintGetStateOffset(out);
+    fprintf(out, "  mov rax, fs:[rax + %" PRIuMAX "]\n", __builtin_offsetof(State, RBP));
+  } else {
+    fprintf(out, "  mov rax, fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "]\n", __builtin_offsetof(State, RBP));
+  }
   fprintf(out, "  ret\n");
   fprintf(out, ".Lfunc_end21:\n");
   fprintf(out, "  .size __mcsema_get_frame_pointer,.Lfunc_end21-__mcsema_get_frame_pointer\n");
@@ -611,11 +651,20 @@ int main(void) {
   fprintf(out, "\n");
 
   // Implements `__mcsema_get_type_index`. Returns the base pointer register.
-  fprintf(out, "  .globl __mcsema_get_type_index\n");
+  PrintGlobal(out, "__mcsema_get_type_index");
   fprintf(out, "  .type __mcsema_get_type_index,@function\n");
   fprintf(out, "__mcsema_get_type_index:\n");
   fprintf(out, "  .cfi_startproc\n");
-  fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RAX));
+  if (gPIC) {
+    fprintf(out, "  push rax\n");
+    fprintf(out, "  .cfi_def_cfa_offset 16\n");
+    PrintGetStateOffset(out);
+    fprintf(out, "  add rax, QWORD PTR fs:[0]\n");
+    fprintf(out, "  pop QWORD PTR [rax + %" PRIuMAX "]\n", __builtin_offsetof(State, RAX));
+    fprintf(out, "  .cfi_def_cfa_offset 8\n");
+  } else {
+    fprintf(out, "  mov fs:[__mcsema_reg_state@TPOFF + %" PRIuMAX "], rax\n", __builtin_offsetof(State, RAX));
+  }
   fprintf(out, "  mov rax, rdx\n");
   fprintf(out, "  ret\n");
   fprintf(out, ".Lfunc_end22:\n");
@@ -625,13 +674,18 @@ int main(void) {
 
   // Implements `__mcsema_debug_get_reg_state`. This is useful when debugging in
   // gdb.
-  fprintf(out, "  .globl __mcsema_debug_get_reg_state\n");
+  PrintGlobal(out, "__mcsema_debug_get_reg_state");
   fprintf(out, "  .type __mcsema_debug_get_reg_state,@function\n");
   fprintf(out, "__mcsema_debug_get_reg_state:\n");
   fprintf(out, "  .cfi_startproc\n");
-  fprintf(out, "  mov rax, fs:[0]\n");
-  fprintf(out, "  lea rdx, [__mcsema_reg_state@TPOFF]\n");
-  fprintf(out, "  lea rax, [rax + rdx]\n");
+  if (gPIC) {
+    PrintGetStateOffset(out);
+    fprintf(out, "  add rax, QWORD PTR fs:[0]\n");
+  } else {
+    fprintf(out, "  mov rax, fs:[0]\n");
+    fprintf(out, "  lea rdx, [__mcsema_reg_state@TPOFF]\n");
+    fprintf(out, "  lea rax, [rax + rdx]\n");
+  }
   fprintf(out, "  ret\n");
   fprintf(out, ".Lfunc_end6:\n");
   fprintf(out, "  .size __mcsema_debug_get_reg_state,.Lfunc_end6-__mcsema_debug_get_reg_state\n");
@@ -639,13 +693,13 @@ int main(void) {
   fprintf(out, "\n");
 
   // Error functions.
-  fprintf(out, "  .globl __remill_error\n");
+  PrintGlobal(out, "__remill_error");
   fprintf(out, "  .type __remill_error,@function\n");
 
-  fprintf(out, "  .globl __remill_missing_block\n");
+  PrintGlobal(out, "__remill_missing_block");
   fprintf(out, "  .type __remill_missing_block,@function\n");
 
-  fprintf(out, "  .globl __remill_function_return\n");
+  PrintGlobal(out, "__remill_function_return");
   fprintf(out, "  .type __remill_function_return,@function\n");
 
   fprintf(out, "__remill_error:\n");
@@ -24,13 +24,16 @@
 #include <string>
 #include <vector>
 
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/InlineAsm.h>
 #include <llvm/IR/Instruction.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
 
 #include <anvill/Decl.h>
@@ -73,7 +76,20 @@ DEFINE_uint32(explicit_args_stack_size, 4096 * 256  /* 1 MiB */,
 DEFINE_uint32(explicit_args_tls_size, 4 * 4096,
               "Number of bytes of thread local storage");
 
+DEFINE_bool(explicit_args_thread_local, true,
+            "Should the emulated stack and thread local storage used by "
+            "--explicit_args be thread-local variables? Symbolic executors "
+            "are typically single-threaded, and handle ordinary globals "
+            "more cheaply than thread-local ones.");
+
+DEFINE_bool(unpack_native_flags, true,
+            "Unpack the arithmetic flags out of the packed flags register "
+            "saved by the runtime when native code calls into lifted code. "
+            "Flags that the lifted code writes before reading them are not "
+            "unpacked.");
+
 DECLARE_bool(stack_protector);
+DECLARE_bool(local_state_pointer);
 
 namespace mcsema {
 namespace {
@@ -100,15 +116,144 @@ static llvm::Function *DetachCallValueFunc(void) {
   return handler;
 }
 
-// Get a callback function for an internal function.
-static llvm::Function *ImplementNativeToLiftedCallback(
-    const NativeObject *cfg_func, const std::string &callback_name) {
+// Name of the metadata attached to the stores that unpack the native flags.
+static constexpr const char *kFlagUnpackMetadata = "mcsema.flag_unpack";
+
+// Returns the index of `State::rflag`, which holds the packed native flags
+// as saved by `__mcsema_attach_call`, within the `State` structure. The
+// runtime no longer unpacks the flags itself, so lifted code would silently
+// run with stale arithmetic flags if we couldn't find it.
+static unsigned GetPackedFlagsIndex(void) {
+  static unsigned index = ~0u;
+  if (index != ~0u) {
+    return index;
+  }
 
-  // If the native name of the function doesn't yet exist then add it in.
-  auto func = gModule->getFunction(cfg_func->lifted_name);
-  CHECK(func != nullptr)
-      << "Cannot find lifted function " << cfg_func->lifted_name;
+  // `State::rflag` is the only member of type `Flags` in the x86 `State`
+  // structure.
+  const auto state_type = gArch->StateStructType();
+  for (auto i = 0u; i < state_type->getNumElements(); ++i) {
+    auto elem_type = llvm::dyn_cast<llvm::StructType>(
+        state_type->getElementType(i));
+    if (elem_type && elem_type->hasName() &&
+        (elem_type->getName() == "union.Flags" ||
+         elem_type->getName() == "struct.Flags")) {
+      index = i;
+      break;
+    }
+  }
+  CHECK(index != ~0u)
+      << "Unable to find the `rflag` member of the `State` structure";
+
+  return index;
+}
+
+// The runtime leaves the native flags packed in the state structure when
+// it enters lifted code. Unpack the arithmetic flags into the registers that
+// lifted code uses. Each store is tagged so that `RemoveDeadFlagUnpacks` can
+// remove it if the lifted function overwrites that flag before reading it.
+static void UnpackNativeFlags(llvm::BasicBlock *block, llvm::Value *state_ptr) {
+  switch (gArch->arch_name) {
+    case remill::kArchX86:
+    case remill::kArchX86_AVX:
+    case remill::kArchX86_AVX512:
+    case remill::kArchAMD64:
+    case remill::kArchAMD64_AVX:
+    case remill::kArchAMD64_AVX512:
+      break;
+    default:
+      return;
+  }
 
+  const auto state_type = gArch->StateStructType();
+  const auto flags_index = GetPackedFlagsIndex();
+
+  static const std::pair<const char *, unsigned> kFlagBits[] = {
+      {"CF", 0}, {"PF", 2}, {"AF", 4}, {"ZF", 6},
+      {"SF", 7}, {"DF", 10}, {"OF", 11}};
+
+  const auto md_id = gContext->getMDKindID(kFlagUnpackMetadata);
+  const auto md = llvm::MDNode::get(*gContext, llvm::None);
+
+  // The flat `EFLAGS` value is the first 32 bits of `State::rflag`.
+  llvm::IRBuilder<> ir(block);
+  auto flags_ref = ir.CreateBitCast(
+      ir.CreateStructGEP(state_type, state_ptr, flags_index),
+      llvm::Type::getInt32PtrTy(*gContext));
+  auto flags = ir.CreateLoad(flags_ref);
+  for (auto [flag_name, bit] : kFlagBits) {
+    const auto flag_reg = gArch->RegisterByName(flag_name);
+    if (!flag_reg) {
+      continue;
+    }
+    auto flag_ref = flag_reg->AddressOf(state_ptr, block);
+    ir.SetInsertPoint(block);
+    auto flag = ir.CreateAnd(ir.CreateLShr(flags, bit), 1);
+    auto store = ir.CreateStore(
+        ir.CreateZExtOrTrunc(flag, flag_reg->type), flag_ref);
+    store->setMetadata(md_id, md);
+  }
+}
+
+// Returns `true` if the first access to the state structure bytes
+// `[offset, offset + size)` within the entry block of `func` is a store that
+// overwrites all of them. This is conservative: any call, or any read from
+// memory that might alias the state structure, ends the search.
+static bool IsOverwrittenBeforeRead(llvm::Function *func, int64_t offset,
+                                    uint64_t size) {
+  if (func->isDeclaration()) {
+    return false;
+  }
+
+  const auto state_ptr = remill::NthArgument(
+      func, remill::kStatePointerArgNum);
+  const auto &dl = gModule->getDataLayout();
+  const auto end = offset + static_cast<int64_t>(size);
+
+  for (auto &inst : func->getEntryBlock()) {
+    if (llvm::isa<llvm::DbgInfoIntrinsic>(inst)) {
+      continue;
+
+    } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+      int64_t load_offset = 0;
+      auto base = llvm::GetPointerBaseWithConstantOffset(
+          load->getPointerOperand(), load_offset, dl);
+      if (llvm::isa<llvm::AllocaInst>(base)) {
+        continue;
+      } else if (base != state_ptr) {
+        return false;
+      }
+      const auto load_end = load_offset + static_cast<int64_t>(
+          dl.getTypeStoreSize(load->getType()));
+      if (load_offset < end && offset < load_end) {
+        return false;
+      }
+
+    } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+      int64_t store_offset = 0;
+      auto base = llvm::GetPointerBaseWithConstantOffset(
+          store->getPointerOperand(), store_offset, dl);
+      if (base != state_ptr) {
+        continue;
+      }
+      const auto store_end = store_offset + static_cast<int64_t>(
+          dl.getTypeStoreSize(store->getValueOperand()->getType()));
+      if (store_offset <= offset && end <= store_end) {
+        return true;
+      }
+
+    } else if (inst.mayReadFromMemory()) {
+      return false;
+    }
+  }
+
+  return false;
+}
+
+// Implement `callback_name` as a thunk that goes from native code into the
+// lifted function `func`, which is the lifted code at `ea`.
+static llvm::Function *ImplementNativeToLiftedThunk(
+    llvm::Function *func, uint64_t ea, const std::string &callback_name) {
   auto attach_func = GetAttachCallFunc();
 
   // Generate inline assembly that can be used the go from native machine
@@ -117,6 +262,8 @@ static llvm::Function *ImplementNativeToLiftedCallback(
   // then jumps into `__mcsema_attach_call`, which does the low-level
   // marshaling of native register state into the `State` structure.
   std::stringstream asm_str;
+  std::string asm_constraints = "*m,*m,~{dirflag},~{fpsr},~{flags}";
+  bool asm_uses_symbols = false;
   switch (gArch->arch_name) {
     case remill::kArchInvalid:
       LOG(FATAL)
@@ -127,11 +274,11 @@ static llvm::Function *ImplementNativeToLiftedCallback(
     case remill::kArchAMD64_AVX:
     case remill::kArchAMD64_AVX512:
       asm_str << "pushq $0;";
-      if (static_cast<uint32_t>(cfg_func->ea) == cfg_func->ea) {
-        asm_str << "pushq $$0x" << std::hex << cfg_func->ea << ";";
+      if (static_cast<uint32_t>(ea) == ea) {
+        asm_str << "pushq $$0x" << std::hex << ea << ";";
       } else {
         asm_str << "pushq %rax;"
-                << "movq $$0x" << std::hex << cfg_func->ea << ", %rax;"
+                << "movq $$0x" << std::hex << ea << ", %rax;"
                 << "xchgq (%rsp), %rax;";
       }
       asm_str << "jmpq *$1;";
@@ -141,15 +288,29 @@ static llvm::Function *ImplementNativeToLiftedCallback(
     case remill::kArchX86_AVX:
     case remill::kArchX86_AVX512:
       asm_str << "pushl $0;"
-              << "pushl $$0x" << std::hex << cfg_func->ea << ";"
+              << "pushl $$0x" << std::hex << ea << ";"
               << "jmpl *$1;";
       break;
 
+    // There is no AArch64 addressing mode that can reach an arbitrary global
+    // variable, and a naked function can't materialize one into a register
+    // for us, so we refer to the wrapper and to `__mcsema_attach_call` by
+    // symbol instead. The lifted function's address and EA are passed in the
+    // intra-procedure-call scratch registers, `X16` and `X17`, which leaves
+    // the argument registers and the link register untouched.
     case remill::kArchAArch64LittleEndian:
-      LOG(ERROR)
-          << "TODO: Create a native-to-lifted callback for the "
-          << GetArchName(gArch->arch_name) << " instruction set.";
-      asm_str << "nop;";
+      asm_str << "adrp x16, $0;"
+              << "add x16, x16, :lo12:$0;"
+              << "movz x17, #0x" << std::hex << (ea & 0xFFFFu) << ";";
+      for (auto shift = 16u; shift < 64u; shift += 16u) {
+        if (const auto part = (ea >> shift) & 0xFFFFu; part) {
+          asm_str << "movk x17, #0x" << std::hex << part
+                  << ", lsl #" << std::dec << shift << ";";
+        }
+      }
+      asm_str << "b $1;";
+      asm_constraints = "i,i,~{x16},~{x17}";
+      asm_uses_symbols = true;
       break;
 
     default:
@@ -177,11 +338,16 @@ static llvm::Function *ImplementNativeToLiftedCallback(
   // Create the inline assembly. We use memory operands (
   std::vector<llvm::Type *> asm_arg_types;
   std::vector<llvm::Value *> asm_args;
-  asm_arg_types.push_back(llvm::PointerType::get(func->getType(), 0));
-  asm_arg_types.push_back(llvm::PointerType::get(attach_func->getType(), 0));
+  if (asm_uses_symbols) {
+    asm_arg_types.push_back(func->getType());
+    asm_arg_types.push_back(attach_func->getType());
+  } else {
+    asm_arg_types.push_back(llvm::PointerType::get(func->getType(), 0));
+    asm_arg_types.push_back(llvm::PointerType::get(attach_func->getType(), 0));
+  }
   auto asm_func_type = llvm::FunctionType::get(void_type, asm_arg_types, false);
   auto asm_func = llvm::InlineAsm::get(
-      asm_func_type, asm_str.str(), "*m,*m,~{dirflag},~{fpsr},~{flags}",
+      asm_func_type, asm_str.str(), asm_constraints,
       true /* hasSideEffects */);
 
   // Make an initializer function that first calls `__mcsema_early_init`,
@@ -210,6 +376,11 @@ static llvm::Function *ImplementNativeToLiftedCallback(
   func_args[2] = &*arg_it++;
 
   ir.CreateCall(GetOrCreateMcSemaInitializer());
+  if (FLAGS_unpack_native_flags) {
+    UnpackNativeFlags(ir.GetInsertBlock(),
+                      func_args[remill::kStatePointerArgNum]);
+    ir.SetInsertPoint(ir.GetInsertBlock());
+  }
   auto call = ir.CreateCall(func, func_args);
   call->setTailCall(true);
   ir.CreateRet(call);
@@ -217,22 +388,28 @@ static llvm::Function *ImplementNativeToLiftedCallback(
   // Back to the asm attach callback thunk...
   ir.SetInsertPoint(llvm::BasicBlock::Create(*gContext, "", callback_func));
 
+  if (asm_uses_symbols) {
+    asm_args.push_back(func_wrapper);
+    asm_args.push_back(attach_func);
+
   // It's easier to deal with memory references in inline assembly in static
   // and relocatable binaries, but the cost is that we have to produce these
   // otherwise useless global variables.
-  asm_args.push_back(new llvm::GlobalVariable(
-      *gModule, func_wrapper->getType(), true /* isConstant */,
-      llvm::GlobalValue::InternalLinkage, func_wrapper));
+  } else {
+    asm_args.push_back(new llvm::GlobalVariable(
+        *gModule, func_wrapper->getType(), true /* isConstant */,
+        llvm::GlobalValue::InternalLinkage, func_wrapper));
+
+    static llvm::GlobalVariable *attach_func_ptr = nullptr;
+    if (!attach_func_ptr) {
+      attach_func_ptr = new llvm::GlobalVariable(
+          *gModule, attach_func->getType(), true,
+          llvm::GlobalValue::InternalLinkage, attach_func);
+    }
 
-  static llvm::GlobalVariable *attach_func_ptr = nullptr;
-  if (!attach_func_ptr) {
-    attach_func_ptr = new llvm::GlobalVariable(
-        *gModule, attach_func->getType(), true,
-        llvm::GlobalValue::InternalLinkage, attach_func);
+    asm_args.push_back(attach_func_ptr);
   }
 
-  asm_args.push_back(attach_func_ptr);
-
   ir.CreateCall(asm_func, asm_args);
 
   if (auto ret_type = callback_func->getReturnType(); ret_type->isVoidTy()) {
@@ -241,6 +418,21 @@ static llvm::Function *ImplementNativeToLiftedCallback(
     ir.CreateRet(llvm::UndefValue::get(ret_type));
   }
 
+  return callback_func;
+}
+
+// Get a callback function for an internal function.
+static llvm::Function *ImplementNativeToLiftedCallback(
+    const NativeObject *cfg_func, const std::string &callback_name) {
+
+  // If the native name of the function doesn't yet exist then add it in.
+  auto func = gModule->getFunction(cfg_func->lifted_name);
+  CHECK(func != nullptr)
+      << "Cannot find lifted function " << cfg_func->lifted_name;
+
+  auto callback_func = ImplementNativeToLiftedThunk(
+      func, cfg_func->ea, callback_name);
+
   if (!FLAGS_pc_annotation.empty()) {
     legacy::AnnotateInsts(callback_func, cfg_func->ea);
   }
@@ -253,6 +445,15 @@ static llvm::Function *ImplementNativeToLiftedCallback(
   return callback_func;
 }
 
+// Thread-local mode of the emulated stack and TLS in `--explicit_args` mode.
+static llvm::GlobalValue::ThreadLocalMode ExplicitArgsThreadLocalMode(void) {
+  if (FLAGS_explicit_args_thread_local) {
+    return LiftedThreadLocalMode();
+  } else {
+    return llvm::GlobalValue::NotThreadLocal;
+  }
+}
+
 // Create a stack and a variable that tracks the stack pointer.
 static llvm::Constant *InitialStackPointerValue(void) {
   unsigned min_frame_size = 512u;
@@ -266,7 +467,7 @@ static llvm::Constant *InitialStackPointerValue(void) {
     auto stack_var = new llvm::GlobalVariable(
         *gModule, stack_type, false, llvm::GlobalValue::InternalLinkage,
         llvm::ConstantAggregateZero::get(stack_type), "__mcsema_stack",
-        nullptr, llvm::GlobalValue::InitialExecTLSModel);
+        nullptr, ExplicitArgsThreadLocalMode());
     stack = stack_var;
 
     if (stack_var->getType()->getAddressSpace()) {
@@ -350,7 +551,7 @@ static llvm::Constant *InitialThreadLocalStorage(void) {
   auto tls_var = new llvm::GlobalVariable(
       *gModule, tls_type, false, llvm::GlobalValue::InternalLinkage,
       llvm::Constant::getNullValue(tls_type), "__mcsema_tls",
-      nullptr, llvm::GlobalValue::InitialExecTLSModel);
+      nullptr, ExplicitArgsThreadLocalMode());
 
   llvm::Constant *tls = tls_var;
   if (tls_var->getType()->getAddressSpace()) {
@@ -760,6 +961,48 @@ llvm::Constant *NativeFunction::Address(void) const {
   return llvm::ConstantExpr::getPtrToInt(Pointer(), gWordType);
 }
 
+// Get a function that native code can call to run the lifted function
+// `lifted_func`, which is the lifted code at `ea`, but which has no
+// corresponding `NativeFunction` in the CFG.
+llvm::Function *GetNativeToLiftedEntryPoint(llvm::Function *lifted_func,
+                                            uint64_t ea,
+                                            const std::string &name) {
+  if (auto func = gModule->getFunction(name); func) {
+    return func;
+  }
+
+  llvm::Function *func = nullptr;
+
+  // There are no arguments to pass, so the explicit arguments entry point
+  // only needs to find the `State` structure and emulated stack.
+  if (FLAGS_explicit_args) {
+    func = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(*gContext), false),
+        llvm::GlobalValue::InternalLinkage, name, gModule.get());
+
+    llvm::IRBuilder<> ir(llvm::BasicBlock::Create(*gContext, "", func));
+    llvm::Value *lifted_func_args[remill::kNumBlockArgs] = {};
+    lifted_func_args[remill::kStatePointerArgNum] =
+        ir.CreateCall(GetVerifyRegState());
+    lifted_func_args[remill::kMemoryPointerArgNum] =
+        llvm::Constant::getNullValue(remill::MemoryPointerType(gModule.get()));
+    lifted_func_args[remill::kPCArgNum] =
+        llvm::ConstantInt::get(gWordType, ea);
+    ir.CreateCall(lifted_func, lifted_func_args);
+    ir.CreateRetVoid();
+
+  } else {
+    func = ImplementNativeToLiftedThunk(lifted_func, ea, name);
+    if (!FLAGS_pc_annotation.empty()) {
+      legacy::AnnotateInsts(func, ea);
+    }
+  }
+
+  func->addFnAttr(llvm::Attribute::NoInline);
+  func->addFnAttr(llvm::Attribute::NoBuiltin);
+  return func;
+}
+
 // Get a callback function for an external function that can be referenced by
 // internal code.
 llvm::Function *GetLiftedToNativeExitPoint(const NativeFunction *cfg_func) {
@@ -878,4 +1121,69 @@ llvm::Function *GetLiftedToNativeExitPoint(ExitPointKind kind) {
   return callback_func;
 }
 
+// Remove the stores, in native-to-lifted callbacks, that unpack native flags
+// which the called lifted function overwrites before reading.
+void RemoveDeadFlagUnpacks(void) {
+  if (!FLAGS_unpack_native_flags) {
+    return;
+  }
+
+  // If the state pointer was globalized then the lifted functions no longer
+  // access the state structure through their argument.
+  if (!FLAGS_local_state_pointer) {
+    return;
+  }
+
+  const auto md_id = gContext->getMDKindID(kFlagUnpackMetadata);
+  const auto &dl = gModule->getDataLayout();
+  std::vector<llvm::StoreInst *> dead_stores;
+  std::vector<llvm::StoreInst *> unpacks;
+
+  for (auto &func : *gModule) {
+    for (auto &block : func) {
+      unpacks.clear();
+      for (auto &inst : block) {
+        if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+            store && store->getMetadata(md_id)) {
+          unpacks.push_back(store);
+          continue;
+        }
+
+        auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+        if (!call || unpacks.empty()) {
+          continue;
+        }
+
+        auto callee = call->getCalledFunction();
+        if (!callee) {
+          unpacks.clear();
+          continue;
+        }
+
+        for (auto store : unpacks) {
+          int64_t offset = 0;
+          llvm::GetPointerBaseWithConstantOffset(
+              store->getPointerOperand(), offset, dl);
+          const auto size = dl.getTypeStoreSize(
+              store->getValueOperand()->getType());
+          if (IsOverwrittenBeforeRead(callee, offset, size)) {
+            dead_stores.push_back(store);
+          } else {
+            store->setMetadata(md_id, nullptr);
+          }
+        }
+        unpacks.clear();
+      }
+    }
+  }
+
+  for (auto store : dead_stores) {
+    store->eraseFromParent();
+  }
+
+  LOG_IF(INFO, !dead_stores.empty())
+      << "Removed " << dead_stores.size()
+      << " dead native flag unpacks";
+}
+
 }  // namespace mcsema
@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 namespace llvm {
 
 class Function;
@@ -38,4 +41,15 @@ enum ExitPointKind {
 // where we don't know where the native destination actually is.
 llvm::Function *GetLiftedToNativeExitPoint(ExitPointKind);
 
+// Get a function that native code can call to run the lifted function
+// `lifted_func`, which is the lifted code at `ea`, but which has no
+// corresponding `NativeFunction` in the CFG.
+llvm::Function *GetNativeToLiftedEntryPoint(llvm::Function *lifted_func,
+                                            uint64_t ea,
+                                            const std::string &name);
+
+// Remove the stores, in native-to-lifted callbacks, that unpack native flags
+// which the called lifted function overwrites before reading.
+void RemoveDeadFlagUnpacks(void);
+
 }  // namespace mcsema
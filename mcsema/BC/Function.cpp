@@ -38,6 +38,8 @@
 
 #include <llvm/Transforms/Utils/Cloning.h>
 
+#include <algorithm>
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
@@ -61,6 +63,7 @@
 #include "mcsema/BC/Lift.h"
 #include "mcsema/BC/Optimize.h"
 #include "mcsema/BC/Segment.h"
+#include "mcsema/BC/Stream.h"
 #include "mcsema/BC/Util.h"
 #include "mcsema/CFG/CFG.h"
 
@@ -100,6 +103,48 @@ DEFINE_bool(stack_protector, false, "Annotate functions so that if the bitcode "
             "is compiled with -fstack-protector-all then the stack protection "
             "guards will be added.");
 
+DEFINE_bool(frame_pointers, false,
+            "Keep frame pointers and unwind tables in lifted functions, so "
+            "that profilers and debuggers can walk the stack from lifted code "
+            "into the native code around it.");
+
+DEFINE_bool(optimize_eh_funcs, true,
+            "Let lifted functions containing exception landing pads go through "
+            "the normal optimization pipeline. Only the stack and frame pointer "
+            "values needed by the landing pad prologue are pinned in memory. "
+            "Disabling this marks such functions as `optnone`.");
+
+DEFINE_bool(elide_return_addresses, true,
+            "On amd64, don't store return addresses into the emulated stack "
+            "for direct calls between lifted functions whose callee provably "
+            "never looks at its return address slot, and don't load them back "
+            "on return from such functions. Callees that set up a frame "
+            "pointer before making calls are excluded, as their callees can "
+            "walk the frame pointer chain. The stack pointer is still "
+            "adjusted as the call and return would.");
+
+DEFINE_bool(fold_indirect_targets, true,
+            "Propagate constants through the instructions of a block that "
+            "ends in an indirect jump or call, and if the target is then "
+            "known, e.g. `lea rax, [func]; jmp rax`, or a load from a "
+            "read-only slot, lift it as a direct jump or call.");
+
+DEFINE_bool(fuse_flag_consumers, true,
+            "On x86 and amd64, lift a `jcc`, `setcc`, or register `cmovcc` "
+            "that directly follows a `cmp` or `test` of registers or "
+            "immediates as one integer comparison of the compared values, "
+            "instead of recomputing its condition from the flags.");
+
+DEFINE_bool(devirtualize_vtables, true,
+            "Recognize C++ virtual calls that load their targets out of "
+            "virtual tables in the binary, and compare the loaded target "
+            "against the lifted methods that the slot may hold, calling "
+            "those directly instead of through `__remill_function_call`.");
+
+DEFINE_uint32(max_virtual_call_targets, 4,
+              "Maximum number of possible targets of a virtual call for it "
+              "to be devirtualized with `--devirtualize_vtables`.");
+
 namespace mcsema {
 namespace {
 
@@ -138,6 +183,17 @@ static llvm::Value *LoadNextProgramCounterRef(
   return ctx.lifter->LoadRegAddress(block, "NEXT_PC");
 }
 
+// Name of the register that compiled code uses as its frame pointer.
+static const char *FramePointerRegisterName(void) {
+  if (gArch->IsAArch64()) {
+    return "X29";
+  } else if (gArch->IsAMD64()) {
+    return "RBP";
+  } else {
+    return "EBP";
+  }
+}
+
 // Get the register tracer. This is useful when debugging, where the runtime
 // implements the register tracer in a way that prints out all general purpose
 // register names and their values before each lifted instruction. This trace
@@ -388,8 +444,9 @@ enum class PCValueKind {
 };
 
 // Add a invoke to another function and then update the memory pointer with the
-// result of the function. It also needs to stash the stack and frame pointer which
-// can be restored before handling the exception handler.
+// result of the function. The landing pad restores the stack and frame pointer
+// as they were at the time of the invoke, so they are passed to it through
+// its PHI nodes.
 static void InlineSubFuncInvoke(
     const TranslationContext &ctx,
     llvm::BasicBlock *block,
@@ -400,24 +457,14 @@ static void InlineSubFuncInvoke(
     PCValueKind pc_kind=PCValueKind::kSymbolicPC) {
 
   llvm::IRBuilder <> ir(block);
-  auto get_sp_func = gModule->getFunction("__mcsema_get_stack_pointer");
-  if (!get_sp_func) {
-    get_sp_func = llvm::Function::Create(
-        llvm::FunctionType::get(gWordType, false),
-        llvm::GlobalValue::ExternalLinkage,
-        "__mcsema_get_stack_pointer", gModule.get());
-  }
 
-  auto sp_var = ir.CreateCall(get_sp_func);
-  ir.CreateStore(sp_var, ctx.stack_ptr_var);
-
-  auto get_bp_func = gModule->getFunction("__mcsema_get_frame_pointer");
-  if (!get_bp_func) {
-    get_bp_func = llvm::Function::Create(
-        llvm::FunctionType::get(gWordType, false),
-        llvm::GlobalValue::ExternalLinkage,
-        "__mcsema_get_frame_pointer", gModule.get());
-  }
+  // These are the values that the lifted code has just stored into the state
+  // structure ahead of the call, so once the function is optimized these loads
+  // are forwarded, and nothing extra happens on the normal path.
+  const auto sp_val = ctx.lifter->LoadRegValue(
+      block, gArch->StackPointerRegisterName());
+  const auto bp_val = ctx.lifter->LoadRegValue(
+      block, FramePointerRegisterName());
 
   llvm::Value *args[remill::kNumBlockArgs];
   args[remill::kMemoryPointerArgNum] = LoadMemoryPointer(ctx, block);
@@ -431,12 +478,15 @@ static void InlineSubFuncInvoke(
     args[remill::kPCArgNum] = llvm::ConstantInt::get(gWordType, ctx.inst.pc);
   }
 
-  auto bp_var = ir.CreateCall(get_bp_func);
-  ir.CreateStore(bp_var, ctx.frame_ptr_var);
   auto invoke = ir.CreateInvoke(
       sub, if_normal, if_exception, args, "");
   invoke->setCallingConv(sub->getCallingConv());
 
+  // See `CreateLandingPad`.
+  auto phi_it = if_exception->begin();
+  llvm::cast<llvm::PHINode>(&*phi_it++)->addIncoming(sp_val, block);
+  llvm::cast<llvm::PHINode>(&*phi_it)->addIncoming(bp_val, block);
+
   // Store the memory pointer down the normal path of the invoked function.
   auto mem_ptr_ref = LoadMemoryPointerRef(ctx, if_normal);
   ir.SetInsertPoint(if_normal);
@@ -488,16 +538,320 @@ static llvm::Function *CallableLiftedFunc(
   }
 }
 
+// Try to decode the instruction at `pc` into `inst`.
+static bool DecodeInstructionAt(
+    const NativeModule *cfg_module, uint64_t pc, remill::Instruction &inst,
+    bool is_delayed) {
+
+  static const auto max_inst_size = gArch->MaxInstructionSize();
+  inst.Reset();
+
+  auto byte = cfg_module->FindByte(pc);
+  if (!byte.IsExecutable()) {
+    return false;
+  }
+
+  // Read the bytes.
+  auto &inst_bytes = inst.bytes;
+  inst_bytes.reserve(max_inst_size);
+  for (auto i = 0u; i < max_inst_size && byte && byte.IsExecutable();
+       ++i, byte = cfg_module->FindNextByte(byte)) {
+    auto maybe_val = byte.Value();
+    if (remill::IsError(maybe_val)) {
+      LOG(ERROR)
+          << "Unable to read balue of byte at " << std::hex
+          << byte.Address() << std::dec << ": "
+          << remill::GetErrorString(maybe_val);
+      break;
+    } else {
+      inst_bytes.push_back(static_cast<char>(remill::GetReference(maybe_val)));
+    }
+  }
+
+  if (is_delayed) {
+    return gArch->DecodeDelayedInstruction(pc, inst.bytes, inst);
+  } else {
+    return gArch->DecodeInstruction(pc, inst.bytes, inst);
+  }
+}
+
+// Constant values of registers, keyed by their offset in the `State`
+// structure, at some point within a block.
+using RegConstants = std::unordered_map<uint64_t, uint64_t>;
+
+static uint64_t WidthMask(uint64_t size) {
+  return size >= 64 ? ~0ULL : ((1ULL << size) - 1ULL);
+}
+
+// Forget anything known about the registers overlapping `reg`.
+template <typename RegFacts>
+static void ForgetReg(RegFacts &consts, const remill::Register *reg) {
+  const auto word_size = gArch->address_size / 8;
+  const auto begin = reg->offset;
+  const auto end = reg->offset + reg->size;
+  for (auto it = consts.begin(); it != consts.end(); ) {
+    if (it->first < end && begin < (it->first + word_size)) {
+      it = consts.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Read the pointer-sized value stored at `ea`. We only trust slots whose
+// values can't change at runtime: those in read-only segments, and those
+// that the loader binds to an external function, e.g. GOT entries.
+static bool ReadConstantSlot(const NativeModule *cfg_module, uint64_t ea,
+                             uint64_t size, uint64_t &val) {
+  const auto seg = cfg_module->TryGetSegment(ea);
+  if (!seg) {
+    return false;
+  }
+
+  const auto entry_it = seg->entries.find(ea);
+  if (entry_it == seg->entries.end() || !entry_it->second.xref) {
+    return false;
+  }
+
+  const auto xref = entry_it->second.xref.get();
+  if ((size && (xref->width * 8) != size) ||
+      xref->fixup_kind != NativeXref::kAbsoluteFixup) {
+    return false;
+  }
+
+  if (!seg->is_read_only && (!xref->func || !xref->func->is_external)) {
+    return false;
+  }
+
+  val = xref->mask ? (xref->target_ea & xref->mask) : xref->target_ea;
+  return true;
+}
+
+// Returns `true` if `mem` is relative to a segment with a non-flat base, i.e.
+// `FS` or `GS`. On 32-bit x86, the other segments have a base register too,
+// but it is always zero.
+static bool IsSegmentRelative(const remill::Operand::Address &mem) {
+  const auto &seg_reg = mem.segment_base_reg.name;
+  return !seg_reg.empty() && seg_reg != "CS_BASE" && seg_reg != "DS_BASE" &&
+         seg_reg != "ES_BASE" && seg_reg != "SS_BASE";
+}
+
+// Get the value of a register, if it is known.
+static bool GetRegConstant(const remill::Instruction &inst,
+                           const RegConstants &consts,
+                           const remill::Register &op_reg, uint64_t &val) {
+  if (op_reg.name == "PC") {
+    val = inst.pc;
+  } else if (op_reg.name == "NEXT_PC") {
+    val = inst.next_pc;
+  } else if (auto reg = gArch->RegisterByName(op_reg.name); !reg) {
+    return false;
+  } else if (auto it = consts.find(reg->offset); it != consts.end()) {
+    val = it->second;
+  } else {
+    return false;
+  }
+  val &= WidthMask(op_reg.size);
+  return true;
+}
+
+// Get the value of a read operand, if it is known.
+static bool GetOperandConstant(const NativeModule *cfg_module,
+                               const remill::Instruction &inst,
+                               const RegConstants &consts,
+                               const remill::Operand &op, uint64_t &val) {
+  const auto cfg_inst = cfg_module->TryGetInstruction(inst.pc);
+
+  switch (op.type) {
+    case remill::Operand::kTypeRegister:
+      return GetRegConstant(inst, consts, op.reg, val);
+
+    case remill::Operand::kTypeImmediate:
+      if (cfg_inst && cfg_inst->imm) {
+        val = cfg_inst->imm->target_ea;
+      } else {
+        val = static_cast<uint64_t>(op.imm.val);
+      }
+      val &= WidthMask(op.size);
+      return true;
+
+    case remill::Operand::kTypeAddress: {
+      const auto &mem = op.addr;
+      uint64_t addr = 0;
+
+      // E.g. `fs:[rax + 8]` isn't an address in any of the CFG's segments.
+      if (IsSegmentRelative(mem)) {
+        return false;
+      }
+
+      // Prefer what the disassembler told us, as it will have taken
+      // relocations into account. This mirrors `LiftAddressOperand`.
+      const auto xref = cfg_inst ? (cfg_inst->mem ? cfg_inst->mem :
+                                    cfg_inst->disp) : nullptr;
+      if (xref && mem.index_reg.name.empty() &&
+          (mem.base_reg.name.empty() || mem.base_reg.name == "PC" ||
+           mem.base_reg.name == "NEXT_PC")) {
+        addr = xref->target_ea;
+
+      } else {
+        uint64_t base = 0;
+        uint64_t index = 0;
+        if (!mem.base_reg.name.empty() &&
+            !GetRegConstant(inst, consts, mem.base_reg, base)) {
+          return false;
+        }
+        if (!mem.index_reg.name.empty() &&
+            !GetRegConstant(inst, consts, mem.index_reg, index)) {
+          return false;
+        }
+        addr = base + index * static_cast<uint64_t>(mem.scale) +
+               static_cast<uint64_t>(mem.displacement);
+      }
+
+      addr &= WidthMask(gArch->address_size);
+      if (mem.kind == remill::Operand::Address::kMemoryRead) {
+        return ReadConstantSlot(cfg_module, addr, op.size, val);
+      } else if (mem.kind == remill::Operand::Address::kAddressCalculation) {
+        val = addr;
+        return true;
+      } else {
+        return false;
+      }
+    }
+
+    default:
+      return false;
+  }
+}
+
+// Remill's semantics for some instructions (e.g. string operations, or
+// `CPUID`) write to registers that aren't listed as operands, so we only
+// trust the operand list of instructions that are known not to.
+static bool WritesOnlyOperands(const remill::Instruction &inst) {
+  const llvm::StringRef func(inst.function);
+  return (inst.category == remill::Instruction::kCategoryNormal ||
+          inst.category == remill::Instruction::kCategoryNoOp) &&
+         (func.startswith("MOV_") || func.startswith("LEA_") ||
+          func.startswith("ADR_") || func.startswith("ADRP_") ||
+          func.startswith("LDR_") || func.startswith("STR_") ||
+          func.startswith("ADD_") || func.startswith("SUB_") ||
+          func.startswith("AND_") || func.startswith("OR_") ||
+          func.startswith("XOR_") || func.startswith("CMP_") ||
+          func.startswith("TEST_") || func.startswith("NOP") ||
+          func.startswith("ENDBR"));
+}
+
+// Update `consts` with the effects of `inst`. Only moves, loads, address
+// computations, and additions of known values are propagated; any other
+// register written by an instruction becomes unknown.
+static void PropagateConstants(const NativeModule *cfg_module,
+                               const remill::Instruction &inst,
+                               RegConstants &consts) {
+  const llvm::StringRef func(inst.function);
+  if (!WritesOnlyOperands(inst)) {
+    consts.clear();
+    return;
+  }
+
+  std::vector<const remill::Operand *> dsts;
+  std::vector<const remill::Operand *> srcs;
+  for (const auto &op : inst.operands) {
+    if (op.action == remill::Operand::kActionWrite) {
+      if (op.type == remill::Operand::kTypeRegister) {
+        dsts.push_back(&op);
+      }
+    } else if (op.action == remill::Operand::kActionRead) {
+      srcs.push_back(&op);
+    }
+  }
+
+  // Only instructions with a single destination of at least 32 bits produce
+  // a value. Smaller writes merge into the enclosing register, and multiple
+  // destinations (e.g. post-indexed loads) are too subtle.
+  auto is_known = false;
+  uint64_t val = 0;
+  if (dsts.size() == 1 && dsts[0]->reg.size >= 32) {
+    if (func.startswith("MOV_") || func.startswith("LEA_") ||
+        func.startswith("ADR_") || func.startswith("ADRP_") ||
+        func.startswith("LDR_")) {
+      is_known = srcs.size() == 1 &&
+                 GetOperandConstant(cfg_module, inst, consts, *srcs[0], val);
+
+    } else if (func.startswith("ADD_")) {
+      uint64_t rhs = 0;
+      is_known = srcs.size() == 2 &&
+                 GetOperandConstant(cfg_module, inst, consts, *srcs[0], val) &&
+                 GetOperandConstant(cfg_module, inst, consts, *srcs[1], rhs);
+      val += rhs;
+    }
+  }
+
+  for (auto dst : dsts) {
+    if (auto reg = gArch->RegisterByName(dst->reg.name); reg) {
+      ForgetReg(consts, reg);
+    } else {
+      consts.clear();
+      return;
+    }
+  }
+
+  // Writes of 32 or more bits zero-extend into the enclosing register.
+  if (is_known) {
+    const auto reg = gArch->RegisterByName(dsts[0]->reg.name);
+    consts[reg->offset] = val & WidthMask(dsts[0]->reg.size);
+  }
+}
+
+// Try to statically compute the target of the indirect jump or call `inst` by
+// propagating constants from the beginning of its block. E.g. PLT stubs and
+// position-independent trampolines load their targets from constant slots.
+static bool FoldIndirectTarget(const TranslationContext &ctx,
+                               const remill::Instruction &inst,
+                               uint64_t &target_ea) {
+  if (!FLAGS_fold_indirect_targets || !ctx.cfg_block ||
+      ctx.cfg_block->ea > inst.pc) {
+    return false;
+  }
+
+  RegConstants consts;
+  remill::Instruction prev_inst;
+  for (auto pc = ctx.cfg_block->ea; pc < inst.pc; pc = prev_inst.next_pc) {
+    if (!DecodeInstructionAt(ctx.cfg_module, pc, prev_inst, false) ||
+        !prev_inst.IsValid()) {
+      return false;
+    }
+    PropagateConstants(ctx.cfg_module, prev_inst, consts);
+    if (prev_inst.next_pc > inst.pc) {
+      return false;  // Overlapping instructions.
+    }
+  }
+
+  // The target is the first operand read by the jump or call.
+  for (const auto &op : inst.operands) {
+    if (op.action == remill::Operand::kActionRead) {
+      return GetOperandConstant(ctx.cfg_module, inst, consts, op, target_ea);
+    }
+  }
+  return false;
+}
+
 // Find an external function associated with this indirect jump.
 static llvm::Function *DevirtualizeIndirectFlow(
     TranslationContext &ctx, llvm::Function *fallback) {
-  if (!ctx.cfg_inst) {
-    return fallback;
+  if (ctx.cfg_inst) {
+    if (const auto flow = ctx.cfg_inst->flow; flow) {
+      if (auto cfg_func = ctx.cfg_module->TryGetFunction(flow->target_ea);
+          cfg_func) {
+        return CallableLiftedFunc(cfg_func, fallback);
+      }
+    }
   }
 
-  if (const auto flow = ctx.cfg_inst->flow; flow) {
-    if (auto cfg_func = ctx.cfg_module->TryGetFunction(flow->target_ea);
-        cfg_func) {
+  if (uint64_t target_ea = 0; FoldIndirectTarget(ctx, ctx.inst, target_ea)) {
+    if (auto cfg_func = ctx.cfg_module->TryGetFunction(target_ea); cfg_func) {
+      LOG(INFO)
+          << "Folded target of indirect flow at " << std::hex << ctx.inst.pc
+          << " to " << cfg_func->name << " at " << target_ea << std::dec;
       return CallableLiftedFunc(cfg_func, fallback);
     }
   }
@@ -505,6 +859,261 @@ static llvm::Function *DevirtualizeIndirectFlow(
   return fallback;
 }
 
+// Lifted methods stored in what look like C++ virtual tables, keyed first by
+// the offset of their slot from the address point of the table, then by their
+// address.
+using VirtualTableSlots =
+    std::map<uint64_t, std::map<uint64_t, const NativeFunction *>>;
+
+// Get the entry of `cfg_seg` that covers `ea`, if any.
+static const NativeSegment::Entry *FindSegmentEntry(
+    const NativeSegment *cfg_seg, uint64_t ea) {
+  auto it = cfg_seg->entries.upper_bound(ea);
+  if (it == cfg_seg->entries.begin()) {
+    return nullptr;
+  }
+  --it;
+  return ea < it->second.next_ea ? &(it->second) : nullptr;
+}
+
+// Get the function that `entry` points to, if it is a pointer-sized slot
+// holding the address of a function.
+static const NativeFunction *GetFunctionSlot(
+    const NativeSegment::Entry &entry) {
+  const auto xref = entry.xref.get();
+  if (!xref || !xref->func || xref->mask ||
+      xref->fixup_kind != NativeXref::kAbsoluteFixup ||
+      (xref->width * 8) != gArch->address_size ||
+      xref->target_ea != xref->func->ea) {
+    return nullptr;
+  }
+  return xref->func->Get();
+}
+
+// Itanium C++ ABI virtual tables begin with the offset to the top of the
+// object and a pointer to its type info (or zero), followed by the address
+// point, which is where the vptr of objects points, and from there on by the
+// pointers to the virtual methods.
+static bool IsVirtualTableAddressPoint(const NativeSegment *cfg_seg,
+                                       uint64_t ea) {
+  const auto word_size = gArch->address_size / 8;
+  if (ea < (cfg_seg->ea + 2 * word_size)) {
+    return false;
+  }
+
+  const auto type_info = FindSegmentEntry(cfg_seg, ea - word_size);
+  const auto offset_to_top = FindSegmentEntry(cfg_seg, ea - 2 * word_size);
+  return offset_to_top && offset_to_top->blob && type_info &&
+         (type_info->blob || (type_info->xref && !type_info->xref->func));
+}
+
+// Find the virtual tables in the segments of `cfg_module`. Relocated tables
+// are placed in `.data.rel.ro`, which is only read-only after relocation.
+static VirtualTableSlots FindVirtualTableSlots(const NativeModule *cfg_module) {
+  VirtualTableSlots slots;
+  auto num_tables = 0u;
+
+  for (const auto &cfg_seg : cfg_module->segments) {
+    if (cfg_seg->is_external ||
+        !(cfg_seg->is_read_only ||
+          llvm::StringRef(cfg_seg->name).startswith(".data.rel.ro"))) {
+      continue;
+    }
+
+    auto in_table = false;
+    uint64_t address_point = 0;
+    uint64_t next_ea = 0;
+    for (const auto &[ea, entry] : cfg_seg->entries) {
+      const auto cfg_func = GetFunctionSlot(entry);
+      if (!cfg_func) {
+        in_table = false;
+        continue;
+      }
+
+      if (!in_table || ea != next_ea) {
+        in_table = IsVirtualTableAddressPoint(cfg_seg.get(), ea);
+        address_point = ea;
+        num_tables += in_table ? 1u : 0u;
+      }
+
+      if (in_table && !cfg_func->is_external) {
+        slots[ea - address_point].emplace(cfg_func->ea, cfg_func);
+      }
+      next_ea = entry.next_ea;
+    }
+  }
+
+  LOG(INFO)
+      << "Found " << num_tables << " virtual tables";
+
+  return slots;
+}
+
+static std::unordered_map<const NativeModule *, VirtualTableSlots>
+    gVirtualTableSlots;
+
+// How many virtual calls were devirtualized, and into how many direct calls.
+static unsigned gNumDevirtualizedCalls = 0;
+static unsigned gNumDevirtualizedTargets = 0;
+
+// Get the virtual table slots of `cfg_module`, finding them the first time.
+static const VirtualTableSlots &GetVirtualTableSlots(
+    const NativeModule *cfg_module) {
+  auto it = gVirtualTableSlots.find(cfg_module);
+  if (it == gVirtualTableSlots.end()) {
+    it = gVirtualTableSlots.emplace(
+        cfg_module, FindVirtualTableSlots(cfg_module)).first;
+  }
+  return it->second;
+}
+
+// What is known about a register while looking for a virtual call: it either
+// holds the vptr of an object, i.e. the first word of it, or the contents of
+// the slot at `slot_offset` of a virtual table.
+struct VirtualValue {
+  bool is_vptr{false};
+  uint64_t slot_offset{0};
+};
+
+using VirtualRegs = std::unordered_map<uint64_t, VirtualValue>;
+
+// Get the register holding the base address of the pointer-sized load `op`.
+static const remill::Register *GetLoadBaseReg(const remill::Operand &op) {
+  if (op.type != remill::Operand::kTypeAddress ||
+      op.addr.kind != remill::Operand::Address::kMemoryRead ||
+      op.size != gArch->address_size || !op.addr.index_reg.name.empty() ||
+      op.addr.displacement < 0 || IsSegmentRelative(op.addr)) {
+    return nullptr;
+  }
+  return gArch->RegisterByName(op.addr.base_reg.name);
+}
+
+// Update `regs` with the effects of `inst`. Only pointer-sized loads and
+// register moves are tracked.
+static void PropagateVirtualValues(const remill::Instruction &inst,
+                                   VirtualRegs &regs) {
+  const llvm::StringRef func(inst.function);
+  if (!WritesOnlyOperands(inst)) {
+    regs.clear();
+    return;
+  }
+
+  std::vector<const remill::Operand *> dsts;
+  std::vector<const remill::Operand *> srcs;
+  for (const auto &op : inst.operands) {
+    if (op.action == remill::Operand::kActionWrite) {
+      if (op.type == remill::Operand::kTypeRegister) {
+        dsts.push_back(&op);
+      }
+    } else if (op.action == remill::Operand::kActionRead) {
+      srcs.push_back(&op);
+    }
+  }
+
+  auto is_known = false;
+  VirtualValue val;
+  if (dsts.size() == 1 && srcs.size() == 1 &&
+      dsts[0]->reg.size == gArch->address_size &&
+      (func.startswith("MOV_") || func.startswith("LDR_"))) {
+    const auto &src = *srcs[0];
+
+    // `mov rax, [rax + k]`, loading a method out of a virtual table, or
+    // `mov rax, [rdi]`, loading the vptr out of an object.
+    if (auto base = GetLoadBaseReg(src); base) {
+      if (auto it = regs.find(base->offset);
+          it != regs.end() && it->second.is_vptr) {
+        val.slot_offset = static_cast<uint64_t>(src.addr.displacement);
+        is_known = true;
+
+      } else if (!src.addr.displacement) {
+        val.is_vptr = true;
+        is_known = true;
+      }
+
+    // `mov rcx, rax`.
+    } else if (src.type == remill::Operand::kTypeRegister &&
+               src.reg.size == gArch->address_size) {
+      if (auto reg = gArch->RegisterByName(src.reg.name); reg) {
+        if (auto it = regs.find(reg->offset); it != regs.end()) {
+          val = it->second;
+          is_known = true;
+        }
+      }
+    }
+  }
+
+  for (auto dst : dsts) {
+    if (auto reg = gArch->RegisterByName(dst->reg.name); reg) {
+      ForgetReg(regs, reg);
+    } else {
+      regs.clear();
+      return;
+    }
+  }
+
+  if (is_known) {
+    regs[gArch->RegisterByName(dsts[0]->reg.name)->offset] = val;
+  }
+}
+
+// Try to find the offset of the virtual table slot from which the indirect
+// call `inst` loads its target, by recognizing either of
+//
+//      mov rax, [rdi]                mov rax, [rdi]
+//      call [rax + k]                mov rax, [rax + k]
+//                                    call rax
+//
+// from the beginning of its block.
+static bool FindVirtualCallSlot(const TranslationContext &ctx,
+                                const remill::Instruction &inst,
+                                uint64_t &slot_offset) {
+  if (!ctx.cfg_block || ctx.cfg_block->ea > inst.pc) {
+    return false;
+  }
+
+  VirtualRegs regs;
+  remill::Instruction prev_inst;
+  for (auto pc = ctx.cfg_block->ea; pc < inst.pc; pc = prev_inst.next_pc) {
+    if (!DecodeInstructionAt(ctx.cfg_module, pc, prev_inst, false) ||
+        !prev_inst.IsValid()) {
+      return false;
+    }
+    PropagateVirtualValues(prev_inst, regs);
+    if (prev_inst.next_pc > inst.pc) {
+      return false;  // Overlapping instructions.
+    }
+  }
+
+  // The target is the first operand read by the call.
+  for (const auto &op : inst.operands) {
+    if (op.action != remill::Operand::kActionRead) {
+      continue;
+    }
+
+    if (auto base = GetLoadBaseReg(op); base) {
+      auto it = regs.find(base->offset);
+      if (it == regs.end() || !it->second.is_vptr) {
+        return false;
+      }
+      slot_offset = static_cast<uint64_t>(op.addr.displacement);
+      return true;
+
+    } else if (op.type == remill::Operand::kTypeRegister) {
+      auto reg = gArch->RegisterByName(op.reg.name);
+      auto it = reg ? regs.find(reg->offset) : regs.end();
+      if (it == regs.end() || it->second.is_vptr) {
+        return false;
+      }
+      slot_offset = it->second.slot_offset;
+      return true;
+
+    } else {
+      return false;
+    }
+  }
+  return false;
+}
+
 // Try to find a function. We start by assuming that `target_pc` is an
 // absolute address for the function. This is usually the case for direct
 // function calls internal to a binary. However, if the function is actually
@@ -534,48 +1143,414 @@ FindFunction(TranslationContext &ctx, uint64_t target_pc) {
   return {nullptr, nullptr};
 }
 
-// Try to decode an instruction.
-static bool TryDecodeInstruction(
-    TranslationContext &ctx, uint64_t pc, bool is_delayed) {
+// What is known about the stack and frame pointers at some point within a
+// function, relative to the stack pointer on entry to the function, i.e. the
+// address of the return address slot.
+struct StackHeights {
+  int64_t sp{0};
+  int64_t fp{0};
+  bool fp_is_known{false};
 
-  remill::Instruction &inst = is_delayed ? ctx.delayed_inst : ctx.inst;
+  bool operator==(const StackHeights &that) const {
+    return sp == that.sp && fp_is_known == that.fp_is_known &&
+           (!fp_is_known || fp == that.fp);
+  }
+};
 
-  static const auto max_inst_size = gArch->MaxInstructionSize();
-  inst.Reset();
+static bool IsStackPointerReg(const remill::Register &reg) {
+  return reg.name == "RSP" || reg.name == "ESP" || reg.name == "SP" ||
+         reg.name == "SPL";
+}
 
-  auto byte = ctx.cfg_module->FindByte(pc);
-  if (!byte.IsExecutable()) {
-    return false;
+static bool IsFramePointerReg(const remill::Register &reg) {
+  return reg.name == "RBP" || reg.name == "EBP" || reg.name == "BP" ||
+         reg.name == "BPL";
+}
+
+// Returns `true` if the `size`-byte access at `offset` touches the return
+// address slot.
+static bool OverlapsReturnAddress(int64_t offset, int64_t size) {
+  const auto slot_size = static_cast<int64_t>(gArch->address_size / 8);
+  return offset < slot_size && 0 < (offset + size);
+}
+
+// Size of the value pushed or popped by `inst`.
+static int64_t PushPopSize(const remill::Instruction &inst) {
+  for (const auto &op : inst.operands) {
+    if (op.type == remill::Operand::kTypeRegister ||
+        op.type == remill::Operand::kTypeAddress) {
+      return op.size == 16 ? 2 : 8;
+    }
   }
+  return 8;
+}
 
-  // Read the bytes.
-  auto &inst_bytes = inst.bytes;
-  inst_bytes.reserve(max_inst_size);
-  for (auto i = 0u; i < max_inst_size && byte && byte.IsExecutable();
-       ++i, byte = ctx.cfg_module->FindNextByte(byte)) {
-    auto maybe_val = byte.Value();
-    if (remill::IsError(maybe_val)) {
-      LOG(ERROR)
-          << "Unable to read balue of byte at " << std::hex
-          << byte.Address() << std::dec << ": "
-          << remill::GetErrorString(maybe_val);
+// Check the stack accesses of `inst`, and update `heights` with its effect on
+// the stack and frame pointers. Returns `false` if `inst` might read or write
+// the return address slot, make a pointer to it, or if it changes the stack
+// pointer in a way we don't follow.
+static bool UpdateStackHeights(const remill::Instruction &inst,
+                               StackHeights &heights) {
+  const llvm::StringRef func(inst.function);
+
+  for (const auto &op : inst.operands) {
+    if (op.type != remill::Operand::kTypeAddress) {
+      continue;
+    }
+
+    const auto &mem = op.addr;
+    int64_t offset = 0;
+    if (IsStackPointerReg(mem.base_reg)) {
+      offset = heights.sp + mem.displacement;
+    } else if (IsFramePointerReg(mem.base_reg) && heights.fp_is_known) {
+      offset = heights.fp + mem.displacement;
+    } else if (IsStackPointerReg(mem.index_reg) ||
+               (IsFramePointerReg(mem.index_reg) && heights.fp_is_known)) {
+      return false;
+    } else {
+      continue;
+    }
+
+    // An indexed access into an object that starts below or above the slot
+    // stays there, as objects on the stack don't straddle it.
+    if (!mem.index_reg.name.empty()) {
+      if (OverlapsReturnAddress(offset, 1)) {
+        return false;
+      }
+    } else if (mem.kind == remill::Operand::Address::kAddressCalculation) {
+      if (OverlapsReturnAddress(offset, 1)) {
+        return false;
+      }
+    } else if (OverlapsReturnAddress(offset, std::max<int64_t>(op.size / 8,
+                                                               1))) {
+      return false;
+    }
+  }
+
+  switch (inst.category) {
+    case remill::Instruction::kCategoryDirectFunctionCall:
+    case remill::Instruction::kCategoryIndirectFunctionCall:
+
+      // The callee pops its own return address, and preserves the frame
+      // pointer. If the frame pointer points into this frame then the callee
+      // (e.g. `backtrace`) can walk the frame pointer chain, and read the
+      // return address slot next to the saved frame pointer.
+      return !heights.fp_is_known && !OverlapsReturnAddress(heights.sp - 8, 8);
+
+    case remill::Instruction::kCategoryFunctionReturn:
+      return func.startswith("RET_NEAR") && !heights.sp;
+
+    default:
       break;
+  }
+
+  if (func.startswith("PUSH")) {
+    if (func.startswith("PUSHA") ||
+        (heights.fp_is_known && !inst.operands.empty() &&
+         inst.operands[0].type == remill::Operand::kTypeRegister &&
+         IsFramePointerReg(inst.operands[0].reg))) {
+      return false;
+    }
+    const auto size = func.startswith("PUSHF") ? 8 : PushPopSize(inst);
+    heights.sp -= size;
+    return !OverlapsReturnAddress(heights.sp, size);
+
+  } else if (func.startswith("POP")) {
+    if (func.startswith("POPA")) {
+      return false;
+    }
+    const auto size = func.startswith("POPF") ? 8 : PushPopSize(inst);
+    if (OverlapsReturnAddress(heights.sp, size)) {
+      return false;
+    }
+    heights.sp += size;
+    for (const auto &op : inst.operands) {
+      if (op.type == remill::Operand::kTypeRegister &&
+          op.action == remill::Operand::kActionWrite) {
+        if (IsStackPointerReg(op.reg)) {
+          return false;
+        } else if (IsFramePointerReg(op.reg)) {
+          heights.fp_is_known = false;
+        }
+      }
+    }
+    return true;
+
+  } else if (func.startswith("LEAVE")) {
+    if (!heights.fp_is_known || OverlapsReturnAddress(heights.fp, 8)) {
+      return false;
+    }
+    heights.sp = heights.fp + 8;
+    heights.fp_is_known = false;
+    return true;
+
+  } else if (func.startswith("ENTER")) {
+    return false;
+  }
+
+  const remill::Operand *dst = nullptr;
+  std::vector<const remill::Operand *> srcs;
+  for (const auto &op : inst.operands) {
+    if (op.action == remill::Operand::kActionWrite) {
+      if (op.type == remill::Operand::kTypeRegister &&
+          (IsStackPointerReg(op.reg) || IsFramePointerReg(op.reg))) {
+        if (dst) {
+          return false;
+        }
+        dst = &op;
+      }
+    } else if (op.action == remill::Operand::kActionRead) {
+      srcs.push_back(&op);
+    }
+  }
+
+  // Reads of the stack pointer, or of a known frame pointer, make pointers
+  // into the stack that we can't follow. The exceptions are the usual
+  // prologue and epilogue instructions.
+  auto reads_stack_ptr = false;
+  for (auto src : srcs) {
+    if (src->type == remill::Operand::kTypeRegister &&
+        (IsStackPointerReg(src->reg) ||
+         (IsFramePointerReg(src->reg) && heights.fp_is_known))) {
+      reads_stack_ptr = true;
+    }
+  }
+
+  if (!dst) {
+    return !reads_stack_ptr;
+  }
+
+  const auto &reg = dst->reg;
+  const auto is_full_width = reg.size == gArch->address_size;
+
+  // `add rsp, imm` and `sub rsp, imm`.
+  if ((func.startswith("ADD_") || func.startswith("SUB_")) &&
+      is_full_width && srcs.size() == 2 &&
+      srcs[0]->type == remill::Operand::kTypeRegister &&
+      srcs[0]->reg.name == reg.name &&
+      srcs[1]->type == remill::Operand::kTypeImmediate) {
+    const auto imm = static_cast<int64_t>(srcs[1]->imm.val);
+    const auto delta = func.startswith("ADD_") ? imm : -imm;
+    if (IsStackPointerReg(reg)) {
+      heights.sp += delta;
+      return true;
+    } else if (heights.fp_is_known) {
+      heights.fp += delta;
+      return true;
     } else {
-      inst_bytes.push_back(static_cast<char>(remill::GetReference(maybe_val)));
+      return true;
+    }
+
+  // `mov rbp, rsp` and `mov rsp, rbp`.
+  } else if (func.startswith("MOV_") && is_full_width && srcs.size() == 1 &&
+             srcs[0]->type == remill::Operand::kTypeRegister &&
+             srcs[0]->reg.size == gArch->address_size) {
+    if (IsFramePointerReg(reg) && IsStackPointerReg(srcs[0]->reg)) {
+      heights.fp = heights.sp;
+      heights.fp_is_known = true;
+      return true;
+    } else if (IsStackPointerReg(reg) && IsFramePointerReg(srcs[0]->reg) &&
+               heights.fp_is_known) {
+      heights.sp = heights.fp;
+      return true;
+    }
+
+  // `lea rbp, [rsp + disp]` and `lea rsp, [rbp + disp]`.
+  } else if (func.startswith("LEA_") && is_full_width && srcs.size() == 1 &&
+             srcs[0]->type == remill::Operand::kTypeAddress &&
+             srcs[0]->addr.index_reg.name.empty()) {
+    const auto &mem = srcs[0]->addr;
+    if (IsFramePointerReg(reg) && IsStackPointerReg(mem.base_reg)) {
+      heights.fp = heights.sp + mem.displacement;
+      heights.fp_is_known = true;
+      return true;
+    } else if (IsStackPointerReg(reg) && IsFramePointerReg(mem.base_reg) &&
+               heights.fp_is_known) {
+      heights.sp = heights.fp + mem.displacement;
+      return true;
     }
   }
 
-  if (is_delayed) {
-    return gArch->DecodeDelayedInstruction(pc, inst.bytes, inst);
-  } else {
-    return gArch->DecodeInstruction(pc, inst.bytes, inst);
+  // Any other write to the frame pointer makes it a general purpose
+  // register.
+  if (IsFramePointerReg(reg) && !reads_stack_ptr) {
+    heights.fp_is_known = false;
+    return true;
+  }
+
+  return false;
+}
+
+// Returns `true` if `cfg_func` provably never reads or writes its return
+// address slot on the stack, nor makes a pointer to it. This is a stack
+// height analysis over the function's blocks, which gives up on anything that
+// isn't the usual prologue, epilogue, and stack slot accesses. Tail calls give
+// up too, as the callee would inherit the return address slot.
+static bool IgnoresReturnAddress(const NativeModule *cfg_module,
+                                 const NativeFunction *cfg_func) {
+  static std::unordered_map<const NativeFunction *, bool> cache;
+  if (auto it = cache.find(cfg_func); it != cache.end()) {
+    return it->second;
+  }
+
+  auto &ignores = cache[cfg_func];
+  if (cfg_func->is_external || !cfg_func->eh_frame.empty() ||
+      cfg_func->blocks.empty()) {
+    return ignores;
+  }
+
+  std::unordered_map<uint64_t, const NativeBlock *> blocks;
+  for (auto block : cfg_func->blocks) {
+    blocks.emplace(block->ea, block);
+  }
+
+  std::unordered_map<uint64_t, StackHeights> block_heights;
+  std::vector<uint64_t> work_list;
+
+  auto add_succ = [&] (uint64_t ea, const StackHeights &heights) {
+    if (!blocks.count(ea)) {
+      return false;
+    }
+    auto [it, added] = block_heights.emplace(ea, heights);
+    if (added) {
+      work_list.push_back(ea);
+      return true;
+    }
+    return it->second == heights;
+  };
+
+  if (!add_succ(cfg_func->ea, StackHeights())) {
+    return ignores;
+  }
+
+  remill::Instruction inst;
+  while (!work_list.empty()) {
+    const auto block = blocks[work_list.back()];
+    work_list.pop_back();
+
+    auto heights = block_heights[block->ea];
+    for (auto pc = block->ea; pc <= block->last_inst_ea; pc = inst.next_pc) {
+      if (!DecodeInstructionAt(cfg_module, pc, inst, false) ||
+          !inst.IsValid() || !UpdateStackHeights(inst, heights)) {
+        return ignores;
+      }
+    }
+
+    auto ok = true;
+    switch (inst.category) {
+      case remill::Instruction::kCategoryInvalid:
+      case remill::Instruction::kCategoryError:
+      case remill::Instruction::kCategoryFunctionReturn:
+        break;
+
+      case remill::Instruction::kCategoryDirectJump:
+        ok = add_succ(inst.branch_taken_pc, heights);
+        break;
+
+      case remill::Instruction::kCategoryConditionalBranch:
+        ok = add_succ(inst.branch_taken_pc, heights) &&
+             add_succ(inst.branch_not_taken_pc, heights);
+        break;
+
+      // E.g. jump tables. Indirect tail calls have no successors.
+      case remill::Instruction::kCategoryIndirectJump:
+        ok = !block->successor_eas.empty();
+        for (auto succ_ea : block->successor_eas) {
+          ok = ok && add_succ(succ_ea, heights);
+        }
+        break;
+
+      // Calls to functions that don't return may not be followed by a block.
+      case remill::Instruction::kCategoryDirectFunctionCall:
+      case remill::Instruction::kCategoryIndirectFunctionCall:
+        if (blocks.count(inst.next_pc)) {
+          ok = add_succ(inst.next_pc, heights);
+        }
+        break;
+
+      default:
+        ok = add_succ(inst.next_pc, heights);
+        break;
+    }
+
+    if (!ok) {
+      return ignores;
+    }
   }
+
+  ignores = true;
+  return ignores;
+}
+
+// Returns `true` if the return address of the `call` or `ret` `ctx.inst`
+// doesn't need to be stored or loaded, and if so, sets `sp_delta` to how much
+// it moves the stack pointer. That is the case for direct calls between
+// lifted functions, where the callee never looks at its return address slot.
+// The lifted call and return are LLVM calls and returns, so nothing else would
+// read the return address. Stores of return addresses can't otherwise be
+// removed by the optimizer, as the emulated stack escapes.
+static bool ElidesReturnAddress(TranslationContext &ctx, int64_t &sp_delta) {
+  if (!FLAGS_elide_return_addresses || !gArch->IsAMD64()) {
+    return false;
+  }
+
+  const llvm::StringRef func(ctx.inst.function);
+  switch (ctx.inst.category) {
+    case remill::Instruction::kCategoryDirectFunctionCall: {
+      if (!func.startswith("CALL_NEAR")) {
+        return false;
+      }
+      auto [targ_cfg_func, targ_func] = FindFunction(
+          ctx, ctx.inst.branch_taken_pc);
+      if (!targ_cfg_func || targ_cfg_func->is_external ||
+          targ_func != targ_cfg_func->lifted_function ||
+          !IgnoresReturnAddress(ctx.cfg_module, targ_cfg_func)) {
+        return false;
+      }
+      sp_delta = -8;
+      return true;
+    }
+
+    case remill::Instruction::kCategoryFunctionReturn:
+      if (!func.startswith("RET_NEAR") ||
+          !IgnoresReturnAddress(ctx.cfg_module, ctx.cfg_func)) {
+        return false;
+      }
+      sp_delta = 8;
+      for (const auto &op : ctx.inst.operands) {
+        if (op.type == remill::Operand::kTypeImmediate) {
+          sp_delta += static_cast<int64_t>(op.imm.val);
+        }
+      }
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// Try to decode an instruction.
+static bool TryDecodeInstruction(
+    TranslationContext &ctx, uint64_t pc, bool is_delayed) {
+  return DecodeInstructionAt(
+      ctx.cfg_module, pc, is_delayed ? ctx.delayed_inst : ctx.inst,
+      is_delayed);
 }
 
 static llvm::BasicBlock *GetOrCreateBlock(TranslationContext &ctx,
                                           uint64_t pc,
                                           bool force_as_block=false);
 
+// Make sure that `func` maintains a frame pointer and gets unwind info.
+static void KeepFramePointer(llvm::Function *func) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(9, 0)
+  func->addFnAttr("frame-pointer", "all");
+#else
+  func->addFnAttr("no-frame-pointer-elim", "true");
+#endif
+  func->addFnAttr(llvm::Attribute::UWTable);
+}
+
 // Create a landing pad basic block.
 static void CreateLandingPad(TranslationContext &ctx,
                              struct NativeExceptionFrame *eh_entry) {
@@ -596,6 +1571,12 @@ static void CreateLandingPad(TranslationContext &ctx,
   llvm::IRBuilder<> ir(landing_bb);
   auto exn_type = llvm::StructType::get(*gContext, elem_types, false);
 
+  // The stack and frame pointers at the time of the unwinding `invoke`. Each
+  // invoke adds its own incoming values in `InlineSubFuncInvoke`, so that
+  // they are only materialized on the exceptional path.
+  auto sp_at_invoke = ir.CreatePHI(gWordType, 0, "sp_at_invoke");
+  auto bp_at_invoke = ir.CreatePHI(gWordType, 0, "bp_at_invoke");
+
 #if LLVM_VERSION_NUMBER > LLVM_VERSION(3, 6)
   auto lpad = ir.CreateLandingPad(exn_type, 1, ss.str());
 #else
@@ -677,27 +1658,19 @@ static void CreateLandingPad(TranslationContext &ctx,
 
     auto var_value = ir.CreateGEP(gvar_landingpad, array_index_vec);
 
+    args[0] = sp_at_invoke;
+    args[1] = bp_at_invoke;
 #if LLVM_VERSION_NUMBER > LLVM_VERSION(3, 6)
-    args[0] = ir.CreateLoad(gWordType, ctx.stack_ptr_var);
-    args[1] = ir.CreateLoad(gWordType, ctx.frame_ptr_var);
     args[2] = ir.CreateLoad(dword_type, var_value);
 #else
-    args[0] = ir.CreateLoad(ctx.stack_ptr_var, true);
-    args[1] = ir.CreateLoad(ctx.frame_ptr_var, true);
     args[2] = ir.CreateLoad(var_value, true);
 #endif
 
   } else {
     auto type_index_value = ir.CreateCall(GetExceptionTypeIndex());
-#if LLVM_VERSION_NUMBER > LLVM_VERSION(3, 6)
-    args[0] = ir.CreateLoad(gWordType, ctx.stack_ptr_var);
-    args[1] = ir.CreateLoad(gWordType, ctx.frame_ptr_var);
+    args[0] = sp_at_invoke;
+    args[1] = bp_at_invoke;
     args[2] = ir.CreateTruncOrBitCast(type_index_value, dword_type);
-#else
-    args[0] = ir.CreateLoad(ctx.stack_ptr_var, true);
-    args[1] = ir.CreateLoad(ctx.frame_ptr_var, true);
-    args[2] = ir.CreateTruncOrBitCast(type_index_value, dword_type);
-#endif
   }
 
   auto handler = GetExceptionHandlerPrologue();
@@ -723,9 +1696,15 @@ static void LiftExceptionFrameLP(TranslationContext &ctx,
   }
 
   const auto lifted_func = ctx.lifted_func;
-  lifted_func->addFnAttr(llvm::Attribute::OptimizeNone);
+  if (!FLAGS_optimize_eh_funcs) {
+    lifted_func->addFnAttr(llvm::Attribute::OptimizeNone);
+  }
+
+  // `__mcsema_exception_ret` restores the stack and frame pointers observed
+  // at the time of the `invoke`, so the frame pointer has to stay a frame
+  // pointer even once the function is optimized.
+  KeepFramePointer(lifted_func);
   lifted_func->removeFnAttr(llvm::Attribute::NoUnwind);
-  lifted_func->addFnAttr(llvm::Attribute::UWTable);
 
 #if LLVM_VERSION_NUMBER > LLVM_VERSION(3, 6)
   auto personality_func = GetPersonalityFunction();
@@ -743,11 +1722,29 @@ static void LiftFuncRestoredRegs(TranslationContext &ctx,
                                  llvm::BasicBlock *block,
                                  bool force=false);
 
+static void KillPCAndNextPC(TranslationContext &ctx, llvm::BasicBlock *block);
+
 // Lift an indirect jump into a switch instruction.
 static void LiftIndirectJump(
     TranslationContext &ctx, llvm::BasicBlock *block,
     const remill::Instruction &inst) {
 
+  // If the target is statically known, and is something that we lift, then
+  // treat this like a direct jump. Tail-calls to other functions are handled
+  // by `LiftFunction` when it visits the target block.
+  if (uint64_t target_ea = 0;
+      (!ctx.cfg_inst || !ctx.cfg_inst->offset_table) &&
+      FoldIndirectTarget(ctx, inst, target_ea) &&
+      (ctx.cfg_module->TryGetFunction(target_ea) ||
+       ctx.cfg_module->ea_to_block.count(target_ea))) {
+    LOG(INFO)
+        << "Folded target of indirect jump at " << std::hex << inst.pc
+        << " to " << target_ea << std::dec;
+    KillPCAndNextPC(ctx, block);
+    llvm::BranchInst::Create(GetOrCreateBlock(ctx, target_ea), block);
+    return;
+  }
+
   auto exit_point = GetLiftedToNativeExitPoint(kExitPointJump);
   auto fallback = DevirtualizeIndirectFlow(ctx, exit_point);
 
@@ -1007,6 +2004,235 @@ static void LiftInstIntoBlock(TranslationContext &ctx,
   ctx.cfg_inst = prev_cfg_inst;
 }
 
+// Lift a `call` or `ret` whose return address is elided as only its effect on
+// the stack pointer. See `ElidesReturnAddress`.
+static void LiftStackPointerAdjustment(TranslationContext &ctx,
+                                       llvm::BasicBlock *block,
+                                       int64_t sp_delta) {
+  Instrument(ctx, block, ctx.inst.pc);
+
+  const auto sp_ref = ctx.lifter->LoadRegAddress(
+      block, gArch->StackPointerRegisterName());
+  llvm::IRBuilder<> ir(block);
+  const auto sp = ir.CreateLoad(sp_ref);
+  ir.CreateStore(
+      ir.CreateAdd(sp, llvm::ConstantInt::get(
+          gWordType, static_cast<uint64_t>(sp_delta), true)),
+      sp_ref);
+}
+
+// A `cmp` or `test` whose operands are registers or immediates, and so can be
+// read again by the instruction that consumes its flags.
+struct FlagProducer {
+  bool is_test;
+  const remill::Operand *lhs;
+  const remill::Operand *rhs;
+};
+
+static bool GetFlagProducer(const remill::Instruction &inst,
+                            FlagProducer &producer) {
+  const llvm::StringRef func(inst.function);
+  if (inst.category != remill::Instruction::kCategoryNormal ||
+      !(func.startswith("CMP_") || func.startswith("TEST_")) ||
+      inst.operands.size() != 2) {
+    return false;
+  }
+
+  for (const auto &op : inst.operands) {
+    if (op.action != remill::Operand::kActionRead ||
+        !(op.type == remill::Operand::kTypeRegister ||
+          op.type == remill::Operand::kTypeImmediate) ||
+        op.size != inst.operands[0].size) {
+      return false;
+    }
+  }
+
+  producer.is_test = func.startswith("TEST_");
+  producer.lhs = &(inst.operands[0]);
+  producer.rhs = &(inst.operands[1]);
+  return true;
+}
+
+// Integer comparison that the condition code `cc` (e.g. `NLE` in `JNLE`)
+// tests after a `cmp lhs, rhs`. `on_difference` is set if it looks at the
+// sign of `lhs - rhs` instead of comparing `lhs` and `rhs`. After a `test`,
+// the same comparisons of `lhs & rhs` against zero hold, because it clears
+// `CF` and `OF`. Overflow and parity conditions are not covered.
+static bool GetConditionPredicate(llvm::StringRef cc,
+                                  llvm::CmpInst::Predicate &pred,
+                                  bool &on_difference) {
+  static const std::pair<const char *, llvm::CmpInst::Predicate> kPreds[] = {
+      {"Z", llvm::CmpInst::ICMP_EQ}, {"NZ", llvm::CmpInst::ICMP_NE},
+      {"B", llvm::CmpInst::ICMP_ULT}, {"NB", llvm::CmpInst::ICMP_UGE},
+      {"BE", llvm::CmpInst::ICMP_ULE}, {"NBE", llvm::CmpInst::ICMP_UGT},
+      {"L", llvm::CmpInst::ICMP_SLT}, {"NL", llvm::CmpInst::ICMP_SGE},
+      {"LE", llvm::CmpInst::ICMP_SLE}, {"NLE", llvm::CmpInst::ICMP_SGT},
+      {"S", llvm::CmpInst::ICMP_SLT}, {"NS", llvm::CmpInst::ICMP_SGE},
+  };
+  for (const auto &[name, cc_pred] : kPreds) {
+    if (cc == name) {
+      pred = cc_pred;
+      on_difference = cc.endswith("S");
+      return true;
+    }
+  }
+  return false;
+}
+
+static llvm::Value *LoadFlagOperand(TranslationContext &ctx,
+                                    llvm::BasicBlock *block,
+                                    const remill::Operand &op) {
+  const auto type = llvm::Type::getIntNTy(*gContext, op.size);
+  if (op.type == remill::Operand::kTypeImmediate) {
+    return llvm::ConstantInt::get(type, op.imm.val, op.imm.is_signed);
+  }
+  llvm::IRBuilder<> ir(block);
+  return ir.CreateZExtOrTrunc(
+      ctx.lifter->LoadRegValue(block, op.reg.name), type);
+}
+
+// Compute the condition `pred` of the flags of `producer` directly from its
+// operands.
+static llvm::Value *LiftFusedCondition(TranslationContext &ctx,
+                                       llvm::BasicBlock *block,
+                                       const FlagProducer &producer,
+                                       llvm::CmpInst::Predicate pred,
+                                       bool on_difference) {
+  auto lhs = LoadFlagOperand(ctx, block, *producer.lhs);
+  auto rhs = LoadFlagOperand(ctx, block, *producer.rhs);
+  llvm::IRBuilder<> ir(block);
+  if (producer.is_test) {
+    lhs = ir.CreateAnd(lhs, rhs);
+    rhs = llvm::Constant::getNullValue(lhs->getType());
+  } else if (on_difference) {
+    lhs = ir.CreateSub(lhs, rhs);
+    rhs = llvm::Constant::getNullValue(lhs->getType());
+  }
+  return ir.CreateICmp(pred, lhs, rhs);
+}
+
+// Lift the `jcc`, `setcc`, or register-to-register `cmovcc` following the
+// `cmp` or `test` in `ctx.inst`, which was just lifted into `block`, using
+// one comparison of the compared values, rather than recomputing its
+// condition from the flags. The flags are still written by the `cmp` or
+// `test`, for whatever else reads them, and are otherwise removed as dead
+// stores. The consumer's own block is bypassed, and is only lifted if
+// something else branches to it. Returns `true` if `block` was terminated.
+static bool FuseFlagConsumer(TranslationContext &ctx,
+                             llvm::BasicBlock *block) {
+  if (!FLAGS_fuse_flag_consumers || FLAGS_legacy_mode ||
+      !(gArch->IsX86() || gArch->IsAMD64())) {
+    return false;
+  }
+
+  FlagProducer producer = {};
+  if (!GetFlagProducer(ctx.inst, producer)) {
+    return false;
+  }
+
+  const auto next_pc = ctx.inst.next_pc;
+  remill::Instruction next;
+  if (ctx.cfg_module->TryGetFunction(next_pc) ||
+      !DecodeInstructionAt(ctx.cfg_module, next_pc, next, false) ||
+      !next.IsValid() || next.IsError()) {
+    return false;
+  }
+
+  llvm::CmpInst::Predicate pred = llvm::CmpInst::ICMP_EQ;
+  bool on_difference = false;
+  const llvm::StringRef func(next.function);
+  const auto cc_of = [&] (llvm::StringRef prefix) {
+    return func.drop_front(prefix.size()).split('_').first;
+  };
+
+  // Conditional branch.
+  if (next.category == remill::Instruction::kCategoryConditionalBranch) {
+    if (!func.startswith("J") ||
+        !GetConditionPredicate(cc_of("J"), pred, on_difference)) {
+      return false;
+    }
+    Instrument(ctx, block, next_pc);
+    const auto cond = LiftFusedCondition(
+        ctx, block, producer, pred, on_difference);
+    llvm::BranchInst::Create(
+        GetOrCreateBlock(ctx, next.branch_taken_pc),
+        GetOrCreateBlock(ctx, next.branch_not_taken_pc), cond, block);
+    return true;
+  }
+
+  if (next.category != remill::Instruction::kCategoryNormal) {
+    return false;
+  }
+
+  // Set a byte register.
+  if (func.startswith("SET") && func.endswith("_GPR8")) {
+    if (next.operands.size() != 1 ||
+        next.operands[0].type != remill::Operand::kTypeRegister ||
+        next.operands[0].action != remill::Operand::kActionWrite ||
+        !GetConditionPredicate(cc_of("SET"), pred, on_difference)) {
+      return false;
+    }
+    Instrument(ctx, block, next_pc);
+    const auto cond = LiftFusedCondition(
+        ctx, block, producer, pred, on_difference);
+    const auto dst = ctx.lifter->LoadRegAddress(
+        block, next.operands[0].reg.name);
+
+    // Only the byte register itself is written, e.g. `AH` leaves `AL` and
+    // the bits above `AH` alone.
+    llvm::IRBuilder<> ir(block);
+    const auto i8_type = llvm::Type::getInt8Ty(*gContext);
+    ir.CreateStore(
+        ir.CreateZExt(cond, i8_type),
+        ir.CreateBitCast(dst, llvm::PointerType::get(
+            i8_type, dst->getType()->getPointerAddressSpace())));
+
+  // Conditionally move between registers, e.g. `CMOVL_GPRv_GPRv_32`. A
+  // 32-bit destination is zero-extended even if the condition doesn't hold;
+  // a 16-bit one keeps the upper bits of its register.
+  } else if (func.startswith("CMOV") &&
+             func.rsplit('_').first.endswith("_GPRv_GPRv")) {
+    const auto width = func.rsplit('_').second;
+    if ((width != "16" && width != "32" && width != "64") ||
+        next.operands.size() != 2 ||
+        next.operands[0].type != remill::Operand::kTypeRegister ||
+        next.operands[0].action != remill::Operand::kActionWrite ||
+        next.operands[1].type != remill::Operand::kTypeRegister ||
+        next.operands[1].action != remill::Operand::kActionRead ||
+        !GetConditionPredicate(cc_of("CMOV"), pred, on_difference)) {
+      return false;
+    }
+    Instrument(ctx, block, next_pc);
+    const auto cond = LiftFusedCondition(
+        ctx, block, producer, pred, on_difference);
+    const auto src = LoadFlagOperand(ctx, block, next.operands[1]);
+    const auto dst = ctx.lifter->LoadRegAddress(
+        block, next.operands[0].reg.name);
+    const auto dst_type = llvm::cast<llvm::IntegerType>(
+        dst->getType()->getPointerElementType());
+    llvm::IRBuilder<> ir(block);
+    const auto dst_val = ir.CreateLoad(dst);
+    const auto old_val = ir.CreateZExtOrTrunc(dst_val, src->getType());
+    llvm::Value *new_val = ir.CreateZExtOrTrunc(
+        ir.CreateSelect(cond, src, old_val), dst_type);
+    if (width != "32" &&
+        dst_type->getBitWidth() > src->getType()->getIntegerBitWidth()) {
+      const auto low_mask = llvm::ConstantInt::get(
+          dst_type, llvm::APInt::getLowBitsSet(
+              dst_type->getBitWidth(), src->getType()->getIntegerBitWidth()));
+      new_val = ir.CreateOr(
+          ir.CreateAnd(dst_val, ir.CreateNot(low_mask)), new_val);
+    }
+    ir.CreateStore(new_val, dst);
+
+  } else {
+    return false;
+  }
+
+  llvm::BranchInst::Create(GetOrCreateBlock(ctx, next.next_pc), block);
+  return true;
+}
+
 static std::unordered_map<llvm::Type *, llvm::Function *> gTypeToRestorer;
 
 // Get a type-specific register restorer.
@@ -1039,13 +2265,20 @@ static llvm::Function *GetRestorer(llvm::Type *type) {
 
 static std::unordered_map<llvm::Type *, llvm::Constant *> gTypeToKiller;
 
-// Get a type-specific register killer.
+// Get a type-specific register killer. Only integers can be computed from
+// the address of `__remill_kill`; vector registers, e.g. `XMM0`, are killed
+// by storing `undef` into them.
 static llvm::Constant *GetKiller(llvm::Type *type) {
   auto &gc = gTypeToKiller[type];
   if (gc) {
     return gc;
   }
 
+  if (!type->isIntegerTy()) {
+    gc = llvm::UndefValue::get(type);
+    return gc;
+  }
+
   auto gv = gModule->getGlobalVariable("__remill_kill");
   if (!gv) {
     gv = new llvm::GlobalVariable(
@@ -1201,9 +2434,17 @@ static void KillPCAndNextPC(TranslationContext &ctx, llvm::BasicBlock *block) {
 
 static void LiftKilledRegs(TranslationContext &ctx, llvm::BasicBlock *block) {
   llvm::IRBuilder<> ir(block);
+
+  // Dead registers are computed without looking at exception edges, and the
+  // landing pad of an `invoke` still needs the frame pointer.
+  const auto is_invoke = ctx.cfg_inst && ctx.cfg_inst->lp_ea;
+
   ctx.cfg_module->ForEachInstructionKilledRegister(
     ctx.inst.pc,
     [=, &ir, &ctx](const std::string &reg_name) {
+      if (is_invoke && reg_name == FramePointerRegisterName()) {
+        return;
+      }
       const auto reg_ptr = ctx.lifter->LoadRegAddress(block, reg_name);
       if (!reg_ptr) {
         return;
@@ -1239,10 +2480,68 @@ static uint64_t FunctionReturnAddress(TranslationContext &ctx) {
   return ctx.inst.branch_not_taken_pc;
 }
 
+// Lift the indirect call at the end of `block` as a chain of comparisons of
+// its target against the lifted methods that the virtual table slot it loads
+// from may hold, each calling its method directly. Any other target, e.g. a
+// method of a class from a shared library, is called through `fallback`.
+// Returns the block where the calls join back, or `nullptr` if the call
+// doesn't look like a virtual call with few enough targets.
+static llvm::BasicBlock *LiftVirtualCall(TranslationContext &ctx,
+                                         llvm::BasicBlock *block,
+                                         llvm::Function *fallback) {
+  uint64_t slot_offset = 0;
+  if (!FLAGS_devirtualize_vtables ||
+      !FindVirtualCallSlot(ctx, ctx.inst, slot_offset)) {
+    return nullptr;
+  }
+
+  const auto &slots = GetVirtualTableSlots(ctx.cfg_module);
+  const auto slot_it = slots.find(slot_offset);
+  if (slot_it == slots.end() ||
+      slot_it->second.size() > FLAGS_max_virtual_call_targets) {
+    return nullptr;
+  }
+
+  const auto target = LoadNextProgramCounter(ctx, block);
+  const auto join_block = llvm::BasicBlock::Create(
+      *gContext, "", ctx.lifted_func);
+
+  for (auto [ea, cfg_func] : slot_it->second) {
+    const auto direct_block = llvm::BasicBlock::Create(
+        *gContext, "", ctx.lifted_func);
+    const auto next_block = llvm::BasicBlock::Create(
+        *gContext, "", ctx.lifted_func);
+
+    auto cmp = llvm::CmpInst::Create(
+        llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+        target, LiftXrefInCode(ea), "", block);
+    llvm::BranchInst::Create(direct_block, next_block, cmp, block);
+
+    KillPCAndNextPC(ctx, direct_block);
+    LiftSubFuncCall(ctx, direct_block, CallableLiftedFunc(cfg_func, fallback),
+                    PCValueKind::kUndefPC);
+    llvm::BranchInst::Create(join_block, direct_block);
+
+    block = next_block;
+  }
+
+  LiftSubFuncCall(ctx, block, fallback);
+  llvm::BranchInst::Create(join_block, block);
+
+  gNumDevirtualizedCalls += 1;
+  gNumDevirtualizedTargets += static_cast<unsigned>(slot_it->second.size());
+
+  return join_block;
+}
+
 // Lift a decoded block into a function.
 static void LiftInstIntoFunction(TranslationContext &ctx,
                                  llvm::BasicBlock *block) {
-  LiftInstIntoBlock(ctx, ctx.inst, block, false  /* is_delayed */);
+  if (int64_t sp_delta = 0; ElidesReturnAddress(ctx, sp_delta)) {
+    LiftStackPointerAdjustment(ctx, block, sp_delta);
+  } else {
+    LiftInstIntoBlock(ctx, ctx.inst, block, false  /* is_delayed */);
+  }
 
   // We might need to lift another instruction and execute it in the delay
   // slot. `cont` contains enough info to redirect control flow after we've
@@ -1279,7 +2578,10 @@ static void LiftInstIntoFunction(TranslationContext &ctx,
 
     case remill::Instruction::kCategoryNormal: {
       CHECK(!ctx.delayed_inst.IsValid());
-      llvm::BranchInst::Create(GetOrCreateBlock(ctx, ctx.inst.next_pc), block);
+      if (!FuseFlagConsumer(ctx, block)) {
+        llvm::BranchInst::Create(
+            GetOrCreateBlock(ctx, ctx.inst.next_pc), block);
+      }
       break;
     }
 
@@ -1382,11 +2684,14 @@ static void LiftInstIntoFunction(TranslationContext &ctx,
       if (!ctx.cfg_inst || !ctx.cfg_inst->lp_ea) {
         LiftSavedRegs(ctx, block);
         LiftKilledRegs(ctx, block);
-        if (fallback_func == target_func) {
-          LiftSubFuncCall(ctx, block, target_func);
-        } else {
+        if (fallback_func != target_func) {
           KillPCAndNextPC(ctx, block);
           LiftSubFuncCall(ctx, block, target_func, PCValueKind::kUndefPC);
+        } else if (auto join_block = LiftVirtualCall(ctx, block, target_func);
+                   join_block) {
+          block = join_block;
+        } else {
+          LiftSubFuncCall(ctx, block, target_func);
         }
         LiftRestoredRegs(ctx, block);
         llvm::BranchInst::Create(
@@ -1491,6 +2796,10 @@ static llvm::Function *LiftFunction(
     lifted_func->addFnAttr(llvm::Attribute::StackProtectReq);
   }
 
+  if (FLAGS_frame_pointers) {
+    KeepFramePointer(lifted_func);
+  }
+
   TranslationContext ctx;
   InstructionLifter lifter(&intrinsics, ctx);
 
@@ -1519,11 +2828,12 @@ static llvm::Function *LiftFunction(
   auto unique_it = std::unique(ctx.work_list.begin(), ctx.work_list.end());
   ctx.work_list.erase(unique_it, ctx.work_list.end());
 
+  const auto entry_block = &(lifted_func->front());
+  llvm::IRBuilder<> ir(entry_block);
+
   // Lift the landing pad if there are exception frames recovered.
   LiftExceptionFrameLP(ctx, cfg_func);
 
-  const auto entry_block = &(lifted_func->front());
-
   if (FLAGS_add_func_state_tracer) {
     LiftSubFuncCall(ctx, entry_block, GetRegTracer());
   }
@@ -1531,19 +2841,10 @@ static llvm::Function *LiftFunction(
   const auto next_pc_ref = LoadNextProgramCounterRef(ctx, entry_block);
   const auto pc_ref = LoadProgramCounterRef(ctx, entry_block);
   const auto pc = LiftXrefInCode(cfg_func->ea);
-  llvm::IRBuilder<> ir(entry_block);
+  ir.SetInsertPoint(entry_block);
   ir.CreateStore(pc, next_pc_ref);
   ir.CreateStore(pc, pc_ref);
 
-  // Used for exception handling.
-  ctx.stack_ptr_var = ir.CreateAlloca(
-      llvm::Type::getInt64Ty(*gContext),
-      llvm::ConstantInt::get(gWordType, 1), "stack_ptr_var");
-
-  ctx.frame_ptr_var = ir.CreateAlloca(
-      llvm::Type::getInt64Ty(*gContext),
-      llvm::ConstantInt::get(gWordType, 1), "frame_ptr_var");
-
   // Preserve registers at a function granularity.
   cfg_module->ForEachRangePreservedRegister(
       cfg_func->ea,
@@ -1749,10 +3050,18 @@ bool DefineLiftedFunctions(const NativeModule *cfg_module) {
     }
 
     func_pass_manager.run(*lifted_func);
+
+    // All lifted functions are declared up-front, so the callees of this
+    // function are already resolved, and it can be streamed out.
+    StreamLiftedFunction(cfg_module, lifted_func);
   }
 
   func_pass_manager.doFinalization();
 
+  LOG_IF(INFO, gNumDevirtualizedCalls)
+      << "Devirtualized " << gNumDevirtualizedCalls << " virtual calls into "
+      << gNumDevirtualizedTargets << " direct calls of lifted methods";
+
   return true;
 }
 
@@ -17,6 +17,7 @@
 
 #include "Instruction.h"
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include <sstream>
@@ -41,6 +42,11 @@
 #include "mcsema/BC/Util.h"
 #include "mcsema/CFG/CFG.h"
 
+DEFINE_bool(native_segment_access, true,
+            "Compute the base of thread-local segment accesses (e.g. "
+            "`fs:[0x28]`) from the native segment instead of from the "
+            "`FS_BASE`/`GS_BASE` registers of the lifted state.");
+
 
 namespace mcsema {
 
@@ -242,6 +248,24 @@ llvm::Value *InstructionLifter::LiftAddressOperand(
     }
   }
 
+  // Thread-local accesses, e.g. `mov rax, fs:[0x28]`, add the base of the
+  // segment that we read out of the segment itself. Memory access lowering
+  // recognizes this and turns the whole access back into a single
+  // segment-relative one, which saves us from keeping `FS_BASE` in the state.
+  if (FLAGS_native_segment_access && !mem.segment_base_reg.name.empty()) {
+    llvm::IRBuilder<> ir(block);
+    if (auto seg_base = GetSegmentBaseAddress(
+            ir, mem.segment_base_reg.name); seg_base) {
+      const auto seg_base_reg = mem.segment_base_reg.name;
+      mem.segment_base_reg.name.clear();
+      auto offset = this->remill::InstructionLifter::LiftAddressOperand(
+          inst, block, arg, op);
+      mem.segment_base_reg.name = seg_base_reg;
+      ir.SetInsertPoint(block);
+      return ir.CreateAdd(offset, seg_base);
+    }
+  }
+
   return this->remill::InstructionLifter::LiftAddressOperand(
       inst, block, arg, op);
 }
@@ -60,6 +60,7 @@
 #include "mcsema/BC/Legacy.h"
 #include "mcsema/BC/Optimize.h"
 #include "mcsema/BC/Segment.h"
+#include "mcsema/BC/Stream.h"
 #include "mcsema/BC/Util.h"
 #include "mcsema/CFG/CFG.h"
 
@@ -219,7 +220,8 @@ bool LiftCodeIntoModule(const NativeModule *cfg_module) {
 
   DefineErrorIntrinsics();
 
-  // Optimize the lifted bitcode.
+  // Optimize the lifted bitcode. This lowers the memory access intrinsics
+  // into `load` and `store` instructions before the bulk of the optimizations.
   OptimizeModule(cfg_module);
 
   // Segments are only filled in after the lifted function declarations,
@@ -231,8 +233,8 @@ bool LiftCodeIntoModule(const NativeModule *cfg_module) {
   // post-`main` functions destructors.
   CallInitFiniCode(cfg_module);
 
-  // Remove leftover Remill intrinsics, and lower memory access intrincis into
-  // `load` and `store` instructions.
+  // Remove leftover Remill intrinsics, and lower any remaining memory access
+  // intrinsics into `load` and `store` instructions.
   CleanUpModule(cfg_module);
 
   // Add entrypoint functions for any exported functions.
@@ -241,6 +243,13 @@ bool LiftCodeIntoModule(const NativeModule *cfg_module) {
   // Export any variables that should be externally visible.
   ExportVariables(cfg_module);
 
+  // Group the lifted code and big segments for huge pages.
+  PlaceInHugePages(cfg_module);
+
+  // Now that all lifted functions are in their final form, drop any of the
+  // native flags unpacking that the lifted functions don't need.
+  RemoveDeadFlagUnpacks();
+
   if (FLAGS_explicit_args) {
     DefineGCCStackGuard();
     DefineDebugGetRegState();
@@ -250,6 +259,10 @@ bool LiftCodeIntoModule(const NativeModule *cfg_module) {
     legacy::PropagateInstAnnotations();
   }
 
+  // Make the module's internal functions and variables that streamed shards
+  // use visible to them.
+  FinishStreamingFunctions();
+
   return true;
 }
 
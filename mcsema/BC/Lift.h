@@ -63,8 +63,6 @@ struct TranslationContext {
   std::vector<std::tuple<uint64_t, bool, uint64_t>> work_list;
 
   llvm::BasicBlock *entry_block{nullptr};
-  llvm::Value *stack_ptr_var{nullptr};
-  llvm::Value *frame_ptr_var{nullptr};
 };
 
 bool LiftCodeIntoModule(const NativeModule *cfg_module);
@@ -22,17 +22,26 @@
 
 #include <algorithm>
 #include <limits>
+#include <map>
+#include <memory>
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include <llvm/ADT/Triple.h>
 
+#include <llvm/Analysis/ScopedNoAliasAA.h>
+#include <llvm/Analysis/ValueTracking.h>
+
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DebugInfo.h>
+#include <llvm/IR/InlineAsm.h>
 #include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/LLVMContext.h>
@@ -41,8 +50,11 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 
+#include <llvm/Linker/Linker.h>
+
 #include <llvm/Transforms/IPO.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Utils/Local.h>
 #include <llvm/Transforms/Utils/Cloning.h>
@@ -51,12 +63,14 @@
 #include <anvill/Analyze.h>
 
 #include <remill/Arch/Arch.h>
+#include <remill/Arch/Runtime/HyperCall.h>
 #include <remill/BC/ABI.h>
 #include <remill/BC/Compat/GlobalValue.h>
 #include <remill/BC/Compat/ScalarTransforms.h>
 #include <remill/BC/Compat/TargetLibraryInfo.h>
 #include <remill/BC/DeadStoreEliminator.h>
 #include <remill/BC/Util.h>
+#include <remill/BC/Version.h>
 
 #include "mcsema/Arch/Arch.h"
 #include "mcsema/BC/Optimize.h"
@@ -66,6 +80,15 @@
 DEFINE_bool(keep_memops, false,
             "Should the memory intrinsics be replaced or not?");
 
+DEFINE_string(memops_runtime, "",
+              "Path to a bitcode file, e.g. memops_amd64.bc, with always-inline "
+              "definitions of the memory intrinsics. When lifting with "
+              "--keep_memops, this is linked into the module before "
+              "optimization, so that memory accesses become direct loads and "
+              "stores. A custom version of this file can make its accessors "
+              "call instrumentation hooks on only some paths, so that only "
+              "those paths pay for a call.");
+
 DEFINE_bool(check_for_lowmem_xrefs, false,
             "Check every constant, even those less than 4096, to see "
             "if they might be cross-reference targets. This might be "
@@ -81,17 +104,70 @@ DEFINE_bool(restore_all_on_unreachable, false,
             "Ensure that functions containing unreachable code end up "
             "restoring all saved registers on returning paths.");
 
+DEFINE_bool(lower_hyper_calls, true,
+            "Lower the x86 CPUID, RDTSC, and RDTSCP synchronous hyper calls "
+            "into inline assembly that only touches the registers that each "
+            "instruction reads and writes, instead of calling into the "
+            "runtime with the whole register state.");
+
+DEFINE_bool(cache_cpuid, false,
+            "Treat lowered CPUID instructions as having no side-effects, so "
+            "that repeated queries with the same inputs can be merged. This "
+            "is meant for feature detection (leaves 0 and 1), and is not "
+            "safe if the program depends on per-core values such as the "
+            "APIC ID.");
+
+DEFINE_bool(minimize_flag_exprs, false,
+            "Run an extra round of scalar simplification over the lifted code "
+            "so that arithmetic flag computations fold into the conditions "
+            "that consume them, and branches on the same flags are threaded. "
+            "This produces fewer, larger expressions, which is what symbolic "
+            "executors and other analysis engines want.");
+
+DEFINE_bool(recover_vector_ops, true,
+            "Rebuild the lane-by-lane computations of lifted SSE and AVX "
+            "instructions into LLVM vector operations, loads and stores, so "
+            "that each of them compiles back into about one SIMD "
+            "instruction.");
+
+DEFINE_bool(string_op_fast_paths, true,
+            "Give REP MOVS and REP STOS instructions fast paths that use "
+            "memmove and memset instead of the one-element-at-a-time loops "
+            "of their semantics.");
+
 DECLARE_bool(disable_aliases);
 
 namespace mcsema {
 namespace {
 
+// The lifted functions that are being optimized and lowered ahead of the rest
+// of the module so that they can be streamed out of it. While this is set,
+// intrinsics are only lowered within these functions, and are never removed,
+// because the semantics of the functions that are yet to be lifted still
+// call them.
+static const std::unordered_set<llvm::Function *> *gStreamedFuncs = nullptr;
+
+// Get the calls to `func` that should be lowered.
+static std::vector<llvm::CallInst *> LowerableCallersOf(llvm::Function *func) {
+  auto callers = remill::CallersOf(func);
+  if (gStreamedFuncs) {
+    callers.erase(
+        std::remove_if(callers.begin(), callers.end(),
+                       [] (llvm::CallInst *call_inst) {
+                         return !gStreamedFuncs->count(
+                             call_inst->getFunction());
+                       }),
+        callers.end());
+  }
+  return callers;
+}
+
 // Replace all uses of a specific intrinsic with an undefined value. We actually
 // don't use LLVM's `undef` values because those can behave unpredictably
 // across different LLVM versions with different optimization levels. Instead,
 // we use a null value (zero, really).
 static void ReplaceUndefIntrinsic(llvm::Function *function) {
-  auto call_insts = remill::CallersOf(function);
+  auto call_insts = LowerableCallersOf(function);
   auto undef_val = llvm::Constant::getNullValue(function->getReturnType());
   for (auto call_inst : call_insts) {
     call_inst->replaceAllUsesWith(undef_val);
@@ -118,6 +194,13 @@ static void RemoveFunction(const char *name) {
   }
 }
 
+// Remove an intrinsic whose calls have all been lowered.
+static void RemoveLoweredFunction(llvm::Function *func) {
+  if (!gStreamedFuncs) {
+    RemoveFunction(func);
+  }
+}
+
 // Remove calls to the various undefined value intrinsics.
 static void RemoveUndefFuncCalls(void) {
   llvm::Function *undef_funcs[] = {
@@ -132,7 +215,7 @@ static void RemoveUndefFuncCalls(void) {
   for (auto undef_func : undef_funcs) {
     if (undef_func) {
       ReplaceUndefIntrinsic(undef_func);
-      RemoveFunction(undef_func);
+      RemoveLoweredFunction(undef_func);
     }
   }
 }
@@ -169,7 +252,7 @@ static void ReplaceBarrier(const char *name) {
   CHECK(func->isDeclaration())
       << "Cannot lower already implemented memory intrinsic " << name;
 
-  auto callers = remill::CallersOf(func);
+  auto callers = LowerableCallersOf(func);
   for (auto call_inst : callers) {
     auto mem_ptr = call_inst->getArgOperand(0);
     call_inst->replaceAllUsesWith(mem_ptr);
@@ -481,6 +564,18 @@ llvm::Value *GetPointer(
   } else if (auto as_add = llvm::dyn_cast<llvm::AddOperator>(addr); as_add) {
     const auto lhs_op = as_add->getOperand(0);
     const auto rhs_op = as_add->getOperand(1);
+
+    // A thread-local access, e.g. `fs:[0x28]`, where the segment base was
+    // read out of the segment itself. Address the segment directly instead.
+    if (auto seg_addr_space = GetSegmentBaseAddressSpace(lhs_op);
+        seg_addr_space) {
+      return GetPointerFromInt(ir, rhs_op, elem_type, seg_addr_space);
+
+    } else if (auto seg_addr_space = GetSegmentBaseAddressSpace(rhs_op);
+               seg_addr_space) {
+      return GetPointerFromInt(ir, lhs_op, elem_type, seg_addr_space);
+    }
+
     auto lhs = FindPointer(ir, lhs_op, elem_type, addr_space);
     auto rhs = FindPointer(ir, rhs_op, elem_type, addr_space);
 
@@ -617,6 +712,55 @@ llvm::Value *GetPointer(
   }
 }
 
+// The alias scope list of accesses to the `State` structure. The lifted
+// program cannot form pointers into the `State` structure, so lowered memory
+// accesses are outside of this scope. That lets GVN forward register values
+// across memory writes, and lets DSE and LICM move accesses to registers past
+// memory accesses.
+static llvm::MDNode *StateAliasScopes(void) {
+  static llvm::MDNode *scopes = nullptr;
+  if (!scopes) {
+    llvm::MDBuilder mdb(*gContext);
+    auto domain = mdb.createAliasScopeDomain("mcsema.memory");
+    auto scope = mdb.createAliasScope("mcsema.state", domain);
+    scopes = llvm::MDNode::get(*gContext, scope);
+  }
+  return scopes;
+}
+
+// Returns `true` if `ptr` is derived from a pointer to the `State` structure.
+static bool IsStatePointer(llvm::Value *ptr) {
+  for (;;) {
+    ptr = ptr->stripPointerCasts();
+    if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(ptr); gep) {
+      ptr = gep->getPointerOperand();
+    } else {
+      break;
+    }
+  }
+  const auto ptr_type = ptr->getType();
+  return ptr_type->isPointerTy() &&
+         ptr_type->getPointerElementType() == gArch->StateStructType();
+}
+
+// Put the accesses to the `State` structure in `func` into the `State` alias
+// scope. The lowered memory accesses are already marked as not aliasing it.
+static void AnnotateStateAccesses(llvm::Function &func) {
+  const auto scopes = StateAliasScopes();
+  for (auto &inst : llvm::instructions(func)) {
+    llvm::Value *ptr = nullptr;
+    if (auto load_inst = llvm::dyn_cast<llvm::LoadInst>(&inst); load_inst) {
+      ptr = load_inst->getPointerOperand();
+    } else if (auto store_inst = llvm::dyn_cast<llvm::StoreInst>(&inst);
+               store_inst) {
+      ptr = store_inst->getPointerOperand();
+    }
+    if (ptr && IsStatePointer(ptr)) {
+      inst.setMetadata(llvm::LLVMContext::MD_alias_scope, scopes);
+    }
+  }
+}
+
 // Lower a memory read intrinsic into a `load` instruction.
 static void ReplaceMemReadOp(const NativeModule *cfg_module, const char *name,
                              llvm::Type *val_type) {
@@ -628,15 +772,18 @@ static void ReplaceMemReadOp(const NativeModule *cfg_module, const char *name,
   CHECK(func->isDeclaration())
       << "Cannot lower already implemented memory intrinsic " << name;
 
-  auto callers = remill::CallersOf(func);
+  auto callers = LowerableCallersOf(func);
   for (auto call_inst : callers) {
     auto addr = call_inst->getArgOperand(1);
     llvm::IRBuilder<> ir(call_inst);
     llvm::Value *ptr = GetPointer(cfg_module, ir, addr, val_type, 0);
     llvm::Value *val = ir.CreateLoad(ptr);
-    if (auto load_inst = llvm::dyn_cast<llvm::LoadInst>(val);
-        FLAGS_volatile_memops && load_inst) {
-      load_inst->setVolatile(true);
+    if (auto load_inst = llvm::dyn_cast<llvm::LoadInst>(val); load_inst) {
+      load_inst->setMetadata(llvm::LLVMContext::MD_noalias,
+                             StateAliasScopes());
+      if (FLAGS_volatile_memops) {
+        load_inst->setVolatile(true);
+      }
     }
     if (val_type->isX86_FP80Ty() || val_type->isFP128Ty()) {
       val = ir.CreateFPTrunc(val, func->getReturnType());
@@ -646,7 +793,7 @@ static void ReplaceMemReadOp(const NativeModule *cfg_module, const char *name,
   for (auto call_inst : callers) {
     call_inst->eraseFromParent();
   }
-  RemoveFunction(func);
+  RemoveLoweredFunction(func);
 }
 
 // Lower a memory write intrinsic into a `store` instruction.
@@ -660,7 +807,7 @@ static void ReplaceMemWriteOp(const NativeModule *cfg_module, const char *name,
   CHECK(func->isDeclaration())
       << "Cannot lower already implemented memory intrinsic " << name;
 
-  auto callers = remill::CallersOf(func);
+  auto callers = LowerableCallersOf(func);
 
   for (auto call_inst : callers) {
     auto mem_ptr = call_inst->getArgOperand(0);
@@ -674,6 +821,7 @@ static void ReplaceMemWriteOp(const NativeModule *cfg_module, const char *name,
     }
 
     auto store_inst = ir.CreateStore(val, ptr);
+    store_inst->setMetadata(llvm::LLVMContext::MD_noalias, StateAliasScopes());
     if (FLAGS_volatile_memops) {
       store_inst->setVolatile(true);
     }
@@ -682,7 +830,63 @@ static void ReplaceMemWriteOp(const NativeModule *cfg_module, const char *name,
   for (auto call_inst : callers) {
     call_inst->eraseFromParent();
   }
-  RemoveFunction(func);
+  RemoveLoweredFunction(func);
+}
+
+// Bulk operations used by the fast paths of `REP` string instructions. They
+// are lowered along with the other memory intrinsics.
+static constexpr auto kStringMemMove = "__mcsema_memmove";
+static constexpr auto kStringMemSet = "__mcsema_memset";
+
+// Lower the bulk memory operations of the `REP` string instruction fast paths
+// (see `SplitStringOps`) into `llvm.memmove` and `llvm.memset`.
+static void ReplaceStringOp(const NativeModule *cfg_module, const char *name) {
+  auto func = gModule->getFunction(name);
+  if (!func) {
+    return;
+  }
+
+  CHECK(func->isDeclaration())
+      << "Cannot lower already implemented memory intrinsic " << name;
+
+  const auto i8_type = llvm::Type::getInt8Ty(*gContext);
+  const llvm::StringRef func_name(name);
+
+  auto callers = LowerableCallersOf(func);
+  for (auto call_inst : callers) {
+    auto mem_ptr = call_inst->getArgOperand(0);
+    auto size = call_inst->getArgOperand(3);
+
+    llvm::IRBuilder<> ir(call_inst);
+    auto dst = GetPointer(cfg_module, ir, call_inst->getArgOperand(1),
+                          i8_type, 0);
+    llvm::Instruction *op = nullptr;
+    if (func_name == kStringMemSet) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+      op = ir.CreateMemSet(dst, call_inst->getArgOperand(2), size,
+                           llvm::MaybeAlign(1), FLAGS_volatile_memops);
+#else
+      op = ir.CreateMemSet(dst, call_inst->getArgOperand(2), size, 1,
+                           FLAGS_volatile_memops);
+#endif
+    } else {
+      auto src = GetPointer(cfg_module, ir, call_inst->getArgOperand(2),
+                            i8_type, 0);
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+      op = ir.CreateMemMove(dst, llvm::MaybeAlign(1), src,
+                            llvm::MaybeAlign(1), size,
+                            FLAGS_volatile_memops);
+#else
+      op = ir.CreateMemMove(dst, 1, src, 1, size, FLAGS_volatile_memops);
+#endif
+    }
+    op->setMetadata(llvm::LLVMContext::MD_noalias, StateAliasScopes());
+    call_inst->replaceAllUsesWith(mem_ptr);
+  }
+  for (auto call_inst : callers) {
+    call_inst->eraseFromParent();
+  }
+  RemoveLoweredFunction(func);
 }
 
 static void LowerMemOps(const NativeModule *cfg_module) {
@@ -721,6 +925,27 @@ static void LowerMemOps(const NativeModule *cfg_module) {
                     llvm::Type::getX86_FP80Ty(*gContext));
   ReplaceMemWriteOp(cfg_module, "__remill_write_memory_f128",
                     llvm::Type::getFP128Ty(*gContext));
+
+  ReplaceStringOp(cfg_module, kStringMemMove);
+  ReplaceStringOp(cfg_module, kStringMemSet);
+
+  ReplaceBarrier("__remill_barrier_load_load");
+  ReplaceBarrier("__remill_barrier_load_store");
+  ReplaceBarrier("__remill_barrier_store_load");
+  ReplaceBarrier("__remill_barrier_store_store");
+  ReplaceBarrier("__remill_barrier_atomic_begin");
+  ReplaceBarrier("__remill_barrier_atomic_end");
+  ReplaceBarrier("__remill_delay_slot_begin");
+  ReplaceBarrier("__remill_delay_slot_end");
+  ReplaceBarrier("__remill_atomic_begin");
+  ReplaceBarrier("__remill_atomic_end");
+
+  for (auto &func : *gModule) {
+    if (!func.isDeclaration() &&
+        (!gStreamedFuncs || gStreamedFuncs->count(&func))) {
+      AnnotateStateAccesses(func);
+    }
+  }
 }
 
 static bool RemoveDeadRestores(llvm::Function *restorer) {
@@ -765,7 +990,8 @@ static bool RemoveDeadRestores(llvm::Function *restorer) {
 
     for (auto user : restorer->users()) {
       const auto call = llvm::dyn_cast<llvm::CallInst>(user);
-      if (!call) {
+      if (!call ||
+          (gStreamedFuncs && !gStreamedFuncs->count(call->getFunction()))) {
         continue;
       }
 
@@ -885,8 +1111,12 @@ static bool RemoveDeadRestores(void) {
       to_remove.push_back(&func);
     }
   }
-  for (auto func : to_remove) {
-    func->eraseFromParent();
+
+  // Functions that are yet to be lifted still get restores.
+  if (!gStreamedFuncs) {
+    for (auto func : to_remove) {
+      func->eraseFromParent();
+    }
   }
   return needs_restores;
 }
@@ -895,6 +1125,7 @@ static void RemoveKilledStores(void) {
   if (auto killer = gModule->getGlobalVariable("__remill_kill"); killer) {
     std::vector<std::pair<llvm::CallInst *, llvm::Value *>> to_replace;
     std::vector<llvm::Instruction *> to_remove;
+    std::vector<std::pair<llvm::Instruction *, llvm::Value *>> to_undef;
     std::vector<llvm::Value *> work_list;
     std::vector<llvm::Value *> next_work_list;
     next_work_list.push_back(killer);
@@ -904,10 +1135,16 @@ static void RemoveKilledStores(void) {
       next_work_list.clear();
       for (auto val : work_list) {
         for (auto user : val->users()) {
-          if (auto si = llvm::dyn_cast<llvm::StoreInst>(user); si) {
+          auto inst = llvm::dyn_cast<llvm::Instruction>(user);
+          if (inst && gStreamedFuncs &&
+              !gStreamedFuncs->count(inst->getFunction())) {
+            continue;
+          } else if (auto si = llvm::dyn_cast<llvm::StoreInst>(user); si) {
             to_remove.emplace_back(si);
           } else if (auto ce = llvm::dyn_cast<llvm::ConstantExpr>(user); ce) {
             next_work_list.push_back(ce);
+          } else if (inst) {
+            to_undef.emplace_back(inst, val);
           }
         }
       }
@@ -920,6 +1157,15 @@ static void RemoveKilledStores(void) {
       inst->eraseFromParent();
     }
 
+    // The killer stays for the functions that are yet to be lifted, so only
+    // the streamed functions lose their references to it.
+    if (gStreamedFuncs) {
+      for (auto [inst, val] : to_undef) {
+        inst->replaceUsesOfWith(val, llvm::UndefValue::get(val->getType()));
+      }
+      return;
+    }
+
     killer->replaceAllUsesWith(llvm::UndefValue::get(killer->getType()));
     killer->eraseFromParent();
   }
@@ -1064,6 +1310,754 @@ static void MergeGEPInstructions(llvm::Function &func) {
   }
 }
 
+// Remill's vector semantics work one lane at a time: they extract each lane
+// of their sources, apply a scalar operation to it, and insert or store the
+// result back, and vector memory operands are read and written with one
+// memory intrinsic per lane. After inlining, e.g. `ADDPS` is twelve scalar
+// loads and stores of the `State` structure around four `fadd`s, and `MOVUPS`
+// to memory is four scalar stores. The helpers below rebuild such lane-wise
+// computations into single vector operations, so that the code generator
+// emits roughly one instruction per original SIMD instruction again.
+static constexpr unsigned kMaxVectorIdiomDepth = 8;
+
+// Instructions within a block are at most this far apart to be merged.
+static constexpr unsigned kMaxVectorIdiomWindow = 128;
+
+using Lanes = std::vector<llvm::Value *>;
+
+static unsigned NumLanes(llvm::Type *type) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  if (auto vec_type = llvm::dyn_cast<llvm::FixedVectorType>(type)) {
+    return vec_type->getNumElements();
+  }
+  return 0;
+#else
+  return type->isVectorTy() ? type->getVectorNumElements() : 0u;
+#endif
+}
+
+static llvm::Type *GetVectorType(llvm::Type *elem_type, unsigned num_lanes) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  return llvm::FixedVectorType::get(elem_type, num_lanes);
+#else
+  return llvm::VectorType::get(elem_type, num_lanes);
+#endif
+}
+
+// A lane-wise memory access: `size` bytes at `offset` bytes from `base`.
+struct LaneAccess {
+  llvm::Instruction *inst;
+  llvm::Value *base;
+  int64_t offset;
+  uint64_t size;
+};
+
+// Looks through constant `GEP`s as well as the `inttoptr (add base, C)`
+// address arithmetic of lowered memory accesses.
+static std::pair<llvm::Value *, int64_t> BaseAndOffset(
+    llvm::Value *ptr, const llvm::DataLayout &dl) {
+  int64_t offset = 0;
+  for (auto i = 0u; i < kMaxVectorIdiomDepth; ++i) {
+    int64_t ptr_offset = 0;
+    ptr = llvm::GetPointerBaseWithConstantOffset(ptr, ptr_offset, dl);
+    offset += ptr_offset;
+
+    auto itp = llvm::dyn_cast<llvm::IntToPtrInst>(ptr);
+    if (!itp) {
+      break;
+    }
+
+    llvm::Value *addr = itp->getOperand(0);
+    while (auto add = llvm::dyn_cast<llvm::BinaryOperator>(addr)) {
+      auto disp = llvm::dyn_cast<llvm::ConstantInt>(add->getOperand(1));
+      if (add->getOpcode() != llvm::Instruction::Add || !disp) {
+        break;
+      }
+      offset += disp->getSExtValue();
+      addr = add->getOperand(0);
+    }
+
+    if (auto pti = llvm::dyn_cast<llvm::PtrToIntInst>(addr)) {
+      ptr = pti->getOperand(0);
+    } else {
+      ptr = addr;
+      break;
+    }
+  }
+  return {ptr, offset};
+}
+
+// Returns `true` if `inst` is a simple load or store of a scalar that can be
+// a vector lane, and describes what it accesses.
+static bool GetLaneAccess(llvm::Instruction *inst, const llvm::DataLayout &dl,
+                          LaneAccess &access) {
+  llvm::Value *ptr = nullptr;
+  llvm::Type *type = nullptr;
+  if (auto load = llvm::dyn_cast<llvm::LoadInst>(inst)) {
+    if (!load->isSimple()) {
+      return false;
+    }
+    ptr = load->getPointerOperand();
+    type = load->getType();
+
+  } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(inst)) {
+    if (!store->isSimple()) {
+      return false;
+    }
+    ptr = store->getPointerOperand();
+    type = store->getValueOperand()->getType();
+
+  } else {
+    return false;
+  }
+
+  if (!llvm::VectorType::isValidElementType(type) || type->isPointerTy() ||
+      dl.getTypeStoreSize(type) != dl.getTypeAllocSize(type)) {
+    return false;
+  }
+
+  std::tie(access.base, access.offset) = BaseAndOffset(ptr, dl);
+  access.inst = inst;
+  access.size = dl.getTypeStoreSize(type);
+  return true;
+}
+
+// Two accesses are known not to overlap if they are at disjoint offsets from
+// the same base, or if one accesses the `State` structure and the other is a
+// lowered memory access.
+static bool MayOverlap(llvm::Instruction *inst, const LaneAccess &lane,
+                       const llvm::DataLayout &dl) {
+  if (!inst->mayReadOrWriteMemory()) {
+    return false;
+  }
+
+  const auto lane_scopes = lane.inst->getMetadata(
+      llvm::LLVMContext::MD_alias_scope);
+  const auto lane_noalias = lane.inst->getMetadata(
+      llvm::LLVMContext::MD_noalias);
+  if ((lane_scopes &&
+       lane_scopes == inst->getMetadata(llvm::LLVMContext::MD_noalias)) ||
+      (lane_noalias &&
+       lane_noalias == inst->getMetadata(llvm::LLVMContext::MD_alias_scope))) {
+    return false;
+  }
+
+  LaneAccess access = {};
+  if (!GetLaneAccess(inst, dl, access) || access.base != lane.base) {
+    return true;
+  }
+
+  return (access.offset + static_cast<int64_t>(access.size)) > lane.offset &&
+         (lane.offset + static_cast<int64_t>(lane.size)) > access.offset;
+}
+
+// Positions of the instructions of a block, so that lane-wise accesses can be
+// moved to one of them if nothing in between interferes.
+class BlockOrder {
+ public:
+  explicit BlockOrder(llvm::BasicBlock &block) {
+    for (auto &inst : block) {
+      insts.push_back(&inst);
+      index.emplace(&inst, index.size());
+    }
+  }
+
+  bool Contains(llvm::Instruction *inst) const {
+    return index.count(inst);
+  }
+
+  unsigned IndexOf(llvm::Instruction *inst) const {
+    return index.at(inst);
+  }
+
+  // Can `lane` move to just before the instruction at `to` without changing
+  // what it reads or writes?
+  bool CanMove(const LaneAccess &lane, unsigned to,
+               const llvm::DataLayout &dl) const {
+    const auto from = IndexOf(lane.inst);
+    const auto begin = std::min(from, to);
+    const auto end = std::max(from, to);
+    const bool is_store = llvm::isa<llvm::StoreInst>(lane.inst);
+    for (auto i = begin; i < end; ++i) {
+      const auto inst = insts[i];
+      if (inst == lane.inst) {
+        continue;
+      }
+      if (!is_store && !inst->mayWriteToMemory()) {
+        continue;
+      }
+      if (MayOverlap(inst, lane, dl)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::vector<llvm::Instruction *> insts;
+  std::unordered_map<llvm::Instruction *, unsigned> index;
+};
+
+// Keep the alias information that all of the merged lanes agree on.
+static void CopyCommonAAMetadata(llvm::Instruction *dest,
+                                 const std::vector<llvm::Instruction *> &lanes) {
+  for (auto kind : {llvm::LLVMContext::MD_tbaa,
+                    llvm::LLVMContext::MD_alias_scope,
+                    llvm::LLVMContext::MD_noalias}) {
+    auto md = lanes.front()->getMetadata(kind);
+    for (auto lane : lanes) {
+      if (lane->getMetadata(kind) != md) {
+        md = nullptr;
+        break;
+      }
+    }
+    if (md) {
+      dest->setMetadata(kind, md);
+    }
+  }
+}
+
+template <typename T>
+static unsigned AlignmentOf(T *inst, llvm::Type *type,
+                            const llvm::DataLayout &dl) {
+  const unsigned align = inst->getAlignment();
+  return align ? align : dl.getABITypeAlignment(type);
+}
+
+template <typename T>
+static void SetAlignment(T *inst, unsigned align) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  inst->setAlignment(llvm::Align(align));
+#else
+  inst->setAlignment(align);
+#endif
+}
+
+// Intrinsics that have a lane-wise vector form with the same name.
+static bool IsLaneWiseIntrinsic(llvm::Intrinsic::ID id) {
+  switch (id) {
+    case llvm::Intrinsic::fabs:
+    case llvm::Intrinsic::sqrt:
+    case llvm::Intrinsic::minnum:
+    case llvm::Intrinsic::maxnum:
+    case llvm::Intrinsic::copysign:
+    case llvm::Intrinsic::floor:
+    case llvm::Intrinsic::ceil:
+    case llvm::Intrinsic::trunc:
+    case llvm::Intrinsic::rint:
+    case llvm::Intrinsic::nearbyint:
+    case llvm::Intrinsic::round:
+    case llvm::Intrinsic::fma:
+    case llvm::Intrinsic::fmuladd:
+    case llvm::Intrinsic::ctpop:
+    case llvm::Intrinsic::bswap:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Rebuilds the scalar `lanes` as one vector value of type `vec_type`. New
+// instructions are created before `ir`'s insertion point, except for vector
+// loads, and are recorded in `created` so that a failed attempt can be
+// undone.
+class VectorBuilder {
+ public:
+  VectorBuilder(llvm::Instruction *insert_pt, const BlockOrder &order_,
+                const llvm::DataLayout &dl_)
+      : ir(insert_pt),
+        order(order_),
+        dl(dl_) {}
+
+  llvm::Value *Build(const Lanes &lanes, llvm::Type *vec_type,
+                     unsigned depth = 0) {
+    if (depth > kMaxVectorIdiomDepth) {
+      return nullptr;
+    }
+
+    const auto num_lanes = NumLanes(vec_type);
+    const auto elem_type = vec_type->getScalarType();
+    if (!num_lanes || num_lanes != lanes.size()) {
+      return nullptr;
+    }
+    for (auto lane : lanes) {
+      if (lane->getType() != elem_type) {
+        return nullptr;
+      }
+    }
+
+    std::vector<llvm::Constant *> consts;
+    for (auto lane : lanes) {
+      if (auto c = llvm::dyn_cast<llvm::Constant>(lane)) {
+        consts.push_back(c);
+      }
+    }
+    if (consts.size() == num_lanes) {
+      return llvm::ConstantVector::get(consts);
+    }
+
+    if (auto vec = BuildShuffle(lanes, vec_type)) {
+      return vec;
+    }
+
+    const auto first = llvm::dyn_cast<llvm::Instruction>(lanes.front());
+    if (!first) {
+      return nullptr;
+    }
+    if (std::all_of(lanes.begin(), lanes.end(),
+                    [=] (llvm::Value *lane) { return lane == first; })) {
+      return Record(ir.CreateVectorSplat(num_lanes, first));
+    }
+    for (auto lane : lanes) {
+      auto inst = llvm::dyn_cast<llvm::Instruction>(lane);
+      if (!inst || inst->getOpcode() != first->getOpcode()) {
+        return nullptr;
+      }
+    }
+
+    // Lanes that feed more than one operation, e.g. the compare and select
+    // of `MAXPS`, are only vectorized once.
+    auto &vec = built[lanes];
+    if (!vec) {
+      vec = BuildOp(first, lanes, vec_type, depth);
+    }
+    return vec;
+  }
+
+  // Undo a failed attempt.
+  void EraseCreated(void) {
+    built.clear();
+    while (!created.empty()) {
+      created.back()->eraseFromParent();
+      created.pop_back();
+    }
+  }
+
+ private:
+  llvm::Value *BuildOp(llvm::Instruction *first, const Lanes &lanes,
+                       llvm::Type *vec_type, unsigned depth) {
+    const auto num_lanes = NumLanes(vec_type);
+
+    if (llvm::isa<llvm::LoadInst>(first)) {
+      return BuildLoad(lanes, vec_type);
+
+    } else if (llvm::isa<llvm::BinaryOperator>(first)) {
+      auto lhs = Build(Operands(lanes, 0), vec_type, depth + 1);
+      auto rhs = lhs ? Build(Operands(lanes, 1), vec_type, depth + 1) : nullptr;
+      if (!rhs) {
+        return nullptr;
+      }
+      auto opcode = llvm::cast<llvm::BinaryOperator>(first)->getOpcode();
+      return WithFlags(ir.CreateBinOp(opcode, lhs, rhs), lanes);
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(9, 0)
+    } else if (llvm::isa<llvm::UnaryOperator>(first)) {
+      auto op = Build(Operands(lanes, 0), vec_type, depth + 1);
+      if (!op) {
+        return nullptr;
+      }
+      auto opcode = llvm::cast<llvm::UnaryOperator>(first)->getOpcode();
+      return WithFlags(ir.CreateUnOp(opcode, op), lanes);
+#endif
+
+    } else if (auto cast = llvm::dyn_cast<llvm::CastInst>(first)) {
+      auto src_type = cast->getSrcTy();
+      if (!llvm::VectorType::isValidElementType(src_type) ||
+          !SameOperandTypes(lanes, 0)) {
+        return nullptr;
+      }
+      auto op = Build(Operands(lanes, 0), GetVectorType(src_type, num_lanes),
+                      depth + 1);
+      if (!op) {
+        return nullptr;
+      }
+      return WithFlags(ir.CreateCast(cast->getOpcode(), op, vec_type), lanes);
+
+    } else if (auto cmp = llvm::dyn_cast<llvm::CmpInst>(first)) {
+      auto op_type = cmp->getOperand(0)->getType();
+      if (!llvm::VectorType::isValidElementType(op_type) ||
+          !SameOperandTypes(lanes, 0)) {
+        return nullptr;
+      }
+      for (auto lane : lanes) {
+        if (llvm::cast<llvm::CmpInst>(lane)->getPredicate() !=
+            cmp->getPredicate()) {
+          return nullptr;
+        }
+      }
+      auto op_vec_type = GetVectorType(op_type, num_lanes);
+      auto lhs = Build(Operands(lanes, 0), op_vec_type, depth + 1);
+      auto rhs = lhs ? Build(Operands(lanes, 1), op_vec_type, depth + 1)
+                     : nullptr;
+      if (!rhs) {
+        return nullptr;
+      }
+      return WithFlags(cmp->isFPPredicate() ?
+                       ir.CreateFCmp(cmp->getPredicate(), lhs, rhs) :
+                       ir.CreateICmp(cmp->getPredicate(), lhs, rhs), lanes);
+
+    } else if (llvm::isa<llvm::SelectInst>(first)) {
+      auto cond = Build(Operands(lanes, 0),
+                        GetVectorType(ir.getInt1Ty(), num_lanes), depth + 1);
+      auto if_true = cond ? Build(Operands(lanes, 1), vec_type, depth + 1)
+                          : nullptr;
+      auto if_false = if_true ? Build(Operands(lanes, 2), vec_type, depth + 1)
+                              : nullptr;
+      if (!if_false) {
+        return nullptr;
+      }
+      return WithFlags(ir.CreateSelect(cond, if_true, if_false), lanes);
+
+    } else if (auto call = llvm::dyn_cast<llvm::IntrinsicInst>(first)) {
+      const auto id = call->getIntrinsicID();
+      if (!IsLaneWiseIntrinsic(id)) {
+        return nullptr;
+      }
+      for (auto lane : lanes) {
+        auto lane_call = llvm::dyn_cast<llvm::IntrinsicInst>(lane);
+        if (!lane_call || lane_call->getIntrinsicID() != id) {
+          return nullptr;
+        }
+      }
+      std::vector<llvm::Value *> args;
+      for (auto i = 0u; i < call->arg_size(); ++i) {
+        auto arg = Build(Operands(lanes, i), vec_type, depth + 1);
+        if (!arg) {
+          return nullptr;
+        }
+        args.push_back(arg);
+      }
+      auto intrinsic = llvm::Intrinsic::getDeclaration(
+          gModule.get(), id, vec_type);
+      return WithFlags(ir.CreateCall(intrinsic, args), lanes);
+    }
+
+    return nullptr;
+  }
+
+  llvm::Value *Record(llvm::Value *val) {
+    if (auto inst = llvm::dyn_cast<llvm::Instruction>(val)) {
+      created.push_back(inst);
+    }
+    return val;
+  }
+
+  // Keep the wrapping and fast-math flags that all lanes agree on.
+  llvm::Value *WithFlags(llvm::Value *val, const Lanes &lanes) {
+    if (auto inst = llvm::dyn_cast<llvm::Instruction>(val)) {
+      inst->copyIRFlags(lanes.front());
+      for (auto lane : lanes) {
+        inst->andIRFlags(lane);
+      }
+    }
+    return Record(val);
+  }
+
+  static Lanes Operands(const Lanes &lanes, unsigned i) {
+    Lanes ops;
+    for (auto lane : lanes) {
+      ops.push_back(llvm::cast<llvm::User>(lane)->getOperand(i));
+    }
+    return ops;
+  }
+
+  static bool SameOperandTypes(const Lanes &lanes, unsigned i) {
+    const auto type = llvm::cast<llvm::User>(lanes.front())->getOperand(i)->getType();
+    for (auto lane : lanes) {
+      if (llvm::cast<llvm::User>(lane)->getOperand(i)->getType() != type) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Lanes extracted from at most two vectors of the same type as the result
+  // are a shuffle, or just the source vector itself.
+  llvm::Value *BuildShuffle(const Lanes &lanes, llvm::Type *vec_type) {
+    llvm::Value *srcs[2] = {nullptr, nullptr};
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+    std::vector<int> mask;
+#else
+    std::vector<uint32_t> mask;
+#endif
+    for (auto lane : lanes) {
+      auto extract = llvm::dyn_cast<llvm::ExtractElementInst>(lane);
+      if (!extract || extract->getVectorOperandType() != vec_type) {
+        return nullptr;
+      }
+      auto index = llvm::dyn_cast<llvm::ConstantInt>(extract->getIndexOperand());
+      if (!index || index->getZExtValue() >= lanes.size()) {
+        return nullptr;
+      }
+      auto src = extract->getVectorOperand();
+      auto src_num = 0u;
+      if (!srcs[0] || srcs[0] == src) {
+        srcs[0] = src;
+      } else if (!srcs[1] || srcs[1] == src) {
+        srcs[1] = src;
+        src_num = 1;
+      } else {
+        return nullptr;
+      }
+      mask.push_back(src_num * lanes.size() + index->getZExtValue());
+    }
+
+    auto is_identity = !srcs[1];
+    for (auto i = 0u; is_identity && i < mask.size(); ++i) {
+      is_identity = static_cast<unsigned>(mask[i]) == i;
+    }
+    if (is_identity) {
+      return srcs[0];
+    }
+    if (!srcs[1]) {
+      srcs[1] = llvm::UndefValue::get(vec_type);
+    }
+    return Record(ir.CreateShuffleVector(srcs[0], srcs[1], mask));
+  }
+
+  // Loads of consecutive lanes become one vector load at the position of the
+  // first of them.
+  llvm::Value *BuildLoad(const Lanes &lanes, llvm::Type *vec_type) {
+    std::vector<llvm::Instruction *> loads;
+    std::vector<LaneAccess> accesses;
+    for (auto lane : lanes) {
+      auto load = llvm::cast<llvm::LoadInst>(lane);
+      LaneAccess access = {};
+      if (!order.Contains(load) || !GetLaneAccess(load, dl, access)) {
+        return nullptr;
+      }
+      if (!accesses.empty() &&
+          (access.base != accesses[0].base ||
+           access.offset != accesses[0].offset +
+               static_cast<int64_t>(accesses.size() * access.size))) {
+        return nullptr;
+      }
+      loads.push_back(load);
+      accesses.push_back(access);
+    }
+
+    auto first_load = *std::min_element(
+        loads.begin(), loads.end(),
+        [this] (llvm::Instruction *a, llvm::Instruction *b) {
+          return order.IndexOf(a) < order.IndexOf(b);
+        });
+    const auto to = order.IndexOf(first_load);
+    for (const auto &access : accesses) {
+      if (!order.CanMove(access, to, dl)) {
+        return nullptr;
+      }
+    }
+
+    // The pointer to the first lane must be available at `first_load`.
+    auto lane0 = llvm::cast<llvm::LoadInst>(loads[0]);
+    auto ptr = lane0->getPointerOperand();
+    if (auto ptr_inst = llvm::dyn_cast<llvm::Instruction>(ptr);
+        ptr_inst && ptr_inst->getParent() == first_load->getParent() &&
+        (!order.Contains(ptr_inst) || order.IndexOf(ptr_inst) >= to)) {
+      return nullptr;
+    }
+
+    llvm::IRBuilder<> load_ir(first_load);
+    auto vec_ptr = Record(load_ir.CreateBitCast(
+        ptr, llvm::PointerType::get(
+            vec_type, ptr->getType()->getPointerAddressSpace())));
+    auto vec_load = load_ir.CreateLoad(vec_type, vec_ptr);
+    SetAlignment(vec_load, AlignmentOf(lane0, lane0->getType(), dl));
+    CopyCommonAAMetadata(vec_load, loads);
+    return Record(vec_load);
+  }
+
+  llvm::IRBuilder<> ir;
+  const BlockOrder &order;
+  const llvm::DataLayout &dl;
+  std::vector<llvm::Instruction *> created;
+  std::map<Lanes, llvm::Value *> built;
+};
+
+// Replace complete `insertelement` chains whose lanes are computed lane-wise
+// with the vector operation.
+static bool RecoverVectorInserts(llvm::BasicBlock &block,
+                                 const llvm::DataLayout &dl) {
+  std::vector<llvm::InsertElementInst *> roots;
+  for (auto &inst : block) {
+    auto insert = llvm::dyn_cast<llvm::InsertElementInst>(&inst);
+    if (!insert || !NumLanes(insert->getType())) {
+      continue;
+    }
+    if (insert->hasOneUse()) {
+      auto user = llvm::dyn_cast<llvm::InsertElementInst>(
+          *insert->user_begin());
+      if (user && user->getOperand(0) == insert) {
+        continue;
+      }
+    }
+    roots.push_back(insert);
+  }
+
+  auto changed = false;
+  BlockOrder order(block);
+  for (auto root : roots) {
+    const auto num_lanes = NumLanes(root->getType());
+    Lanes lanes(num_lanes, nullptr);
+    auto num_set = 0u;
+    llvm::Value *vec = root;
+    while (auto insert = llvm::dyn_cast<llvm::InsertElementInst>(vec)) {
+      auto index = llvm::dyn_cast<llvm::ConstantInt>(insert->getOperand(2));
+      if (!index || index->getZExtValue() >= num_lanes) {
+        break;
+      }
+      auto &lane = lanes[index->getZExtValue()];
+      if (!lane) {
+        lane = insert->getOperand(1);
+        ++num_set;
+      }
+      vec = insert->getOperand(0);
+    }
+    if (num_set != num_lanes ||
+        std::all_of(lanes.begin(), lanes.end(), [] (llvm::Value *lane) {
+          return llvm::isa<llvm::Constant>(lane);
+        })) {
+      continue;
+    }
+
+    VectorBuilder builder(root, order, dl);
+    if (auto new_vec = builder.Build(lanes, root->getType())) {
+      root->replaceAllUsesWith(new_vec);
+      changed = true;
+    } else {
+      builder.EraseCreated();
+    }
+  }
+  return changed;
+}
+
+// Replace stores of consecutive lanes with one vector store at the position
+// of the last of them.
+static bool RecoverVectorStores(llvm::BasicBlock &block,
+                                const llvm::DataLayout &dl) {
+  std::vector<LaneAccess> stores;
+  for (auto &inst : block) {
+    LaneAccess access = {};
+    if (llvm::isa<llvm::StoreInst>(inst) && GetLaneAccess(&inst, dl, access)) {
+      stores.push_back(access);
+    }
+  }
+
+  auto changed = false;
+  std::unordered_set<llvm::Instruction *> merged;
+  std::unique_ptr<BlockOrder> order(new BlockOrder(block));
+
+  // How far apart `a` and `b` are in the block.
+  auto distance = [&] (llvm::Instruction *a, llvm::Instruction *b) {
+    const auto a_index = order->IndexOf(a);
+    const auto b_index = order->IndexOf(b);
+    return std::max(a_index, b_index) - std::min(a_index, b_index);
+  };
+
+  for (const auto &lane0 : stores) {
+    if (merged.count(lane0.inst)) {
+      continue;
+    }
+
+    const auto elem_type = llvm::cast<llvm::StoreInst>(lane0.inst)
+        ->getValueOperand()->getType();
+    const auto lane_size = static_cast<int64_t>(lane0.size);
+
+    // Try the widest vectors first, as in 256-bit AVX registers.
+    for (auto vec_size : {32, 16}) {
+      const auto num_lanes = vec_size / lane_size;
+      if (num_lanes < 2 || vec_size % lane_size) {
+        continue;
+      }
+
+      // If a lane is stored more than once, then take the store nearest to
+      // `lane0`.
+      std::vector<const LaneAccess *> lane_stores(num_lanes, nullptr);
+      lane_stores[0] = &lane0;
+      for (const auto &store : stores) {
+        const auto lane = (store.offset - lane0.offset) / lane_size;
+        if (merged.count(store.inst) || store.base != lane0.base ||
+            store.size != lane0.size || lane <= 0 || lane >= num_lanes ||
+            (store.offset - lane0.offset) % lane_size ||
+            distance(store.inst, lane0.inst) > kMaxVectorIdiomWindow ||
+            llvm::cast<llvm::StoreInst>(store.inst)
+                ->getValueOperand()->getType() != elem_type) {
+          continue;
+        }
+        auto &lane_store = lane_stores[lane];
+        if (!lane_store || distance(store.inst, lane0.inst) <
+                           distance(lane_store->inst, lane0.inst)) {
+          lane_store = &store;
+        }
+      }
+      if (std::find(lane_stores.begin(), lane_stores.end(), nullptr) !=
+          lane_stores.end()) {
+        continue;
+      }
+
+      llvm::Instruction *last_store = lane0.inst;
+      for (auto store : lane_stores) {
+        if (order->IndexOf(store->inst) > order->IndexOf(last_store)) {
+          last_store = store->inst;
+        }
+      }
+      const auto to = order->IndexOf(last_store);
+      if (!std::all_of(lane_stores.begin(), lane_stores.end(),
+                       [&] (const LaneAccess *store) {
+                         return order->CanMove(*store, to, dl);
+                       })) {
+        continue;
+      }
+
+      Lanes vals;
+      std::vector<llvm::Instruction *> insts;
+      for (auto store : lane_stores) {
+        vals.push_back(llvm::cast<llvm::StoreInst>(store->inst)
+            ->getValueOperand());
+        insts.push_back(store->inst);
+      }
+
+      const auto vec_type = GetVectorType(
+          elem_type, static_cast<unsigned>(num_lanes));
+      VectorBuilder builder(last_store, *order, dl);
+      auto vec = builder.Build(vals, vec_type);
+      if (!vec) {
+        builder.EraseCreated();
+        continue;
+      }
+
+      auto lane0_store = llvm::cast<llvm::StoreInst>(lane0.inst);
+      auto ptr = lane0_store->getPointerOperand();
+      llvm::IRBuilder<> ir(last_store);
+      auto vec_store = ir.CreateStore(vec, ir.CreateBitCast(
+          ptr, llvm::PointerType::get(
+              vec_type, ptr->getType()->getPointerAddressSpace())));
+      SetAlignment(vec_store, AlignmentOf(lane0_store, elem_type, dl));
+      CopyCommonAAMetadata(vec_store, insts);
+
+      for (auto inst : insts) {
+        merged.insert(inst);
+        inst->eraseFromParent();
+      }
+      order.reset(new BlockOrder(block));
+      changed = true;
+      break;
+    }
+  }
+  return changed;
+}
+
+static void RecoverVectorIdioms(llvm::Function &func) {
+  if (!FLAGS_recover_vector_ops || func.isDeclaration()) {
+    return;
+  }
+  const auto &dl = gModule->getDataLayout();
+  for (auto &block : func) {
+    RecoverVectorInserts(block, dl);
+    RecoverVectorStores(block, dl);
+  }
+}
+
 // Lower cross-references, and try to fixup pointers.
 static void LowerXrefs(const NativeModule *cfg_module) {
   std::vector<llvm::Constant *> work_list;
@@ -1409,7 +2403,7 @@ static llvm::Value *TryGetRegAlias(llvm::Value *ptr, unsigned offset) {
       elem_type, ptr_type->getPointerAddressSpace(),
       llvm::GlobalValue::PrivateLinkage, alias_name, ptr_const,
       gModule.get());
-  alias->setThreadLocalMode(llvm::GlobalValue::InitialExecTLSModel);
+  alias->setThreadLocalMode(LiftedThreadLocalMode());
   return alias;
 }
 
@@ -1565,6 +2559,473 @@ static void GlobalizeStateStructures(void) {
   }
 }
 
+// Load the register named `reg_name` from the state structure.
+static llvm::Value *LoadReg(llvm::IRBuilder<> &ir, llvm::Value *state_ptr,
+                            const char *reg_name) {
+  const auto reg = gArch->RegisterByName(reg_name);
+  CHECK(reg != nullptr)
+      << "Unable to find register " << reg_name;
+  auto ptr = remill::BuildPointerToOffset(
+      ir, state_ptr, reg->offset, llvm::PointerType::get(reg->type, 0));
+  return ir.CreateLoad(ptr);
+}
+
+// Store `val` into the register named `reg_name` in the state structure,
+// zero-extending it if necessary.
+static void StoreReg(llvm::IRBuilder<> &ir, llvm::Value *state_ptr,
+                     const char *reg_name, llvm::Value *val) {
+  const auto reg = gArch->RegisterByName(reg_name);
+  CHECK(reg != nullptr)
+      << "Unable to find register " << reg_name;
+  auto ptr = remill::BuildPointerToOffset(
+      ir, state_ptr, reg->offset, llvm::PointerType::get(reg->type, 0));
+  ir.CreateStore(ir.CreateZExtOrTrunc(val, reg->type), ptr);
+}
+
+// Lower calls to `__remill_sync_hyper_call` for CPUID, RDTSC, and RDTSCP into
+// inline assembly. The runtime implementation of the hyper call takes the
+// whole `State` structure by reference, which forces every register to be
+// spilled before the call and reloaded after. The inline assembly only reads
+// and writes the registers that the instruction actually uses.
+static void LowerSyncHyperCalls(void) {
+  switch (gArch->arch_name) {
+    case remill::kArchX86:
+    case remill::kArchX86_AVX:
+    case remill::kArchX86_AVX512:
+    case remill::kArchAMD64:
+    case remill::kArchAMD64_AVX:
+    case remill::kArchAMD64_AVX512:
+      break;
+    default:
+      return;
+  }
+
+  auto hyper_call = gModule->getFunction("__remill_sync_hyper_call");
+  if (!hyper_call) {
+    return;
+  }
+
+  const auto is_64 = 64 == gArch->address_size;
+  const auto i32_type = llvm::Type::getInt32Ty(*gContext);
+
+  auto num_lowered = 0u;
+  for (auto call : remill::CallersOf(hyper_call)) {
+    auto name = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(2));
+    if (!name) {
+      continue;
+    }
+
+    auto state_ptr = call->getArgOperand(0);
+    auto mem_ptr = call->getArgOperand(1);
+    llvm::IRBuilder<> ir(call);
+
+    switch (name->getZExtValue()) {
+      case SyncHyperCall::kX86CPUID: {
+        llvm::Value *args[] = {
+            LoadReg(ir, state_ptr, "EAX"), LoadReg(ir, state_ptr, "EBX"),
+            LoadReg(ir, state_ptr, "ECX"), LoadReg(ir, state_ptr, "EDX")};
+        llvm::Type *arg_types[] = {i32_type, i32_type, i32_type, i32_type};
+        auto ret_type = llvm::StructType::get(*gContext, arg_types);
+        auto asm_func = llvm::InlineAsm::get(
+            llvm::FunctionType::get(ret_type, arg_types, false), "cpuid",
+            "={ax},={bx},={cx},={dx},0,1,2,3", !FLAGS_cache_cpuid);
+        auto res = ir.CreateCall(asm_func, args);
+        if (FLAGS_cache_cpuid) {
+          res->setDoesNotAccessMemory();
+        }
+        StoreReg(ir, state_ptr, is_64 ? "RAX" : "EAX", ir.CreateExtractValue(res, 0));
+        StoreReg(ir, state_ptr, is_64 ? "RBX" : "EBX", ir.CreateExtractValue(res, 1));
+        StoreReg(ir, state_ptr, is_64 ? "RCX" : "ECX", ir.CreateExtractValue(res, 2));
+        StoreReg(ir, state_ptr, is_64 ? "RDX" : "EDX", ir.CreateExtractValue(res, 3));
+        break;
+      }
+
+      case SyncHyperCall::kX86ReadTSC: {
+        llvm::Type *ret_types[] = {i32_type, i32_type};
+        auto ret_type = llvm::StructType::get(*gContext, ret_types);
+        auto asm_func = llvm::InlineAsm::get(
+            llvm::FunctionType::get(ret_type, false), "rdtsc",
+            "={ax},={dx}", true);
+        auto res = ir.CreateCall(asm_func);
+        StoreReg(ir, state_ptr, is_64 ? "RAX" : "EAX", ir.CreateExtractValue(res, 0));
+        StoreReg(ir, state_ptr, is_64 ? "RDX" : "EDX", ir.CreateExtractValue(res, 1));
+        break;
+      }
+
+      case SyncHyperCall::kX86ReadTSCP: {
+        llvm::Type *ret_types[] = {i32_type, i32_type, i32_type};
+        auto ret_type = llvm::StructType::get(*gContext, ret_types);
+        auto asm_func = llvm::InlineAsm::get(
+            llvm::FunctionType::get(ret_type, false), "rdtscp",
+            "={ax},={cx},={dx}", true);
+        auto res = ir.CreateCall(asm_func);
+        StoreReg(ir, state_ptr, is_64 ? "RAX" : "EAX", ir.CreateExtractValue(res, 0));
+        StoreReg(ir, state_ptr, is_64 ? "RCX" : "ECX", ir.CreateExtractValue(res, 1));
+        StoreReg(ir, state_ptr, is_64 ? "RDX" : "EDX", ir.CreateExtractValue(res, 2));
+        break;
+      }
+
+      default:
+        continue;
+    }
+
+    call->replaceAllUsesWith(mem_ptr);
+    call->eraseFromParent();
+    ++num_lowered;
+  }
+
+  LOG_IF(INFO, num_lowered)
+      << "Lowered " << num_lowered << " synchronous hyper calls";
+}
+
+enum class StringOp { kMove, kStore };
+
+struct StringOpISel {
+  const char *name;
+  StringOp op;
+  unsigned elem_size;
+};
+
+static const StringOpISel kStringOpISels[] = {
+    {"REP_MOVSB", StringOp::kMove, 1}, {"REP_MOVSW", StringOp::kMove, 2},
+    {"REP_MOVSD", StringOp::kMove, 4}, {"REP_MOVSQ", StringOp::kMove, 8},
+    {"REP_STOSB", StringOp::kStore, 1}, {"REP_STOSW", StringOp::kStore, 2},
+    {"REP_STOSD", StringOp::kStore, 4}, {"REP_STOSQ", StringOp::kStore, 8},
+};
+
+static llvm::Function *GetStringOpIntrinsic(const char *name,
+                                            llvm::Type *ret_type,
+                                            llvm::Type *mem_ptr_type,
+                                            llvm::Type *arg_type) {
+  if (auto func = gModule->getFunction(name)) {
+    return func;
+  }
+  const auto addr_type = llvm::Type::getIntNTy(
+      *gContext, gArch->address_size);
+  llvm::Type *arg_types[] = {mem_ptr_type, addr_type, arg_type, addr_type};
+  return llvm::Function::Create(
+      llvm::FunctionType::get(ret_type, arg_types, false),
+      llvm::GlobalValue::ExternalLinkage, name, gModule.get());
+}
+
+// Remill's semantics for `REP MOVS` and `REP STOS` are loops that handle one
+// element per iteration, and update the count, source and destination
+// registers each time around. Give each of them a fast path that does the
+// whole operation with one bulk memory operation, and then sets the
+// registers to their final values. The fast paths only cover the forward
+// direction (`DF` clear), copies whose destination doesn't start inside of
+// the source (where the byte-wise semantics replicate a pattern), and fills
+// with a value whose bytes are all the same. Anything else takes the original
+// loop. `REPE CMPS` has no fast path: it stops at the first difference, and
+// so may legitimately be given a count that runs past the end of the memory
+// that the program owns, which a bulk comparison would read.
+static void SplitStringOps(void) {
+  if (!FLAGS_string_op_fast_paths || FLAGS_keep_memops) {
+    return;
+  }
+
+  switch (gArch->arch_name) {
+    case remill::kArchX86:
+    case remill::kArchX86_AVX:
+    case remill::kArchX86_AVX512:
+    case remill::kArchAMD64:
+    case remill::kArchAMD64_AVX:
+    case remill::kArchAMD64_AVX512:
+      break;
+    default:
+      return;
+  }
+
+  std::unordered_map<std::string, llvm::Function *> sems;
+  remill::ForEachISel(
+      gModule.get(), [&](llvm::GlobalVariable *isel, llvm::Function *sem) {
+        llvm::StringRef name = isel->getName();
+        if (name.startswith("ISEL_")) {
+          name = name.drop_front(5);
+        }
+        if (sem) {
+          sems[name.str()] = sem;
+        }
+      });
+
+  const auto is_64 = 64 == gArch->address_size;
+  const auto addr_type = llvm::Type::getIntNTy(*gContext, gArch->address_size);
+  const auto i8_type = llvm::Type::getInt8Ty(*gContext);
+
+  auto num_split = 0u;
+  for (const auto &isel : kStringOpISels) {
+    auto sem_it = sems.find(isel.name);
+    if (sem_it == sems.end()) {
+      continue;
+    }
+
+    for (auto call : LowerableCallersOf(sem_it->second)) {
+      auto func = call->getFunction();
+      if (func == sem_it->second) {
+        continue;
+      }
+
+      // Semantics functions take the memory and state pointers first.
+      auto mem_ptr = call->getArgOperand(0);
+      auto state_ptr = call->getArgOperand(1);
+      const auto mem_ptr_type = mem_ptr->getType();
+
+      auto block = call->getParent();
+      auto join_block = block->splitBasicBlock(call, "string_op.join");
+      auto slow_block = llvm::BasicBlock::Create(
+          *gContext, "string_op.slow", func, join_block);
+      auto fast_block = llvm::BasicBlock::Create(
+          *gContext, "string_op.fast", func, slow_block);
+      block->getTerminator()->eraseFromParent();
+
+      llvm::IRBuilder<> ir(block);
+      auto count = LoadReg(ir, state_ptr, is_64 ? "RCX" : "ECX");
+      auto src = LoadReg(ir, state_ptr, is_64 ? "RSI" : "ESI");
+      auto dst = LoadReg(ir, state_ptr, is_64 ? "RDI" : "EDI");
+      auto df = LoadReg(ir, state_ptr, "DF");
+
+      // The element count must not overflow when scaled into bytes.
+      const auto elem_size = llvm::ConstantInt::get(addr_type, isel.elem_size);
+      auto size = ir.CreateMul(count, elem_size);
+      auto is_fast = ir.CreateAnd(
+          ir.CreateICmpEQ(df, llvm::Constant::getNullValue(df->getType())),
+          ir.CreateICmpULE(count, llvm::ConstantInt::get(
+              addr_type,
+              llvm::APInt::getMaxValue(gArch->address_size).udiv(
+                  isel.elem_size))));
+
+      llvm::IRBuilder<> fast_ir(fast_block);
+      llvm::Value *new_mem_ptr = mem_ptr;
+      switch (isel.op) {
+        case StringOp::kMove: {
+          // A destination below the source, or past its end, gets the same
+          // bytes from `memmove` as from the forward element-wise copy.
+          is_fast = ir.CreateAnd(
+              is_fast, ir.CreateICmpUGE(ir.CreateSub(dst, src), size));
+          auto memmove_func = GetStringOpIntrinsic(
+              kStringMemMove, mem_ptr_type, mem_ptr_type, addr_type);
+          new_mem_ptr = fast_ir.CreateCall(
+              memmove_func, {mem_ptr, dst, src, size});
+          break;
+        }
+
+        case StringOp::kStore: {
+          const char *val_regs[] = {"AL", "AX", nullptr, "EAX", nullptr,
+                                    nullptr, nullptr, "RAX"};
+          auto val = LoadReg(ir, state_ptr, val_regs[isel.elem_size - 1]);
+          auto byte = ir.CreateTrunc(val, i8_type);
+          auto splat = ir.CreateMul(
+              ir.CreateZExt(byte, val->getType()),
+              llvm::ConstantInt::get(
+                  val->getType(),
+                  llvm::APInt::getSplat(isel.elem_size * 8,
+                                        llvm::APInt(8, 1))));
+          is_fast = ir.CreateAnd(is_fast, ir.CreateICmpEQ(val, splat));
+          auto memset_func = GetStringOpIntrinsic(
+              kStringMemSet, mem_ptr_type, mem_ptr_type, i8_type);
+          new_mem_ptr = fast_ir.CreateCall(
+              memset_func, {mem_ptr, dst, byte, size});
+          break;
+        }
+      }
+      ir.CreateCondBr(is_fast, fast_block, slow_block);
+
+      if (isel.op != StringOp::kStore) {
+        StoreReg(fast_ir, state_ptr, is_64 ? "RSI" : "ESI",
+                 fast_ir.CreateAdd(src, size));
+      }
+      StoreReg(fast_ir, state_ptr, is_64 ? "RDI" : "EDI",
+               fast_ir.CreateAdd(dst, size));
+      StoreReg(fast_ir, state_ptr, is_64 ? "RCX" : "ECX",
+               llvm::Constant::getNullValue(addr_type));
+      fast_ir.CreateBr(join_block);
+
+      call->removeFromParent();
+      slow_block->getInstList().push_back(call);
+      llvm::BranchInst::Create(join_block, slow_block);
+
+      auto phi = llvm::PHINode::Create(mem_ptr_type, 2, "",
+                                       &(join_block->front()));
+      call->replaceAllUsesWith(phi);
+      phi->addIncoming(new_mem_ptr, fast_block);
+      phi->addIncoming(call, slow_block);
+      ++num_split;
+    }
+  }
+
+  LOG_IF(INFO, num_split)
+      << "Added bulk memory fast paths to " << num_split
+      << " REP string instructions";
+}
+
+// Remill semantics materialize every flag as a zero-extended `i8` that is
+// stored into the `State` structure, and later reloaded and compared against
+// zero by whatever consumes it. Once the state has been split into scalars,
+// instruction combining turns those `zext`/`icmp ne 0` pairs back into the
+// original `i1` conditions, and jump threading merges successive branches on
+// the same condition, e.g. a `jcc` following a `setcc`.
+static void MinimizeFlagExpressions(void) {
+  llvm::legacy::FunctionPassManager pm(gModule.get());
+  pm.add(llvm::createSROAPass());
+  pm.add(llvm::createPromoteMemoryToRegisterPass());
+  pm.add(llvm::createInstructionCombiningPass());
+  pm.add(llvm::createCorrelatedValuePropagationPass());
+  pm.add(llvm::createJumpThreadingPass());
+  pm.add(llvm::createInstructionCombiningPass());
+  pm.add(llvm::createAggressiveDCEPass());
+  pm.add(llvm::createCFGSimplificationPass());
+  pm.doInitialization();
+  for (auto &func : *gModule) {
+    if (!gStreamedFuncs || gStreamedFuncs->count(&func)) {
+      pm.run(func);
+    }
+  }
+  pm.doFinalization();
+}
+
+// Inline the always-inline and internal functions that the functions in
+// `funcs` call, e.g. the memory intrinsics linked in by `LinkMemOpsRuntime`.
+// The internal ones are only defined in the module, so a shard couldn't
+// reference them. Unlike the module-wide inliner, this leaves the rest of the
+// module, and calls between lifted functions, alone.
+static void InlineIntoStreamedFunctions(
+    const std::unordered_set<llvm::Function *> &funcs) {
+  std::vector<llvm::CallInst *> calls;
+  for (auto func : funcs) {
+    for (auto &block : *func) {
+      for (auto &inst : block) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+          calls.push_back(call);
+        }
+      }
+    }
+  }
+
+  while (!calls.empty()) {
+    auto call = calls.back();
+    calls.pop_back();
+    auto callee = call->getCalledFunction();
+    if (!callee || callee->isDeclaration() || funcs.count(callee) ||
+        callee == call->getFunction() ||
+        !(callee->hasFnAttribute(llvm::Attribute::AlwaysInline) ||
+          callee->hasLocalLinkage())) {
+      continue;
+    }
+
+    llvm::InlineFunctionInfo info;
+    if (llvm::InlineFunction(call, info)) {
+      for (auto &inlined_call : info.InlinedCalls) {
+        if (auto new_call = llvm::dyn_cast_or_null<llvm::CallInst>(
+                static_cast<llvm::Value *>(inlined_call))) {
+          calls.push_back(new_call);
+        }
+      }
+    }
+  }
+}
+
+// The scalar optimizations that are applied to lifted functions after their
+// semantics have been inlined.
+static void AddScalarOptimizationPasses(
+    llvm::legacy::FunctionPassManager &pm) {
+
+//    pm.add(llvm::createGVNHoistPass());
+//    pm.add(llvm::createGVNSinkPass());
+//    pm.add(llvm::createMergedLoadStoreMotionPass());
+
+  // Makes the `State` alias scopes of lowered memory accesses visible to
+  // the passes below.
+  pm.add(llvm::createScopedNoAliasAAWrapperPass());
+
+  pm.add(llvm::createEarlyCSEPass(true));
+  pm.add(llvm::createDeadCodeEliminationPass());
+  pm.add(llvm::createConstantPropagationPass());
+  pm.add(llvm::createSinkingPass());
+  pm.add(llvm::createNewGVNPass());
+  pm.add(llvm::createLICMPass());
+  pm.add(llvm::createSCCPPass());
+  pm.add(llvm::createDeadStoreEliminationPass());
+  pm.add(llvm::createSROAPass());
+  pm.add(llvm::createPromoteMemoryToRegisterPass());
+  pm.add(llvm::createBitTrackingDCEPass());
+  pm.add(llvm::createCFGSimplificationPass());
+  pm.add(llvm::createSinkingPass());
+  pm.add(llvm::createCFGSimplificationPass());
+}
+
+// Link in the always-inline definitions of the memory intrinsics from
+// `--memops_runtime`, so that the inliner can turn calls to them into direct
+// loads and stores.
+static void LinkMemOpsRuntime(void) {
+  static bool linked = false;
+  if (linked || !FLAGS_keep_memops || FLAGS_memops_runtime.empty()) {
+    return;
+  }
+
+  linked = true;
+
+  auto runtime = remill::LoadModuleFromFile(
+      gContext.get(), FLAGS_memops_runtime, true);
+  LOG_IF(FATAL, !runtime)
+      << "Could not load memory intrinsics runtime " << FLAGS_memops_runtime;
+
+  gArch->PrepareModuleDataLayout(runtime);
+
+  // Don't replace the intrinsics that are already defined, e.g. those that
+  // are instrumented.
+  auto num_inlinable = 0u;
+  std::vector<std::string> names;
+  for (auto &func : *runtime) {
+    if (func.isDeclaration()) {
+      continue;
+    }
+
+    auto name = func.getName().str();
+    auto existing_func = gModule->getFunction(name);
+    if (existing_func && !existing_func->isDeclaration()) {
+      LOG(INFO)
+          << "Not inlining " << name << " from " << FLAGS_memops_runtime
+          << "; it is already defined";
+      func.deleteBody();
+
+    } else {
+      func.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      names.push_back(name);
+    }
+  }
+
+  // Drop `llvm.used` and friends, so that only needed intrinsics come along.
+  if (auto used = runtime->getGlobalVariable("llvm.used")) {
+    used->eraseFromParent();
+  }
+  if (auto used = runtime->getGlobalVariable("llvm.compiler.used")) {
+    used->eraseFromParent();
+  }
+
+  CHECK(!llvm::Linker::linkModules(*gModule, std::move(runtime),
+                                   llvm::Linker::LinkOnlyNeeded))
+      << "Could not link memory intrinsics runtime " << FLAGS_memops_runtime;
+
+  for (const auto &name : names) {
+    auto func = gModule->getFunction(name);
+    if (!func || func->isDeclaration()) {
+      continue;
+    }
+
+    // Internal, so that the definitions disappear once inlined, and don't
+    // conflict with the ones in the static runtime library.
+    func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    func->removeFnAttr(llvm::Attribute::NoInline);
+    func->removeFnAttr(llvm::Attribute::OptimizeNone);
+    func->addFnAttr(llvm::Attribute::AlwaysInline);
+    ++num_inlinable;
+  }
+
+  LOG(INFO)
+      << "Linked " << num_inlinable << " inlinable memory intrinsics from "
+      << FLAGS_memops_runtime;
+}
+
 static void MuteLinkerSymbol(const char *sym_name) {
   if (auto gv = gModule->getGlobalVariable(sym_name); gv) {
     gv->setLinkage(llvm::GlobalValue::PrivateLinkage);
@@ -1585,6 +3046,13 @@ void OptimizeModule(const NativeModule *cfg_module) {
   MuteStateEscape("__remill_missing_block");
   MuteStateEscape("__remill_async_hyper_call");
 
+  if (FLAGS_lower_hyper_calls) {
+    LowerSyncHyperCalls();
+  }
+
+  SplitStringOps();
+  LinkMemOpsRuntime();
+
   auto isels = FindISELs();
   LOG(INFO)
       << "Optimizing module.";
@@ -1603,24 +3071,7 @@ void OptimizeModule(const NativeModule *cfg_module) {
   mod_pm.run(*gModule);
 
   llvm::legacy::FunctionPassManager pm(gModule.get());
-
-//    pm.add(llvm::createGVNHoistPass());
-//    pm.add(llvm::createGVNSinkPass());
-//    pm.add(llvm::createMergedLoadStoreMotionPass());
-
-  pm.add(llvm::createEarlyCSEPass(true));
-  pm.add(llvm::createDeadCodeEliminationPass());
-  pm.add(llvm::createConstantPropagationPass());
-  pm.add(llvm::createSinkingPass());
-  pm.add(llvm::createNewGVNPass());
-  pm.add(llvm::createSCCPPass());
-  pm.add(llvm::createDeadStoreEliminationPass());
-  pm.add(llvm::createSROAPass());
-  pm.add(llvm::createPromoteMemoryToRegisterPass());
-  pm.add(llvm::createBitTrackingDCEPass());
-  pm.add(llvm::createCFGSimplificationPass());
-  pm.add(llvm::createSinkingPass());
-  pm.add(llvm::createCFGSimplificationPass());
+  AddScalarOptimizationPasses(pm);
 
   pm.doInitialization();
   for (auto &func : *gModule) {
@@ -1654,6 +3105,15 @@ void OptimizeModule(const NativeModule *cfg_module) {
 //  anvill::RecoverMemoryAccesses(*cfg_module, *gModule);
   LowerXrefs(cfg_module);
 
+  // Lower the memory access intrinsics now that the cross-references in their
+  // addresses are lowered, so that the rest of the pipeline optimizes real
+  // loads and stores. The `State` structure is already in its final form,
+  // `remill::RemoveDeadStores` and the above only reason about it.
+  if (!FLAGS_keep_memops) {
+    LowerMemOps(cfg_module);
+    LowerXrefs(cfg_module);
+  }
+
   for (auto &[ea, cfg_func] : cfg_module->ea_to_func) {
     (void) ea;
 
@@ -1679,6 +3139,7 @@ void OptimizeModule(const NativeModule *cfg_module) {
 
   for (auto &func : *gModule) {
     MergeGEPInstructions(func);
+    RecoverVectorIdioms(func);
   }
 
   pm.doInitialization();
@@ -1688,6 +3149,85 @@ void OptimizeModule(const NativeModule *cfg_module) {
   pm.doFinalization();
 }
 
+// Optimize and lower the lifted functions in `funcs` ahead of the rest of the
+// module. This mirrors `OptimizeModule` and the lowering parts of
+// `CleanUpModule`, but leaves the ISELs and intrinsics in place so that more
+// functions can be lifted afterward. Only calls to always-inline and internal
+// functions are inlined, see `InlineIntoStreamedFunctions`. Streamed
+// functions are not placed on huge pages by `PlaceInHugePages`, and
+// `RemoveDeadFlagUnpacks` conservatively keeps all of the flag unpacking in
+// the callbacks into them, because their bodies are gone by then.
+void OptimizeStreamedFunctions(
+    const NativeModule *cfg_module,
+    const std::unordered_set<llvm::Function *> &funcs) {
+  CHECK(!gStreamedFuncs);
+  gStreamedFuncs = &funcs;
+
+  MuteStateEscape("__remill_function_return");
+  MuteStateEscape("__remill_jump");
+  MuteStateEscape("__remill_error");
+  MuteStateEscape("__remill_missing_block");
+  MuteStateEscape("__remill_async_hyper_call");
+
+  if (FLAGS_lower_hyper_calls) {
+    LowerSyncHyperCalls();
+  }
+
+  SplitStringOps();
+  LinkMemOpsRuntime();
+
+  auto bb_func = remill::BasicBlockFunction(gModule.get());
+  auto slots = remill::StateSlots(gArch.get(), gModule.get());
+
+  InlineIntoStreamedFunctions(funcs);
+
+  llvm::legacy::FunctionPassManager pm(gModule.get());
+  AddScalarOptimizationPasses(pm);
+
+  auto run_pm = [&] (void) {
+    pm.doInitialization();
+    for (auto func : funcs) {
+      pm.run(*func);
+    }
+    pm.doFinalization();
+  };
+
+  run_pm();
+  remill::RemoveDeadStores(gArch.get(), gModule.get(), bb_func, slots);
+
+  // The same as in `OptimizeModule`, but leaving `__remill_restore.*` and
+  // `__remill_kill` declared for the functions that are yet to be lifted.
+  if (RemoveDeadRestores()) {
+    remill::RemoveDeadStores(gArch.get(), gModule.get(), bb_func, slots);
+    run_pm();
+  }
+  RemoveKilledStores();
+
+  LowerXrefs(cfg_module);
+
+  if (!FLAGS_keep_memops) {
+    LowerMemOps(cfg_module);
+    LowerXrefs(cfg_module);
+  }
+
+  run_pm();
+
+  for (auto func : funcs) {
+    MergeGEPInstructions(*func);
+    RecoverVectorIdioms(*func);
+  }
+
+  run_pm();
+
+  RemoveUndefFuncCalls();
+
+  if (FLAGS_minimize_flag_exprs) {
+    MinimizeFlagExpressions();
+  }
+
+  gStreamedFuncs = nullptr;
+}
+
 // Remove some of the Remill intrinsics.
 void CleanUpModule(const NativeModule *cfg_module) {
   RemoveUndefFuncCalls();
@@ -1696,18 +3236,11 @@ void CleanUpModule(const NativeModule *cfg_module) {
     llvm_used->eraseFromParent();
   }
 
+  // The lifted functions had their memory accesses lowered by
+  // `OptimizeModule`. This picks up any calls to the intrinsics that were
+  // introduced since, e.g. by the init/fini code.
   if (!FLAGS_keep_memops) {
     LowerMemOps(cfg_module);
-    ReplaceBarrier("__remill_barrier_load_load");
-    ReplaceBarrier("__remill_barrier_load_store");
-    ReplaceBarrier("__remill_barrier_store_load");
-    ReplaceBarrier("__remill_barrier_store_store");
-    ReplaceBarrier("__remill_barrier_atomic_begin");
-    ReplaceBarrier("__remill_barrier_atomic_end");
-    ReplaceBarrier("__remill_delay_slot_begin");
-    ReplaceBarrier("__remill_delay_slot_end");
-    ReplaceBarrier("__remill_atomic_begin");
-    ReplaceBarrier("__remill_atomic_end");
 
     llvm::legacy::FunctionPassManager pm(gModule.get());
     pm.add(llvm::createEarlyCSEPass(true));
@@ -1726,7 +3259,10 @@ void CleanUpModule(const NativeModule *cfg_module) {
     (void) ea;
 
     cfg_func->lifted_function = gModule->getFunction(cfg_func->lifted_name);
-    if (cfg_func->lifted_function) {
+
+    // Functions that were streamed out of the module are only declared here.
+    if (cfg_func->lifted_function &&
+        !cfg_func->lifted_function->isDeclaration()) {
       cfg_func->lifted_function->setLinkage(llvm::GlobalValue::InternalLinkage);
     }
   }
@@ -1890,6 +3426,10 @@ void CleanUpModule(const NativeModule *cfg_module) {
     pm.doFinalization();
   }
 
+  if (FLAGS_minimize_flag_exprs) {
+    MinimizeFlagExpressions();
+  }
+
   MuteLinkerSymbol("__TMC_END__");
   MuteLinkerSymbol("__TMC_LIST__");
 }
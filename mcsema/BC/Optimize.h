@@ -17,12 +17,23 @@
 
 #pragma once
 
+#include <unordered_set>
+
+namespace llvm {
+class Function;
+}  // namespace llvm
 namespace mcsema {
 
 struct NativeModule;
 
 void OptimizeModule(const NativeModule *cfg_module);
 
+// Optimize and lower some lifted functions ahead of the rest of the module, so
+// that they can be streamed out of it.
+void OptimizeStreamedFunctions(
+    const NativeModule *cfg_module,
+    const std::unordered_set<llvm::Function *> &funcs);
+
 // Remove some of the Remill intrinsics.
 void CleanUpModule(const NativeModule *cfg_module);
 
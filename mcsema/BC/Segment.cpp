@@ -23,8 +23,11 @@
 #include <algorithm>
 #include <iomanip>
 #include <limits>
+#include <map>
 #include <sstream>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <llvm/IR/Constants.h>
@@ -36,6 +39,7 @@
 #include <llvm/IR/Type.h>
 
 #include <remill/Arch/Arch.h>
+#include <remill/BC/ABI.h>
 #include <remill/BC/Compat/GlobalValue.h>
 #include <remill/BC/Util.h>
 
@@ -51,13 +55,17 @@ DEFINE_string(libc_constructor, "",
               "code compiled from C++ programs. Many C++ programs will "
               "construct global objects before the `main` function is executed,"
               " and those constructors will be called via a function like "
-              "`__libc_csu_init` (on GNU-based systems).");
+              "`__libc_csu_init` (on GNU-based systems). By default, the "
+              "functions in the binary's `.init_array` are registered as "
+              "module constructors instead.");
 
 DEFINE_string(libc_destructor, "",
               "Destructor function for running post-`main` finalizers. This "
               "is a (lifted) function that will be executed after the `main` "
               "function returns. For example, on GNU-based systems, this is "
-              "typically `__libc_csu_fini`.");
+              "typically `__libc_csu_fini`. By default, the functions in the "
+              "binary's `.fini_array` are registered as module destructors "
+              "instead.");
 
 DEFINE_bool(force_embed_data_refs, false,
             "Should data-to-code and data-to-data cross-references be force-"
@@ -65,7 +73,33 @@ DEFINE_bool(force_embed_data_refs, false,
             "when using McSema-produced bitcode in KLEE, as it avoids doing "
             "lazy cross-reference initialization.");
 
+DEFINE_bool(lazy_init_data_refs, false,
+            "Should data-to-external cross-references be initialized at "
+            "runtime by `__mcsema_constructor`? By default these are "
+            "embedded as relocatable constants, which keeps read-only "
+            "segments (e.g. `.rodata`, vtables, jump tables) constant so "
+            "that loads from them can be folded. Truncated cross-references "
+            "are initialized at runtime unless `--embed_truncated_data_refs` "
+            "is used.");
+
+DEFINE_bool(embed_truncated_data_refs, false,
+            "Embed cross-references narrower than a pointer as truncated "
+            "relocatable constants (e.g. `R_X86_64_32`) instead of "
+            "initializing them at runtime. Only enable this if the lifted "
+            "bitcode is linked into a non-PIE executable (`-no-pie`); "
+            "position-independent executables and shared libraries can't "
+            "be linked with these relocations. Ignored with `--pic`.");
+
+DEFINE_bool(huge_pages, false,
+            "Place the lifted code, in its original address order, and the "
+            "data segments of 2 MiB or more into their own 2 MiB-aligned "
+            "sections, with read-only segments kept apart from writable "
+            "ones. At startup, the runtime moves them onto transparent "
+            "huge pages, which reduces TLB misses in big binaries. Only "
+            "supported on x86 and amd64 Linux.");
+
 DECLARE_bool(disable_aliases);
+DECLARE_bool(pic);
 
 namespace mcsema {
 namespace {
@@ -143,50 +177,29 @@ static llvm::StructType *GetSegmentType(const NativeSegment *cfg_seg) {
 static llvm::GlobalValue::ThreadLocalMode ThreadLocalMode(
     const NativeObject *cfg_obj) {
   if (cfg_obj->is_thread_local) {
-    return llvm::GlobalValue::InitialExecTLSModel;
+    return LiftedThreadLocalMode();
   } else {
     return llvm::GlobalValue::NotThreadLocal;
   }
 }
 
-// Create a McSema-specific constructor/destructor function, and add it to the
-// corresponding LLVM-specific array.
-static llvm::Function *CreateMcSemaInitFiniImpl(
-    const char *func_name, const char *arr_name) {
-  LOG(INFO)
-      << "Creating " << func_name << " function to initialize runtime.";
-
-  auto func = llvm::Function::Create(
-      llvm::FunctionType::get(llvm::Type::getVoidTy(*gContext), false),
-      llvm::GlobalValue::InternalLinkage,
-      func_name, gModule.get());
-
-  auto bool_type = llvm::Type::getInt1Ty(*gContext);
-  auto check_var = new llvm::GlobalVariable(
-      bool_type, false, llvm::GlobalValue::InternalLinkage);
-  check_var->setInitializer(llvm::Constant::getNullValue(bool_type));
-
-  auto entry = llvm::BasicBlock::Create(*gContext, "", func);
-  llvm::IRBuilder<> ir(entry);
-  ir.CreateRetVoid();
-
+// Add `(priority, function)` pairs to the end of the LLVM-specific init/fini
+// array `arr_name`.
+static void AppendToInitFiniArray(
+    const char *arr_name,
+    const std::vector<std::pair<uint32_t, llvm::Constant *>> &funcs) {
   auto i32_type = llvm::Type::getInt32Ty(*gContext);
   auto ptr_type = llvm::Type::getInt8PtrTy(*gContext);
+  auto func_type = llvm::PointerType::get(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(*gContext), false), 0);
 
   // Type of an entry in the init/fini array.
   std::vector<llvm::Type *> element_types;
   element_types.push_back(i32_type);
-  element_types.push_back(func->getType());
+  element_types.push_back(func_type);
   element_types.push_back(ptr_type);
   auto el_type = llvm::StructType::get(*gContext, element_types);
 
-  // Init/fini array entry.
-  std::vector<llvm::Constant *> element_inits;
-  element_inits.push_back(llvm::ConstantInt::get(i32_type, 101));
-  element_inits.push_back(func);
-  element_inits.push_back(llvm::Constant::getNullValue(ptr_type));
-  auto el_init = llvm::ConstantStruct::get(el_type, element_inits);
-
   std::vector<llvm::Constant *> new_elems;
 
   auto global_ctors = gModule->getGlobalVariable(arr_name);
@@ -202,7 +215,15 @@ static llvm::Function *CreateMcSemaInitFiniImpl(
     }
   }
 
-  new_elems.push_back(el_init);
+  // Init/fini array entries.
+  for (const auto &func : funcs) {
+    std::vector<llvm::Constant *> element_inits;
+    element_inits.push_back(llvm::ConstantInt::get(i32_type, func.first));
+    element_inits.push_back(
+        llvm::ConstantExpr::getBitCast(func.second, func_type));
+    element_inits.push_back(llvm::Constant::getNullValue(ptr_type));
+    new_elems.push_back(llvm::ConstantStruct::get(el_type, element_inits));
+  }
 
   auto arr_type = llvm::ArrayType::get(el_type, new_elems.size());
   auto arr_init = llvm::ConstantArray::get(arr_type, new_elems);
@@ -216,7 +237,30 @@ static llvm::Function *CreateMcSemaInitFiniImpl(
     global_ctors->dropAllReferences();
     global_ctors->eraseFromParent();
   }
+}
+
+// Create a McSema-specific constructor/destructor function, and add it to the
+// corresponding LLVM-specific array.
+static llvm::Function *CreateMcSemaInitFiniImpl(
+    const char *func_name, const char *arr_name) {
+  LOG(INFO)
+      << "Creating " << func_name << " function to initialize runtime.";
+
+  auto func = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(*gContext), false),
+      llvm::GlobalValue::InternalLinkage,
+      func_name, gModule.get());
+
+  auto bool_type = llvm::Type::getInt1Ty(*gContext);
+  auto check_var = new llvm::GlobalVariable(
+      bool_type, false, llvm::GlobalValue::InternalLinkage);
+  check_var->setInitializer(llvm::Constant::getNullValue(bool_type));
+
+  auto entry = llvm::BasicBlock::Create(*gContext, "", func);
+  llvm::IRBuilder<> ir(entry);
+  ir.CreateRetVoid();
 
+  AppendToInitFiniArray(arr_name, {{101, func}});
   return func;
 }
 
@@ -275,6 +319,11 @@ static void LazyInitXRef(const NativeXref *xref,
     return;
   }
 
+  // NOTE(pag): Only thread-local references (and everything, with
+  //            `--lazy_init_data_refs`) get here. Their values aren't
+  //            link-time constants, so the segment has to be writable, or
+  //            else LLVM would fold loads of this slot to the null
+  //            placeholder in the initializer.
   auto seg = llvm::dyn_cast<llvm::GlobalVariable>(xref->segment->Pointer());
   if (seg->isConstant()) {
     LOG(WARNING)
@@ -396,13 +445,15 @@ static llvm::Constant *FillDataSegment(const NativeModule *cfg_module,
       } else if (xref->var) {
         const auto cfg_var = xref->var->Get();
         val = cfg_var->Pointer();
-        be_lazy = cfg_var->is_external || cfg_var->is_thread_local;
+        be_lazy = cfg_var->is_thread_local ||
+                  (cfg_var->is_external && FLAGS_lazy_init_data_refs);
 
       // Pointer to an unnamed location inside of a data segment.
       } else if (xref->target_segment) {
         const auto target_seg = xref->target_segment;
         val = LiftXrefInData(target_seg, xref->target_ea, false);
-        be_lazy = target_seg->is_external || target_seg->is_thread_local;
+        be_lazy = target_seg->is_thread_local ||
+                  (target_seg->is_external && FLAGS_lazy_init_data_refs);
 
       } else {
         val = llvm::ConstantInt::get(gWordType, xref->target_ea);
@@ -425,8 +476,13 @@ static llvm::Constant *FillDataSegment(const NativeModule *cfg_module,
       if (entry_type->isIntegerTy()) {
         val = llvm::ConstantExpr::getPtrToInt(val, gWordType);
         if ((gArch->address_size / 8) > xref->width) {
+
+          // The truncated address is still a relocatable constant, e.g.
+          // `R_X86_64_32`, but only in code linked at a fixed address. PIE
+          // executables and shared libraries fail to link with it.
           val = llvm::ConstantExpr::getTrunc(val, entry_type);
-          be_lazy = true;
+          be_lazy = be_lazy || FLAGS_lazy_init_data_refs || FLAGS_pic ||
+                    !FLAGS_embed_truncated_data_refs;
         }
 
       } else if (val_type != entry_type) {
@@ -506,7 +562,7 @@ llvm::Constant *NativeVariable::Pointer(void) const {
     module->AddNameToAddress(alias_name, ea);
 
     if (cfg_seg->is_thread_local) {
-      alias->setThreadLocalMode(llvm::GlobalValue::InitialExecTLSModel);
+      alias->setThreadLocalMode(LiftedThreadLocalMode());
     }
   }
   return ret;
@@ -686,11 +742,195 @@ bool DetectAndSetInitFiniCode(const NativeModule *cfg_module) {
   return false;
 }
 
+// Returns the non-external function named `name`, if there is one.
+static const NativeFunction *FindInitFiniFunction(
+    const NativeModule *cfg_module, const char *name) {
+  for (const auto &entry : cfg_module->ea_to_func) {
+    const auto cfg_func = entry.second->Get();
+    if (cfg_func->name == name && !cfg_func->is_external) {
+      return cfg_func;
+    }
+  }
+  return nullptr;
+}
+
+// Define a lifted function, `name`, that calls the lifted functions `funcs`
+// one after the other, and return a native entry point into it. Each call is
+// emulated like a lifted `call` instruction would be, so native code enters
+// lifted code once, and sets up the `State` structure once, for all of them.
+static llvm::Function *CreateInitFiniDriver(
+    const std::string &name, const std::vector<const NativeFunction *> &funcs) {
+  auto driver = llvm::Function::Create(
+      gArch->LiftedFunctionType(), llvm::GlobalValue::InternalLinkage,
+      name, gModule.get());
+
+  auto block = llvm::BasicBlock::Create(*gContext, "", driver);
+  auto state_ptr = remill::NthArgument(driver, remill::kStatePointerArgNum);
+  auto ret_pc = remill::NthArgument(driver, remill::kPCArgNum);
+  llvm::Value *mem_ptr = remill::NthArgument(
+      driver, remill::kMemoryPointerArgNum);
+
+  auto sp_ref = gArch->RegisterByName(
+      gArch->StackPointerRegisterName())->AddressOf(state_ptr, block);
+
+  // The callees return through the link register, and `__mcsema_detach_ret`
+  // returns to native code through it, so keep its value for the latter.
+  llvm::Value *lr_ref = nullptr;
+  if (gArch->IsAArch64()) {
+    lr_ref = gArch->RegisterByName("X30")->AddressOf(state_ptr, block);
+  }
+
+  llvm::IRBuilder<> ir(block);
+  llvm::Value *lr = lr_ref ? ir.CreateLoad(lr_ref) : nullptr;
+
+  const auto addr_size = llvm::ConstantInt::get(
+      gWordType, gArch->address_size / 8);
+  const auto word_ptr_type = llvm::PointerType::get(gWordType, 0);
+
+  for (auto cfg_func : funcs) {
+    llvm::Function *callee = nullptr;
+    if (cfg_func->is_external) {
+      callee = GetLiftedToNativeExitPoint(cfg_func);
+    } else {
+      callee = gModule->getFunction(cfg_func->lifted_name);
+      CHECK(callee != nullptr)
+          << "Cannot find lifted function " << cfg_func->lifted_name;
+    }
+
+    // Push a return address, which the callee's lifted `ret` pops.
+    if (!lr_ref) {
+      auto sp = ir.CreateSub(ir.CreateLoad(sp_ref), addr_size);
+      ir.CreateStore(ret_pc, ir.CreateIntToPtr(sp, word_ptr_type));
+      ir.CreateStore(sp, sp_ref);
+    }
+
+    llvm::Value *args[remill::kNumBlockArgs];
+    args[remill::kStatePointerArgNum] = state_ptr;
+    args[remill::kMemoryPointerArgNum] = mem_ptr;
+    args[remill::kPCArgNum] = llvm::ConstantInt::get(gWordType, cfg_func->ea);
+    mem_ptr = ir.CreateCall(callee, args);
+  }
+
+  // Emulate the driver's own `ret`.
+  if (lr_ref) {
+    ir.CreateStore(lr, lr_ref);
+  } else {
+    ir.CreateStore(ir.CreateAdd(ir.CreateLoad(sp_ref), addr_size), sp_ref);
+  }
+  ir.CreateRet(mem_ptr);
+
+  std::stringstream ss;
+  ss << "callback_" << name;
+  return GetNativeToLiftedEntryPoint(driver, funcs.front()->ea, ss.str());
+}
+
+// Register the functions in the binary's constructor and destructor arrays
+// with `llvm.global_ctors` and `llvm.global_dtors`, keeping their original
+// priorities and order. The native startup code then runs them instead of a
+// lifted `__libc_csu_init` walking the lifted array. There is one entry per
+// priority, which enters lifted code once and then calls the lifted functions
+// of that priority directly. The binary's `_init` runs before the first
+// constructor, and its `_fini` after the last destructor, as they would from
+// `.init` and `.fini`.
+static bool LowerInitFiniArrays(const NativeModule *cfg_module) {
+  using FuncList = std::vector<const NativeFunction *>;
+  std::map<uint32_t, FuncList> ctors;
+  std::map<uint32_t, FuncList> dtors;
+
+  for (const auto &arr : cfg_module->init_fini_arrays) {
+    const auto cfg_seg = cfg_module->TryGetSegment(arr.ea);
+    if (!cfg_seg) {
+      LOG(WARNING)
+          << "Could not find segment containing init/fini array at "
+          << std::hex << arr.ea << std::dec;
+      continue;
+    }
+
+    FuncList funcs;
+    const auto arr_end = arr.ea + arr.size;
+    for (auto it = cfg_seg->entries.lower_bound(arr.ea);
+         it != cfg_seg->entries.end() && it->first < arr_end; ++it) {
+      const auto &xref = it->second.xref;
+
+      // E.g. the `-1` and `0` delimiters of `.ctors`.
+      if (!xref) {
+        continue;
+      }
+
+      if (!xref->func) {
+        LOG(WARNING)
+            << "Init/fini array entry at " << std::hex << xref->ea
+            << " points to " << xref->target_ea << ", which is not a function"
+            << std::dec;
+        continue;
+      }
+
+      funcs.push_back(xref->func->Get());
+    }
+
+    // Put the entries in the order that they run in.
+    if (arr.runs_backward) {
+      std::reverse(funcs.begin(), funcs.end());
+    }
+
+    auto &lowered = (arr.is_fini ? dtors : ctors)[arr.priority];
+    lowered.insert(lowered.end(), funcs.begin(), funcs.end());
+  }
+
+  if (ctors.empty() && dtors.empty()) {
+    return false;
+  }
+
+  // Constructors with lower priorities run first, and destructors with lower
+  // priorities run last.
+  if (auto init = FindInitFiniFunction(cfg_module, "_init"); init) {
+    auto &first = ctors.empty() ? ctors[65535] : ctors.begin()->second;
+    first.insert(first.begin(), init);
+  }
+  if (auto fini = FindInitFiniFunction(cfg_module, "_fini"); fini) {
+    auto &last = dtors.empty() ? dtors[65535] : dtors.begin()->second;
+    last.push_back(fini);
+  }
+
+  auto lower = [] (const char *arr_name, const char *driver_prefix,
+                   const std::map<uint32_t, FuncList> &funcs) {
+    std::vector<std::pair<uint32_t, llvm::Constant *>> entries;
+    auto num_funcs = 0u;
+    for (const auto &[priority, prio_funcs] : funcs) {
+      if (prio_funcs.empty()) {
+        continue;
+      }
+      std::stringstream ss;
+      ss << driver_prefix << priority;
+      entries.emplace_back(priority, CreateInitFiniDriver(ss.str(), prio_funcs));
+      num_funcs += static_cast<unsigned>(prio_funcs.size());
+    }
+
+    if (!entries.empty()) {
+      LOG(INFO)
+          << "Lowering " << num_funcs << " functions into " << entries.size()
+          << " entries of " << arr_name;
+      AppendToInitFiniArray(arr_name, entries);
+    }
+  };
+
+  lower("llvm.global_ctors", "__mcsema_init_array_", ctors);
+  lower("llvm.global_dtors", "__mcsema_fini_array_", dtors);
+  return true;
+}
+
 // Generate code to call pre-`main` function static object constructors, and
 // post-`main` functions destructors.
 void CallInitFiniCode(const NativeModule *cfg_module) {
   if (FLAGS_libc_constructor.empty() && FLAGS_libc_destructor.empty()) {
+    if (LowerInitFiniArrays(cfg_module)) {
+      return;
+    }
+
     if (!DetectAndSetInitFiniCode(cfg_module)) {
+      LOG(WARNING)
+          << "Could not find init/fini arrays or a libc constructor and "
+          << "destructor; static constructors will not be called";
       return;
     }
   }
@@ -720,4 +960,191 @@ void CallInitFiniCode(const NativeModule *cfg_module) {
   }
 }
 
+namespace {
+
+enum : uint64_t {
+  kHugePageSize = 2ULL << 20ULL
+};
+
+// What `__mcsema_remap_huge_pages` is remapping, and so which protections the
+// copy gets.
+enum : uint32_t {
+  kHugeData = 0,
+  kHugeText = 1,
+  kHugeReadOnlyData = 2
+};
+
+// The `.text.`, `.data.`, `.rodata.` and `.data.rel.ro.` prefixes make sure
+// that the sections get the right flags, and that the linker places them
+// with the rest of the code and data. Read-only segments with embedded
+// cross-references go into `.data.rel.ro.mcsema_huge`, so that the dynamic
+// loader can relocate them before it makes them read-only.
+static const char * const kHugeTextSection = ".text.mcsema_huge";
+static const char * const kHugeDataSection = ".data.mcsema_huge";
+static const char * const kHugeReadOnlySection = ".rodata.mcsema_huge";
+static const char * const kHugeRelRoSection = ".data.rel.ro.mcsema_huge";
+
+static void AlignToHugePage(llvm::GlobalObject *obj) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  obj->setAlignment(llvm::MaybeAlign(kHugePageSize));
+#else
+  obj->setAlignment(kHugePageSize);
+#endif
+}
+
+// An empty function that marks the beginning or end of the lifted code in
+// the huge page text section.
+static llvm::Function *CreateHugeTextMarker(const char *name) {
+  auto func = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(*gContext), false),
+      llvm::GlobalValue::InternalLinkage, name, gModule.get());
+  func->addFnAttr(llvm::Attribute::NoInline);
+  func->setSection(kHugeTextSection);
+  llvm::ReturnInst::Create(
+      *gContext, llvm::BasicBlock::Create(*gContext, "", func));
+  return func;
+}
+
+// Runtime function that moves `[begin, end)` onto huge pages.
+static llvm::Function *GetRemapHugePagesFunc(void) {
+  static const char * const kName = "__mcsema_remap_huge_pages";
+  if (auto func = gModule->getFunction(kName)) {
+    return func;
+  }
+  auto ptr_type = llvm::Type::getInt8PtrTy(*gContext);
+  llvm::Type *param_types[] = {
+      ptr_type, ptr_type, llvm::Type::getInt32Ty(*gContext)};
+  return llvm::Function::Create(
+      llvm::FunctionType::get(
+          llvm::Type::getVoidTy(*gContext), param_types, false),
+      llvm::GlobalValue::ExternalLinkage, kName, gModule.get());
+}
+
+// Lay out the lifted functions in `funcs` in order, between a pair of
+// markers, in the huge page text section. Returns the markers.
+static std::pair<llvm::Function *, llvm::Function *> PlaceHugeText(
+    const std::vector<llvm::Function *> &funcs) {
+  auto begin = CreateHugeTextMarker("__mcsema_huge_text_begin");
+  AlignToHugePage(begin);
+  for (auto func : funcs) {
+    func->setSection(kHugeTextSection);
+    func->removeFromParent();
+    gModule->getFunctionList().push_back(func);
+  }
+  auto end = CreateHugeTextMarker("__mcsema_huge_text_end");
+  return {begin, end};
+}
+
+// Lay out the segments in `segs` in order in the huge page data section
+// `section`. Returns the bounds of the section's contents.
+static std::pair<llvm::Constant *, llvm::Constant *> PlaceHugeData(
+    const std::vector<llvm::GlobalVariable *> &segs, const char *section) {
+  AlignToHugePage(segs.front());
+  for (auto seg : segs) {
+    seg->setSection(section);
+    seg->removeFromParent();
+    gModule->getGlobalList().push_back(seg);
+  }
+  auto last = segs.back();
+  auto end = llvm::ConstantExpr::getGetElementPtr(
+      remill::GetValueType(last), last,
+      llvm::ConstantInt::get(llvm::Type::getInt32Ty(*gContext), 1));
+  return {segs.front(), end};
+}
+
+}  // namespace
+
+void PlaceInHugePages(const NativeModule *cfg_module) {
+  if (!FLAGS_huge_pages) {
+    return;
+  }
+
+  // Lifted functions in the order of the original code. Those that were
+  // streamed out of the module are only declared here.
+  std::vector<std::pair<uint64_t, llvm::Function *>> ea_funcs;
+  std::unordered_set<llvm::Function *> seen_funcs;
+  for (auto [ea, cfg_func] : cfg_module->ea_to_func) {
+    auto func = cfg_func->lifted_function;
+    if (cfg_func->is_external || !func || func->isDeclaration() ||
+        !seen_funcs.insert(func).second) {
+      continue;
+    }
+    ea_funcs.emplace_back(ea, func);
+  }
+  std::sort(ea_funcs.begin(), ea_funcs.end());
+
+  std::vector<llvm::Function *> funcs;
+  for (auto [ea, func] : ea_funcs) {
+    (void) ea;
+    funcs.push_back(func);
+  }
+
+  // Segments that are still constant after lazy cross-reference
+  // initialization go into their own range, which stays read-only.
+  std::vector<llvm::GlobalVariable *> segs;
+  std::vector<llvm::GlobalVariable *> ro_segs;
+  auto ro_section = kHugeReadOnlySection;
+  for (const auto &cfg_seg : cfg_module->segments) {
+    if (cfg_seg->is_external || cfg_seg->is_thread_local ||
+        (cfg_seg->size + cfg_seg->padding) < kHugePageSize) {
+      continue;
+    }
+    auto seg = llvm::dyn_cast<llvm::GlobalVariable>(cfg_seg->Pointer());
+    if (!seg || !seg->hasInitializer()) {
+      continue;
+    }
+    if (!seg->isConstant()) {
+      segs.push_back(seg);
+      continue;
+    }
+    ro_segs.push_back(seg);
+    for (const auto &entry : cfg_seg->entries) {
+      if (entry.second.xref) {
+        ro_section = kHugeRelRoSection;
+        break;
+      }
+    }
+  }
+
+  LOG(INFO)
+      << "Placing " << funcs.size() << " lifted functions, " << segs.size()
+      << " writable segments, and " << ro_segs.size()
+      << " read-only segments into huge page sections";
+
+  if (funcs.empty() && segs.empty() && ro_segs.empty()) {
+    return;
+  }
+
+  // Remap before anything else in the constructor runs.
+  auto init_func = GetOrCreateMcSemaConstructor();
+  llvm::IRBuilder<> ir(&(init_func->front().front()));
+  auto remap_func = GetRemapHugePagesFunc();
+  auto ptr_type = llvm::Type::getInt8PtrTy(*gContext);
+  auto i32_type = llvm::Type::getInt32Ty(*gContext);
+
+  if (!funcs.empty()) {
+    auto [begin, end] = PlaceHugeText(funcs);
+    ir.CreateCall(remap_func, {
+        llvm::ConstantExpr::getBitCast(begin, ptr_type),
+        llvm::ConstantExpr::getBitCast(end, ptr_type),
+        llvm::ConstantInt::get(i32_type, kHugeText)});
+  }
+
+  if (!segs.empty()) {
+    auto [begin, end] = PlaceHugeData(segs, kHugeDataSection);
+    ir.CreateCall(remap_func, {
+        llvm::ConstantExpr::getBitCast(begin, ptr_type),
+        llvm::ConstantExpr::getBitCast(end, ptr_type),
+        llvm::ConstantInt::get(i32_type, kHugeData)});
+  }
+
+  if (!ro_segs.empty()) {
+    auto [begin, end] = PlaceHugeData(ro_segs, ro_section);
+    ir.CreateCall(remap_func, {
+        llvm::ConstantExpr::getBitCast(begin, ptr_type),
+        llvm::ConstantExpr::getBitCast(end, ptr_type),
+        llvm::ConstantInt::get(i32_type, kHugeReadOnlyData)});
+  }
+}
+
 }  // namespace mcsema
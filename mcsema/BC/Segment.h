@@ -30,4 +30,8 @@ llvm::Function *GetOrCreateMcSemaInitializer(void);
 void DefineDataSegments(const NativeModule *cfg_module);
 void CallInitFiniCode(const NativeModule *cfg_module);
 
+// Lay out the lifted code and the big data segments in sections that the
+// runtime moves onto huge pages at startup, if `--huge_pages` is set.
+void PlaceInHugePages(const NativeModule *cfg_module);
+
 }  // namespace mcsema
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mcsema/BC/Stream.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalAlias.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <remill/BC/Util.h>
+
+#include "mcsema/BC/Optimize.h"
+#include "mcsema/BC/Util.h"
+
+DEFINE_string(stream_dir, "",
+              "Directory into which lifted functions are streamed as bitcode "
+              "shards once the lifter's memory use exceeds "
+              "--stream_memory_budget. The shards must be linked with the "
+              "output bitcode file, e.g. using llvm-link. Streaming is "
+              "disabled when this is empty.");
+
+DEFINE_uint64(stream_memory_budget, 4096,
+              "Memory budget, in MiB, above which lifted functions are "
+              "streamed out of the module into --stream_dir.");
+
+namespace mcsema {
+namespace {
+
+// Lifted functions that have been handed off, but not yet streamed out.
+static std::unordered_set<llvm::Function *> gPendingFuncs;
+
+// The things in the module that shards reference, keyed by the names that the
+// shards use for them. These are tracked across replacements, e.g. when a
+// segment variable is redefined.
+static std::map<std::string, llvm::WeakTrackingVH> gStreamedRefs;
+
+static unsigned gNumShards = 0;
+
+// Memory use right after the last shard was written. Dropping function bodies
+// rarely brings the memory use back under the budget, e.g. because the
+// semantics module stays resident, or because freed memory isn't returned, so
+// the next shard is only written once the pending functions have grown by a
+// fraction of the budget past this. Otherwise, every function would get its
+// own shard, and a clone of the module.
+static uint64_t gUsageAfterShard = 0;
+
+// Shards are linked back together by name, so make sure that nothing a shard
+// might reference is unnamed.
+static void NameUnnamedGlobals(void) {
+  for (auto &gv : gModule->global_values()) {
+    if (!gv.hasName()) {
+      gv.setName("__mcsema_unnamed");
+    }
+  }
+}
+
+// Write out the pending functions into a new shard, and drop their bodies.
+static void StreamPendingFunctions(const NativeModule *cfg_module) {
+  OptimizeStreamedFunctions(cfg_module, gPendingFuncs);
+  NameUnnamedGlobals();
+
+  // The shard owns the definitions of the pending functions, as well as
+  // private copies of any local constants (e.g. strings) that they use.
+  // Everything else is declared, and resolved against the module at link
+  // time.
+  llvm::ValueToValueMapTy value_map;
+  auto shard = llvm::CloneModule(
+      *gModule, value_map, [] (const llvm::GlobalValue *gv) {
+        if (auto func = llvm::dyn_cast<llvm::Function>(gv)) {
+          return gPendingFuncs.count(const_cast<llvm::Function *>(func)) != 0;
+        } else if (auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv)) {
+          return var->hasLocalLinkage() && var->isConstant();
+        } else {
+          return false;
+        }
+      });
+
+  std::vector<llvm::GlobalValue *> unused;
+  std::vector<llvm::GlobalValue *> used;
+  for (auto &gv : shard->global_values()) {
+    if (!gv.isDeclaration()) {
+      continue;
+    } else if (gv.use_empty()) {
+      unused.push_back(&gv);
+    } else if (!gv.getName().startswith("llvm.")) {
+      const auto name = gv.getName().str();
+      if (!gStreamedRefs.count(name)) {
+        if (auto orig_gv = gModule->getNamedValue(name); orig_gv) {
+          gStreamedRefs.emplace(name, orig_gv);
+          used.push_back(orig_gv);
+        }
+      }
+    }
+  }
+
+  for (auto gv : unused) {
+    gv->eraseFromParent();
+  }
+
+  // Keep the module's copies of referenced things alive until
+  // `FinishStreamingFunctions`, even if nothing in the module uses them.
+  llvm::appendToCompilerUsed(*gModule, used);
+
+  std::stringstream ss;
+  ss << FLAGS_stream_dir << "/shard_" << gNumShards++ << ".bc";
+  const auto shard_path = ss.str();
+  remill::StoreModuleToFile(shard.get(), shard_path);
+
+  LOG(INFO)
+      << "Streamed " << gPendingFuncs.size() << " lifted functions into "
+      << shard_path;
+
+  for (auto func : gPendingFuncs) {
+    func->deleteBody();
+  }
+  gPendingFuncs.clear();
+
+  gUsageAfterShard = llvm::sys::Process::GetMallocUsage();
+}
+
+}  // namespace
+
+bool IsStreamingFunctions(void) {
+  return !FLAGS_stream_dir.empty();
+}
+
+void StreamLiftedFunction(const NativeModule *cfg_module,
+                          llvm::Function *lifted_func) {
+  if (!IsStreamingFunctions()) {
+    return;
+  }
+
+  if (!gNumShards && gPendingFuncs.empty()) {
+    auto ec = llvm::sys::fs::create_directories(FLAGS_stream_dir);
+    CHECK(!ec)
+        << "Unable to create shard directory " << FLAGS_stream_dir
+        << ": " << ec.message();
+  }
+
+  gPendingFuncs.insert(lifted_func);
+
+  const auto budget = FLAGS_stream_memory_budget * 1024ULL * 1024ULL;
+  const auto usage = llvm::sys::Process::GetMallocUsage();
+  if (usage >= budget && usage >= (gUsageAfterShard + budget / 8)) {
+    StreamPendingFunctions(cfg_module);
+  }
+}
+
+void FinishStreamingFunctions(void) {
+  if (!IsStreamingFunctions()) {
+    return;
+  }
+
+  // The functions that are still pending get optimized with the rest of the
+  // module, and stay in it.
+  gPendingFuncs.clear();
+
+  for (auto &[name, val] : gStreamedRefs) {
+    auto gv = llvm::dyn_cast_or_null<llvm::GlobalValue>(
+        static_cast<llvm::Value *>(val));
+    if (!gv) {
+      LOG(ERROR)
+          << "Streamed shards reference " << name
+          << ", which is no longer in the module";
+      continue;
+    }
+
+    if (gv->hasLocalLinkage()) {
+      gv->setLinkage(llvm::GlobalValue::ExternalLinkage);
+      gv->setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+
+    // E.g. exported variables get renamed to their original names.
+    if (gv->getName() != name) {
+      if (auto go = llvm::dyn_cast<llvm::GlobalObject>(gv); go) {
+        auto alias = llvm::GlobalAlias::create(
+            llvm::GlobalValue::ExternalLinkage, name, go);
+        alias->setVisibility(llvm::GlobalValue::HiddenVisibility);
+      } else {
+        LOG(ERROR)
+            << "Unable to make " << gv->getName().str()
+            << " visible to streamed shards as " << name;
+      }
+    }
+  }
+
+  LOG(INFO)
+      << "Streamed lifted functions into " << gNumShards << " shards in "
+      << FLAGS_stream_dir;
+}
+
+}  // namespace mcsema
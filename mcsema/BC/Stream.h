@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+namespace llvm {
+
+class Function;
+
+}  // namespace llvm
+namespace mcsema {
+struct NativeModule;
+
+// Returns `true` if lifted functions are being streamed out of the module
+// into shards.
+bool IsStreamingFunctions(void);
+
+// Hand off a lifted function whose callees are all declared. Once the lifted
+// functions that have been handed off use more memory than the budget, they
+// are optimized, written to a shard, and their bodies are dropped from the
+// module.
+void StreamLiftedFunction(const NativeModule *cfg_module,
+                          llvm::Function *lifted_func);
+
+// Make everything that the shards reference visible to them. This is called
+// once the module is otherwise in its final form.
+void FinishStreamingFunctions(void);
+
+}  // namespace mcsema
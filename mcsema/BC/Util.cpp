@@ -24,6 +24,7 @@
 
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/MDBuilder.h>
@@ -41,6 +42,12 @@
 
 DEFINE_bool(disable_aliases, false, "Disable using global aliases for accessing data/registers in the bitcode");
 
+DEFINE_bool(pic, false,
+            "Produce bitcode for a shared library. Thread-local variables, "
+            "including the register state, use the local-dynamic TLS model "
+            "and the register state is hidden. Link against the "
+            "`mcsema_rt64_pic` runtime. Only supported on amd64 Linux.");
+
 namespace mcsema {
 
 std::shared_ptr<llvm::LLVMContext> gContext = nullptr;
@@ -121,6 +128,17 @@ llvm::Constant *LiftXrefInData(const NativeSegment *cfg_seg, uint64_t ea,
   }
 }
 
+// Thread-local mode of the variables the lifter creates. The initial-exec
+// model needs static TLS, which a `dlopen`ed library with a 1 MiB stack in TLS
+// is not going to get.
+llvm::GlobalValue::ThreadLocalMode LiftedThreadLocalMode(void) {
+  if (FLAGS_pic) {
+    return llvm::GlobalValue::LocalDynamicTLSModel;
+  } else {
+    return llvm::GlobalValue::InitialExecTLSModel;
+  }
+}
+
 // Create a global register state pointer to pass to lifted functions.
 llvm::Constant *GetStatePointer(void) {
   static llvm::Constant *state_ptr = nullptr;
@@ -137,7 +155,12 @@ llvm::Constant *GetStatePointer(void) {
   const auto state_ptr_var = new llvm::GlobalVariable(
       *gModule, state_type, false, llvm::GlobalValue::ExternalLinkage,
       state_init, "__mcsema_reg_state", nullptr,
-      llvm::GlobalValue::InitialExecTLSModel);
+      LiftedThreadLocalMode());
+
+  // Every lifted library has its own state, and its own runtime.
+  if (FLAGS_pic) {
+    state_ptr_var->setVisibility(llvm::GlobalValue::HiddenVisibility);
+  }
 
   state_ptr = state_ptr_var;
   if (state_ptr_var->getType()->getPointerAddressSpace() != 0) {
@@ -148,17 +171,57 @@ llvm::Constant *GetStatePointer(void) {
   return state_ptr;
 }
 
-// Return the address of the base of the TLS data.
-llvm::Value *GetTLSBaseAddress(llvm::IRBuilder<> &ir) {
-  enum {
-    kGSAddressSpace = 256U,
-    kFSAddressSpace = 257U,
+namespace {
+
+enum : unsigned {
+  kGSAddressSpace = 256U,
+  kFSAddressSpace = 257U
+};
+
+enum : uint64_t {
+  // From inside of the TEB.
+  kWin32TLSPointerIndex = 0x2c,
+  kWin64TLSPointerIndex = 0x58,
+
+  // `NT_TIB::Self` of the TEB.
+  kWin32TEBSelfIndex = 0x18,
+  kWin64TEBSelfIndex = 0x30,
+
+  // `tcbhead_t::tcb` of glibc, also followed by musl and bionic.
+  kLinuxTCBSelfIndex = 0
+};
+
+// Figure out whether the segment in `addr_space` is the one the OS uses for
+// thread-local storage, and if so, where the segment keeps a pointer to
+// itself.
+static bool GetSegmentSelfIndex(unsigned addr_space, uint64_t *index) {
+  if (gArch->IsAMD64()) {
+    if (remill::kOSLinux == gArch->os_name && kFSAddressSpace == addr_space) {
+      *index = kLinuxTCBSelfIndex;
+      return true;
+    } else if (remill::kOSWindows == gArch->os_name &&
+               kGSAddressSpace == addr_space) {
+      *index = kWin64TEBSelfIndex;
+      return true;
+    }
 
-    // From inside of the TEB.
-    kWin32TLSPointerIndex = 0x2c,
-    kWin64TLSPointerIndex = 0x58
-  };
+  } else if (gArch->IsX86()) {
+    if (remill::kOSLinux == gArch->os_name && kGSAddressSpace == addr_space) {
+      *index = kLinuxTCBSelfIndex;
+      return true;
+    } else if (remill::kOSWindows == gArch->os_name &&
+               kFSAddressSpace == addr_space) {
+      *index = kWin32TEBSelfIndex;
+      return true;
+    }
+  }
+  return false;
+}
 
+}  // namespace
+
+// Return the address of the base of the TLS data.
+llvm::Value *GetTLSBaseAddress(llvm::IRBuilder<> &ir) {
   if (gArch->IsAArch64()) {
 
 #if LLVM_VERSION(3, 7) >= LLVM_VERSION_NUMBER
@@ -231,4 +294,67 @@ llvm::Value *GetTLSBaseAddress(llvm::IRBuilder<> &ir) {
   return nullptr;
 }
 
+// Return the base address of the segment named by `seg_base_reg`, e.g.
+// `FS_BASE`, by reading the pointer that the segment keeps to itself, or
+// `nullptr` if the segment isn't used for thread-local storage.
+llvm::Value *GetSegmentBaseAddress(llvm::IRBuilder<> &ir,
+                                   const std::string &seg_base_reg) {
+  unsigned addr_space = 0;
+  if (seg_base_reg == "FS_BASE") {
+    addr_space = kFSAddressSpace;
+  } else if (seg_base_reg == "GS_BASE") {
+    addr_space = kGSAddressSpace;
+  }
+
+  uint64_t self_index = 0;
+  if (!addr_space || !GetSegmentSelfIndex(addr_space, &self_index)) {
+    return nullptr;
+  }
+
+  auto self_ptr = ir.CreateIntToPtr(
+      llvm::ConstantInt::get(gWordType, self_index),
+      llvm::PointerType::get(gWordType, addr_space));
+  auto self = ir.CreateLoad(self_ptr);
+
+  // The base of a thread's segment never changes, so let LLVM hoist and
+  // merge these loads.
+  self->setMetadata(llvm::LLVMContext::MD_invariant_load,
+                    llvm::MDNode::get(*gContext, llvm::None));
+  return self;
+}
+
+// If `val` is a segment base loaded by `GetSegmentBaseAddress`, then return
+// the address space of that segment, otherwise return `0`.
+unsigned GetSegmentBaseAddressSpace(llvm::Value *val) {
+  auto load = llvm::dyn_cast_or_null<llvm::LoadInst>(val);
+  if (!load || load->isVolatile()) {
+    return 0;
+  }
+
+  // On Linux, the self pointer is at index `0`, and the `inttoptr` of it
+  // folds into a null pointer in the segment's address space.
+  const auto ptr = load->getPointerOperand();
+  const auto addr_space = ptr->getType()->getPointerAddressSpace();
+  uint64_t self_index = 0;
+  if (!GetSegmentSelfIndex(addr_space, &self_index)) {
+    return 0;
+  }
+
+  if (llvm::isa<llvm::ConstantPointerNull>(ptr)) {
+    return self_index ? 0 : addr_space;
+  }
+
+  auto ce = llvm::dyn_cast<llvm::ConstantExpr>(ptr);
+  if (!ce || ce->getOpcode() != llvm::Instruction::IntToPtr) {
+    return 0;
+  }
+
+  auto index = llvm::dyn_cast<llvm::ConstantInt>(ce->getOperand(0));
+  if (!index || index->getZExtValue() != self_index) {
+    return 0;
+  }
+
+  return addr_space;
+}
+
 }  // namespace mcsema
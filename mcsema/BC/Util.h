@@ -19,6 +19,7 @@
 
 #include <cstdint>
 #include <list>
+#include <string>
 #include <vector>
 
 #include <llvm/IR/IRBuilder.h>
@@ -55,10 +56,24 @@ llvm::Constant *LiftXrefInCode(uint64_t ea);
 llvm::Constant *LiftXrefInData(const NativeSegment *cfg_seg, uint64_t ea,
                                bool cast_to_int=true);
 
+// Thread-local mode of the variables the lifter creates, which depends on
+// whether or not we are lifting into a shared library (`--pic`).
+llvm::GlobalValue::ThreadLocalMode LiftedThreadLocalMode(void);
+
 // Create a global register state pointer to pass to lifted functions.
 llvm::Constant *GetStatePointer(void);
 
 // Return the address of the base of the TLS data.
 llvm::Value *GetTLSBaseAddress(llvm::IRBuilder<> &ir);
 
+// Return the base address of the segment named by `seg_base_reg`, e.g.
+// `FS_BASE`, if the segment is used for thread-local storage. The value is
+// read from the segment itself instead of from the `State` structure.
+llvm::Value *GetSegmentBaseAddress(llvm::IRBuilder<> &ir,
+                                   const std::string &seg_base_reg);
+
+// If `val` is a segment base loaded by `GetSegmentBaseAddress`, then return
+// the address space of that segment, otherwise return `0`.
+unsigned GetSegmentBaseAddressSpace(llvm::Value *val);
+
 }  // namespace mcsema
@@ -18,6 +18,7 @@
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 
+#include <algorithm>
 #include <cctype>
 #include <iostream>
 #include <iterator>
@@ -58,6 +59,13 @@ DEFINE_bool(disable_adjacent_segment_merging, false,
             "used to test if a loop should terminate, then sometimes that "
             "pointer might be one element past the end of a segment.");
 
+DEFINE_bool(pad_segments, true,
+            "Should internal segments be padded at the front so that their "
+            "lifted variables share the page alignment of the original "
+            "segments? Disabling this makes each lifted segment exactly as big "
+            "as the original, which helps analysis engines that model every "
+            "global variable as a separately allocated object.");
+
 namespace mcsema {
 namespace {
 
@@ -105,6 +113,57 @@ static std::string LiftedSegmentName(const Segment &cfg_segment) {
   return ss.str();
 }
 
+// Recognize arrays of static constructors and destructors by the name of
+// their section, e.g. `.init_array` or `.init_array.00101`.
+static void AddInitFiniArray(NativeModule *module,
+                             const Segment &cfg_segment) {
+  static const struct {
+    const char *prefix;
+    bool is_fini;
+    bool runs_backward;
+    bool is_inverted_priority;
+  } kArrays[] = {
+    {".init_array", false, false, false},
+    {".fini_array", true, true, false},
+    {".ctors", false, true, true},
+    {".dtors", true, false, true},
+  };
+
+  llvm::StringRef name = cfg_segment.name();
+  for (const auto &arr : kArrays) {
+    auto suffix = name;
+    if (!suffix.consume_front(arr.prefix)) {
+      continue;
+    }
+
+    NativeInitFiniArray init_fini;
+    init_fini.ea = static_cast<uint64_t>(cfg_segment.ea());
+    init_fini.size = cfg_segment.data().size();
+    init_fini.is_fini = arr.is_fini;
+    init_fini.runs_backward = arr.runs_backward;
+
+    // The linker sorts `.ctors.N` and `.dtors.N` so that their priority is
+    // `65535 - N`.
+    if (!suffix.empty()) {
+      unsigned priority = 0;
+      if (!suffix.consume_front(".") || suffix.getAsInteger(10, priority) ||
+          priority > 65535) {
+        continue;
+      }
+      init_fini.priority = arr.is_inverted_priority ? 65535 - priority :
+                           priority;
+    }
+
+    LOG(INFO)
+        << "Found " << (init_fini.is_fini ? "destructor" : "constructor")
+        << " array " << name.str() << " at " << std::hex << init_fini.ea
+        << std::dec << " with priority " << init_fini.priority;
+
+    module->init_fini_arrays.push_back(init_fini);
+    return;
+  }
+}
+
 static std::string LiftedVarName(const Variable &cfg_var) {
   std::stringstream ss;
   ss << "data_" << std::hex << cfg_var.ea();
@@ -869,6 +928,7 @@ NativeModule *ReadProtoBuf(const std::string &file_name,
     segment->ea = static_cast<uint64_t>(cfg_segment->ea());
     segment->size = cfg_segment->data().size();
     segment->lifted_name = LiftedSegmentName(*cfg_segment);
+    AddInitFiniArray(module, *cfg_segment);
 
     if (cfg_segment->has_variable_name()) {
       segment->name = std::move(*(cfg_segment->mutable_variable_name()));
@@ -945,6 +1005,11 @@ NativeModule *ReadProtoBuf(const std::string &file_name,
     seg_ptr = segment;
   }
 
+  std::sort(module->init_fini_arrays.begin(), module->init_fini_arrays.end(),
+            [] (const NativeInitFiniArray &a, const NativeInitFiniArray &b) {
+              return a.ea < b.ea;
+            });
+
   // Fill in the cross-reference entries for each segment.
   for (const auto &cfg_segment : cfg.segments()) {
     auto ea = static_cast<uint64_t>(cfg_segment.ea());
@@ -1424,7 +1489,7 @@ NativeModule *ReadProtoBuf(const std::string &file_name,
   }
 
   for (auto &seg : module->segments) {
-    if (!seg->is_external) {
+    if (!seg->is_external && FLAGS_pad_segments) {
       seg->padding = seg->ea & 4095u;
     }
 
@@ -328,6 +328,23 @@ struct NativeSegment : public NativeObject {
   llvm::Constant *Address(void) const override;
 };
 
+// An array of pointers to static constructors or destructors, e.g.
+// `.init_array` or `.dtors.00100`. These are remembered when the CFG is
+// loaded, because adjacent segment merging loses the section names.
+struct NativeInitFiniArray {
+  uint64_t ea{0};
+  uint64_t size{0};
+
+  // Priority encoded in the section name, `65535` if there is none.
+  uint32_t priority{65535};
+
+  // Whether this holds destructors (`.fini_array`, `.dtors`).
+  bool is_fini{false};
+
+  // Whether the entries run from last to first (`.ctors`, `.fini_array`).
+  bool runs_backward{false};
+};
+
 struct NativeModule : anvill::Program {
 
   std::unordered_set<uint64_t> exported_vars;
@@ -346,6 +363,9 @@ struct NativeModule : anvill::Program {
   std::vector<std::unique_ptr<NativeSegment>> segments;
   std::vector<std::unique_ptr<NativeSegment>> unused_segments;
 
+  // Constructor and destructor arrays, in the order of their addresses.
+  std::vector<NativeInitFiniArray> init_fini_arrays;
+
   // All known basic blocks.
   std::unordered_map<uint64_t, std::unique_ptr<NativeBlock>> ea_to_block;
 
@@ -27,10 +27,11 @@ cxx_comp = 'clang++'
 cc_comp = 'clang'
 
 class Config:
-    allowed = ['TAGS', 'CC_OPTS', 'LD_OPTS', 'LIFT_OPTS', 'TEST']
+    allowed = ['TAGS', 'CC_OPTS', 'LD_OPTS', 'LIFT_OPTS', 'IR_CHECK', 'TEST']
 
     def __init__(self, filename):
         self.lift_opts = []
+        self.ir_checks = []
         self.tests = []
         self.cc_opts = []
         self.ld_opts = []
@@ -47,6 +48,9 @@ class Config:
     def _lift_opts(self, opts):
         self.lift_opts.append((opts[1], opts[2:]))
 
+    def _ir_check(self, opts):
+        self.ir_checks.append((opts[1], ' '.join(opts[2:])))
+
     def _tags(self, opts):
         self.tags = opts[1:]
 
@@ -80,6 +84,7 @@ class Config:
                         'CC_OPTS:' : Config._cc_opts,
                         'LD_OPTS:' : Config._ld_opts,
                         'LIFT_OPTS:' : Config._lift_opts,
+                        'IR_CHECK:' : Config._ir_check,
                         'TEST:' : Config._test,
                         'STDIN:' : Config._stdin,
                 }
@@ -92,6 +97,9 @@ class Config:
         with open(os.path.join(dst_dir, self.name + '.' + name + '.config'), 'w') as cfg:
             cfg.write("TAGS: " + ' '.join(self.tags) + '\n')
             cfg.write("LIFT_OPTS: " + ' '.join(opts) + '\n')
+            for kind, check in self.ir_checks:
+                if kind == name:
+                    cfg.write("IR_CHECK: " + check + '\n')
 
     def create_test(self, dst_dir):
         with open(os.path.join(dst_dir, self.name + '.test'), 'w') as test:
@@ -18,6 +18,7 @@
 import argparse
 import difflib
 import filecmp
+import glob
 import operator
 import os
 import queue
@@ -176,6 +177,7 @@ class Config:
         self.id = self.name + '.' + self.config
         self.cfg = cfg_path
         self.lift_args = []
+        self.ir_checks = []
         self.exclude_args = []
         self.tags = []
         self._fix_excludes()
@@ -207,6 +209,9 @@ class Config:
             self.lift_args += val
 
 
+    def _ir_check(self, line):
+        self.ir_checks.append(line.split(' ', 1)[1])
+
     def _parse_config(self, src):
         print(' > Parsing', src)
         with open(os.path.join(tags_dir, src), 'r') as cfg:
@@ -217,6 +222,7 @@ class Config:
                 header_dispatch = {
                     'TAGS:' : Config._tags,
                     'LIFT_OPTS:' : Config._lift_opts,
+                    'IR_CHECK:' : Config._ir_check,
                 }
 
                 if header not in header_dispatch:
@@ -229,14 +235,48 @@ class Config:
         self.bc = os.path.join(test_dir, '.'.join([self.name, self.config, 'bc']))
         self.recompiled = os.path.join(test_dir, self.name + '.' + self.config)
 
-        args = [lift] + self.defaults + self.lift_args + \
+        # Streamed shards go next to the bitcode, and are linked with it
+        lift_args = list(self.lift_args)
+        self.stream_dir = None
+        if '--stream_dir' in lift_args:
+            self.stream_dir = os.path.join(
+                test_dir, '.'.join([self.name, self.config, 'shards']))
+            lift_args[lift_args.index('--stream_dir') + 1] = self.stream_dir
+
+        args = [lift] + self.defaults + lift_args + \
                ['-output', self.bc, '-cfg', self.cfg]
         print(args)
         if not exec_and_log_fail(args):
             return Config.Result.LIFT_FAIL
 
+        if not self.check_ir():
+            return Config.Result.LIFT_FAIL
+
         return self.recompile()
 
+    # Each check is a piece of text that must be in the disassembled bitcode,
+    # or, prefixed by `!`, must not be
+    def check_ir(self):
+        if not self.ir_checks:
+            return True
+
+        args = ["llvm-dis-{}".format(llvm_version), self.bc, '-o', '-']
+        try:
+            ir = subprocess.check_output(args).decode()
+        except CalledProcessError as e:
+            print(" > Cannot disassemble", self.bc)
+            return False
+
+        correct = True
+        for check in self.ir_checks:
+            if check.startswith('!') and check[1:] in ir:
+                print(" > IR_CHECK failed, found:", check[1:])
+                correct = False
+            elif not check.startswith('!') and check not in ir:
+                print(" > IR_CHECK failed, missing:", check)
+                correct = False
+        return correct
+
     def recompile(self):
         compiler = None
         if 'c' in self.tags:
@@ -249,7 +289,14 @@ class Config:
             return Config.Result.RECOMPILE_FAIL
 
         compiler = compiler.format(llvm_version)
-        args = [compiler, self.bc, '-o', self.recompiled, \
+        shards = []
+        if self.stream_dir is not None:
+            shards = sorted(glob.glob(os.path.join(self.stream_dir, '*.bc')))
+            if not shards:
+                print(" > No shards were streamed into", self.stream_dir)
+                return Config.Result.LIFT_FAIL
+
+        args = [compiler, self.bc] + shards + ['-o', self.recompiled, \
                 libmcsema, '-lpthread', '-lm', '-ldl'] + shared_libs
 
         if not exec_and_log_fail(args):
@@ -0,0 +1,60 @@
+/* TAGS: min c liveness */
+/* LIFT_OPTS: default */
+/* LD_OPTS: -lm */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Floating point code around calls. The Dyninst frontend reports the
+ * caller-saved `XMM` registers, general purpose registers and flags that are
+ * dead at these calls and returns, and the lifter kills them. */
+
+#include <math.h>
+#include <stdio.h>
+
+__attribute__((noinline))
+static double scale(double x, double y) {
+    return x * y + 0.5;
+}
+
+__attribute__((noinline))
+static double norm(const double *v, int n) {
+    double sum = 0.0;
+    int i;
+    for (i = 0; i < n; ++i) {
+        sum += scale(v[i], v[i]) - 0.5;
+    }
+    return sqrt(sum);
+}
+
+__attribute__((noinline))
+static long mix(long a, long b) {
+    return a < b ? (a ^ (b << 3)) : (b - a);
+}
+
+int main(void)
+{
+    double v[] = {1.5, -2.25, 3.0, 0.125, 4.75};
+    long acc = 1;
+    int i;
+
+    printf("norm: %.6f\n", norm(v, 5));
+    for (i = 0; i < 5; ++i) {
+        printf("scale %d: %.6f\n", i, scale(v[i], (double) i));
+        acc = mix(acc, (long) (v[i] * 16.0));
+    }
+    printf("mix: %ld\n", acc);
+    return 0;
+}
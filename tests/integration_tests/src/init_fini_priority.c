@@ -0,0 +1,54 @@
+/* TAGS: min c */
+/* LIFT_OPTS: explicit +--explicit_args +--explicit_args_count 8 */
+/* LIFT_OPTS: default */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Several constructors and destructors for each of a few priorities. The
+ * lifter calls all of the functions of one priority from a single entry in
+ * `llvm.global_ctors` or `llvm.global_dtors`, which must keep their order. */
+
+#include <stdio.h>
+
+static char order[32];
+static int num_calls = 0;
+
+static void record(char c) {
+    order[num_calls++] = c;
+}
+
+__attribute__((constructor(102))) static void ctor_102_a(void) { record('c'); }
+__attribute__((constructor(101))) static void ctor_101_a(void) { record('a'); }
+__attribute__((constructor)) static void ctor_a(void) { record('e'); }
+__attribute__((constructor(102))) static void ctor_102_b(void) { record('d'); }
+__attribute__((constructor(101))) static void ctor_101_b(void) { record('b'); }
+__attribute__((constructor)) static void ctor_b(void) { record('f'); }
+
+__attribute__((destructor(101))) static void dtor_101(void) {
+    record('Z');
+    order[num_calls] = '\0';
+    printf("destructors: %s\n", order);
+}
+__attribute__((destructor(102))) static void dtor_102(void) { record('Y'); }
+__attribute__((destructor)) static void dtor(void) { record('X'); }
+
+int main(void)
+{
+    order[num_calls] = '\0';
+    printf("constructors: %s\n", order);
+    num_calls = 0;
+    return 0;
+}
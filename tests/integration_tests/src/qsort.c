@@ -1,6 +1,7 @@
 /* TAGS: min c */
 /* LIFT_OPTS: explicit +--explicit_args +--explicit_args_count 8 */
 /* LIFT_OPTS: default */
+/* LIFT_OPTS: stream +--stream_dir +shards +--stream_memory_budget +0 */
 /*
  * Copyright (c) 2018 Trail of Bits, Inc.
  *
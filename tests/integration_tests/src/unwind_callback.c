@@ -0,0 +1,87 @@
+/* TAGS: min c */
+/* LD_OPTS: -ldl */
+/* LIFT_OPTS: frame_pointers +--frame_pointers */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Unwinds the stack from a `qsort` comparator. Once recompiled, the stack
+ * goes through `__remill_function_call` into `qsort`, back into lifted code
+ * through `__mcsema_attach_call`, and again out through
+ * `__remill_function_call` into the unwinder, whose caller is
+ * `__mcsema_attach_ret`. The unwinder has to get through all of them to see
+ * both `qsort` and the code in libc that called `main`. */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unwind.h>
+
+static int in_libc = 0;
+static int libc_runs = 0;
+static int num_frames = 0;
+static int unwound = 0;
+
+static _Unwind_Reason_Code visit_frame(struct _Unwind_Context *ctx,
+                                       void *arg) {
+  Dl_info info;
+  void *ip = (void *) _Unwind_GetIP(ctx);
+  int is_libc = 0;
+  (void) arg;
+
+  if (++num_frames > 256) {
+    return _URC_END_OF_STACK;
+  }
+
+  if (ip && dladdr(ip, &info) && info.dli_fname) {
+    is_libc = strstr(info.dli_fname, "libc.so") != NULL;
+  }
+
+  /* One run of libc frames for `qsort`, and one for `__libc_start_main`. */
+  if (is_libc && !in_libc) {
+    ++libc_runs;
+  }
+  in_libc = is_libc;
+  return _URC_NO_REASON;
+}
+
+static int compare(const void *a, const void *b) {
+  int lhs = *(const int *) a;
+  int rhs = *(const int *) b;
+  if (!unwound) {
+    unwound = 1;
+    _Unwind_Backtrace(visit_frame, NULL);
+  }
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+int main(void) {
+  int arr[] = {12, -2, 8, 5, 10, 6};
+  int size = sizeof arr / sizeof *arr;
+  int i;
+
+  qsort(arr, size, sizeof(int), compare);
+
+  printf("Sorted:");
+  for (i = 0; i < size; ++i) {
+    printf(" %d", arr[i]);
+  }
+  printf("\n");
+  printf("Unwound through qsort into the caller of main: %s\n",
+         libc_runs >= 2 ? "yes" : "no");
+  return 0;
+}
@@ -0,0 +1,73 @@
+/* TAGS: min cpp */
+/* LIFT_OPTS: explicit +--explicit_args +--explicit_args_count 8 */
+/* LIFT_OPTS: default */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Virtual calls through a virtual table slot that holds the same method in
+ * every class (`kind`), and through one that holds a different method in
+ * each class (`area`). With `--devirtualize_vtables`, both become direct
+ * calls of the lifted methods. */
+
+#include <cstdio>
+
+struct Shape {
+    explicit Shape(int size_) : size(size_) {}
+    virtual ~Shape(void) {}
+    virtual const char *kind(void) const { return "shape"; }
+    virtual int area(void) const = 0;
+
+    int size;
+};
+
+struct Square : public Shape {
+    explicit Square(int size_) : Shape(size_) {}
+    int area(void) const override { return size * size; }
+};
+
+struct Rect : public Shape {
+    Rect(int size_, int width_) : Shape(size_), width(width_) {}
+    int area(void) const override { return size * width; }
+
+    int width;
+};
+
+struct Triangle : public Shape {
+    explicit Triangle(int size_) : Shape(size_) {}
+    int area(void) const override { return size * size / 2; }
+};
+
+__attribute__((noinline))
+static void describe(const Shape &shape) {
+    std::printf("%s of size %d with area %d\n", shape.kind(), shape.size,
+                shape.area());
+}
+
+int main(void)
+{
+    Square square(3);
+    Rect rect(4, 7);
+    Triangle triangle(5);
+    const Shape *shapes[] = {&square, &rect, &triangle, &rect, &square};
+
+    int total = 0;
+    for (auto shape : shapes) {
+        describe(*shape);
+        total += shape->area();
+    }
+    std::printf("total area: %d\n", total);
+    return 0;
+}
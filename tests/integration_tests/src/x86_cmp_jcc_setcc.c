@@ -0,0 +1,120 @@
+/* TAGS: min c */
+/* LIFT_OPTS: explicit +--explicit_args +--explicit_args_count 8 */
+/* LIFT_OPTS: default */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+static int cmp_jl(int a, int b) {
+    int r;
+    __asm__ __volatile__ ( "cmp %2, %1\n"
+                           "jl 1f\n"
+                           "mov $0, %0\n"
+                           "jmp 2f\n"
+                           "1:\n"
+                           "mov $1, %0\n"
+                           "2:\n"
+                           : "=&r"(r) : "r"(a), "r"(b) : "cc");
+    return r;
+}
+
+static int cmp_setg(int a, int b) {
+    unsigned char r;
+    __asm__ __volatile__ ( "cmp %2, %1\n"
+                           "setg %0\n"
+                           : "=q"(r) : "r"(a), "r"(b) : "cc");
+    return r;
+}
+
+static int test_setz(int a, int b) {
+    unsigned char r;
+    __asm__ __volatile__ ( "test %2, %1\n"
+                           "setz %0\n"
+                           : "=q"(r) : "r"(a), "r"(b) : "cc");
+    return r;
+}
+
+/* The other bytes of the register must survive. */
+static unsigned int cmp_setg_low(int a, int b, unsigned int dst) {
+    __asm__ __volatile__ ( "cmp %2, %1\n"
+                           "setg %b0\n"
+                           : "+q"(dst) : "r"(a), "r"(b) : "cc");
+    return dst;
+}
+
+static unsigned int cmp_setg_ah(int a, int b, unsigned int dst) {
+    __asm__ __volatile__ ( "cmp %2, %1\n"
+                           "setg %%ah\n"
+                           : "+a"(dst) : "r"(a), "r"(b) : "cc");
+    return dst;
+}
+
+/* The upper 16 bits of the destination must survive. */
+static unsigned int cmp_cmovl_16(int a, int b, unsigned int dst,
+                                 unsigned int src) {
+    __asm__ __volatile__ ( "cmp %2, %1\n"
+                           "cmovl %w3, %w0\n"
+                           : "+r"(dst) : "r"(a), "r"(b), "r"(src) : "cc");
+    return dst;
+}
+
+static unsigned int cmp_cmovl_32(int a, int b, unsigned int dst,
+                                 unsigned int src) {
+    __asm__ __volatile__ ( "cmp %2, %1\n"
+                           "cmovl %3, %0\n"
+                           : "+r"(dst) : "r"(a), "r"(b), "r"(src) : "cc");
+    return dst;
+}
+
+#if defined(__x86_64__)
+/* A 32-bit `cmov` clears the upper half even if it doesn't move. */
+static unsigned long cmp_cmovl_32_zext(int a, int b, unsigned long dst,
+                                       unsigned long src) {
+    __asm__ __volatile__ ( "cmp %k2, %k1\n"
+                           "cmovl %k3, %k0\n"
+                           : "+r"(dst) : "r"(a), "r"(b), "r"(src) : "cc");
+    return dst;
+}
+#endif
+
+int main(void)
+{
+    static const int vals[] = {-5, -1, 0, 1, 7, 0x7fffffff, -0x7fffffff - 1};
+    const int num_vals = sizeof(vals) / sizeof(vals[0]);
+    int i, j;
+
+    for (i = 0; i < num_vals; ++i) {
+        for (j = 0; j < num_vals; ++j) {
+            int a = vals[i];
+            int b = vals[j];
+            printf("%d %d: jl=%d setg=%d setz=%d setg8=%08x setgh=%08x "
+                   "cmovl16=%08x cmovl32=%08x\n",
+                   a, b, cmp_jl(a, b), cmp_setg(a, b), test_setz(a, b),
+                   cmp_setg_low(a, b, 0xaaaa55ffu),
+                   cmp_setg_ah(a, b, 0xaaaaff55u),
+                   cmp_cmovl_16(a, b, 0xaaaa5555u, 0x1234u),
+                   cmp_cmovl_32(a, b, 0xaaaa5555u, 0x12345678u));
+        }
+    }
+
+#if defined(__x86_64__)
+    printf("cmovl32 zext: %016lx %016lx\n",
+           cmp_cmovl_32_zext(1, 2, 0xffffffff00000001ul, 2ul),
+           cmp_cmovl_32_zext(2, 1, 0xffffffff00000001ul, 2ul));
+#endif
+    return 0;
+}
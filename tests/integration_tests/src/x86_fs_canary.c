@@ -0,0 +1,55 @@
+/* TAGS: min c */
+/* CC_OPTS: -fstack-protector-all */
+/* LIFT_OPTS: default */
+/* IR_CHECK: default addrspace(257)* inttoptr (i64 40 to */
+/* IR_CHECK: default !addrspace(257)* null */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Reads the stack protector canary at `fs:[0x28]`, both explicitly and
+ * through the compiler's stack protector. The lifter should turn each read
+ * into a single load from the `FS` address space, without first loading the
+ * thread pointer from `fs:[0]`. */
+
+#include <stdio.h>
+#include <string.h>
+
+__attribute__((noinline))
+static unsigned long read_canary(void) {
+    unsigned long canary;
+    __asm__ __volatile__ ( "mov %%fs:0x28, %0" : "=r"(canary));
+    return canary;
+}
+
+__attribute__((noinline))
+static int fill(char *buf, int n) {
+    char tmp[32];
+    memset(tmp, 'a', sizeof(tmp));
+    memcpy(buf, tmp, n);
+    return n;
+}
+
+int main(void)
+{
+    char buf[16];
+    unsigned long first = read_canary();
+    unsigned long second = read_canary();
+
+    printf("canary set: %s\n", first ? "yes" : "no");
+    printf("canary stable: %s\n", first == second ? "yes" : "no");
+    printf("filled: %d\n", fill(buf, (int) sizeof(buf)));
+    return 0;
+}
@@ -0,0 +1,87 @@
+/* TAGS: min c */
+/* LIFT_OPTS: explicit +--explicit_args +--explicit_args_count 8 */
+/* LIFT_OPTS: default */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+static void rep_movsb(void *dst, const void *src, unsigned long n) {
+    __asm__ __volatile__ ( "rep movsb"
+                           : "+D"(dst), "+S"(src), "+c"(n)
+                           :
+                           : "memory");
+}
+
+static void rep_stosb(void *dst, unsigned char val, unsigned long n) {
+    __asm__ __volatile__ ( "rep stosb"
+                           : "+D"(dst), "+c"(n)
+                           : "a"(val)
+                           : "memory");
+}
+
+static void rep_stosd(void *dst, unsigned int val, unsigned long n) {
+    __asm__ __volatile__ ( "rep stosl"
+                           : "+D"(dst), "+c"(n)
+                           : "a"(val)
+                           : "memory");
+}
+
+static void print_bytes(const char *what, const unsigned char *buf,
+                        unsigned long n) {
+    unsigned long i;
+    printf("%s:", what);
+    for (i = 0; i < n; ++i) {
+        printf(" %02x", buf[i]);
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    unsigned char buf[32];
+    unsigned int words[4];
+    unsigned long i;
+
+    for (i = 0; i < sizeof(buf); ++i) {
+        buf[i] = (unsigned char) i;
+    }
+
+    /* Disjoint copy. */
+    rep_movsb(&buf[16], &buf[0], 8);
+    print_bytes("movsb", buf, sizeof(buf));
+
+    /* Destination inside the source: replicates the first three bytes. */
+    rep_movsb(&buf[3], &buf[0], 12);
+    print_bytes("movsb overlap", buf, sizeof(buf));
+
+    /* Zero count leaves the buffer alone. */
+    rep_movsb(&buf[0], &buf[16], 0);
+    print_bytes("movsb zero", buf, sizeof(buf));
+
+    rep_stosb(&buf[4], 0xab, 20);
+    print_bytes("stosb", buf, sizeof(buf));
+
+    /* A repeated byte, and a value whose bytes differ. */
+    rep_stosd(words, 0x5a5a5a5a, 4);
+    printf("stosd splat: %08x %08x %08x %08x\n",
+           words[0], words[1], words[2], words[3]);
+    rep_stosd(words, 0x12345678, 3);
+    printf("stosd: %08x %08x %08x %08x\n",
+           words[0], words[1], words[2], words[3]);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/* TAGS: min c */
+/* LIFT_OPTS: explicit +--explicit_args +--explicit_args_count 8 */
+/* LIFT_OPTS: default */
+/* IR_CHECK: default fadd <4 x float> */
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* SSE loads, additions and stores, which are lifted one lane at a time, and
+ * which `--recover_vector_ops` turns back into vector operations. Lanes that
+ * overlap another access in between must not be merged across it, and
+ * misaligned accesses must stay misaligned. */
+
+#include <stdio.h>
+#include <string.h>
+
+/* `dst[i] = a[i] + b[i]`, four floats at a time. */
+static void add_ps(float *dst, const float *a, const float *b, int n) {
+    int i;
+    for (i = 0; i < n; i += 4) {
+        __asm__ __volatile__ ( "movups (%1), %%xmm0\n"
+                               "movups (%2), %%xmm1\n"
+                               "addps %%xmm1, %%xmm0\n"
+                               "movups %%xmm0, (%0)\n"
+                               :
+                               : "r"(&dst[i]), "r"(&a[i]), "r"(&b[i])
+                               : "xmm0", "xmm1", "memory");
+    }
+}
+
+/* Stores `v + v` to `p`, then reads it back one float further on, which
+ * overlaps three lanes of the store, and stores that plus `v` after it. */
+static void add_ps_overlap(float *p, const float *v) {
+    __asm__ __volatile__ ( "movups (%1), %%xmm0\n"
+                           "movaps %%xmm0, %%xmm1\n"
+                           "addps %%xmm0, %%xmm0\n"
+                           "movups %%xmm0, (%0)\n"
+                           "movups 4(%0), %%xmm2\n"
+                           "addps %%xmm1, %%xmm2\n"
+                           "movups %%xmm2, 16(%0)\n"
+                           :
+                           : "r"(p), "r"(v)
+                           : "xmm0", "xmm1", "xmm2", "memory");
+}
+
+static void print_floats(const char *what, const float *vals, int n) {
+    int i;
+    printf("%s:", what);
+    for (i = 0; i < n; ++i) {
+        printf(" %g", vals[i]);
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    float a[16], b[16], dst[16], buf[12];
+    unsigned char bytes[80];
+    float tmp[16];
+    int i;
+
+    for (i = 0; i < 16; ++i) {
+        a[i] = (float) i + 0.5f;
+        b[i] = (float) (i * i) - 3.0f;
+    }
+
+    add_ps(dst, a, b, 16);
+    print_floats("addps", dst, 16);
+
+    /* The destination is the first source shifted by one float, so each
+     * iteration reads lanes that the previous one wrote. */
+    memcpy(tmp, a, sizeof(a));
+    add_ps(&tmp[1], tmp, b, 12);
+    print_floats("addps alias", tmp, 16);
+
+    /* In place. */
+    memcpy(tmp, a, sizeof(a));
+    add_ps(tmp, tmp, tmp, 16);
+    print_floats("addps in place", tmp, 16);
+
+    /* Misaligned by three bytes. */
+    memset(bytes, 0, sizeof(bytes));
+    memcpy(&bytes[3], a, 8 * sizeof(float));
+    memcpy(&bytes[35], b, 8 * sizeof(float));
+    add_ps((float *) &bytes[3], (const float *) &bytes[3],
+           (const float *) &bytes[35], 8);
+    memcpy(tmp, &bytes[3], 8 * sizeof(float));
+    print_floats("addps misaligned", tmp, 8);
+
+    for (i = 0; i < 12; ++i) {
+        buf[i] = -1.0f;
+    }
+    add_ps_overlap(buf, b);
+    print_floats("addps overlap", buf, 12);
+    return 0;
+}
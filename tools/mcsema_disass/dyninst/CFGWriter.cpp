@@ -209,7 +209,8 @@ CFGWriter::CFGWriter(mcsema::Module &m,
       code_object(code_obj),
       ext_funcs_m(ext_funcs),
       magic_section(ctx.magic_section),
-      ptr_byte_size(symtab.getAddressWidth()){
+      ptr_byte_size(symtab.getAddressWidth()),
+      reg_facts(m, symtab.getAddressWidth()) {
 
   LOG(INFO) << "Binary is stripped: " << symtab.isStripped();
   LOG(INFO) << "Pie_mode: " << FLAGS_pie_mode;
@@ -324,38 +325,25 @@ void CFGWriter::Write() {
 
   //Handle new functions found via various xrefs, mostly in stripped binary
   LOG(INFO) << code_xrefs_to_resolve.size() << " code xrefs is unresolved!";
+  std::set<Address> targets;
   for (auto &a : code_xrefs_to_resolve) {
     ctx.WriteAndAccount(a.second, true);
-    code_object.parse(a.first, true);
+    targets.insert(a.first);
   }
 
-  for (auto func : code_object.funcs()) {
-    auto code_xref = code_xrefs_to_resolve.find(func->addr());
-    if (code_xref != code_xrefs_to_resolve.end() &&
-        !ctx.getInternalFunction(func->addr())) {
-
-      auto cfg_internal_func = module.add_funcs();
-      WriteFunction(func, cfg_internal_func);
-    }
-  }
+  // Each newly written function can reference code we have not seen yet,
+  // so we need to try until fixpoint
+  while (!targets.empty()) {
+    ParseTargets(targets);
+    WriteNewFunctions();
 
-  // In case we discovered some new ones, we need to try until fixpoint
-  while (!inst_xrefs_to_resolve.empty()) {
-    LOG(WARNING) << inst_xrefs_to_resolve.size()
-                 << " inst code xrefs is unresolved!";
+    targets.clear();
     for (auto &a : inst_xrefs_to_resolve) {
-      code_object.parse(a.first, false);
-    }
-
-    auto old_set = std::move(inst_xrefs_to_resolve);
-    for (auto func : code_object.funcs()) {
-      if (old_set.find(func->addr()) != old_set.end() &&
-          !ctx.getInternalFunction(func->addr())) {
-
-        auto cfg_internal_func = module.add_funcs();
-        WriteFunction(func, cfg_internal_func);
-      }
+      targets.insert(a.first);
     }
+    inst_xrefs_to_resolve.clear();
+    targets.insert(unresolved_succs.begin(), unresolved_succs.end());
+    unresolved_succs.clear();
   }
 
   module.set_name(FLAGS_binary);
@@ -510,6 +498,8 @@ void CFGWriter::WriteInternalFunctions() {
 void CFGWriter::WriteFunctionBlocks(ParseAPI::Function *func,
                                     mcsema::Function *cfg_internal_func) {
 
+    reg_facts.WriteFunctionPreservedRegs(func);
+
     std::set<ParseAPI::Block *> written;
     std::set<Address> unknown;
     for (ParseAPI::Block *block : func->blocks()) {
@@ -533,12 +523,43 @@ void CFGWriter::WriteFunctionBlocks(ParseAPI::Function *func,
       for (const auto trg: unknown) {
         targets << std::hex << trg << " ";
       }
-      LOG(ERROR)
+      LOG(WARNING)
         << "Unresolved succ of bb was not match to a func: " << std::hex
         << func->addr() << "[ " << targets.str() << " ]";
+
+      // Most likely a tail call into function ParseAPI did not find yet
+      unresolved_succs.insert(unknown.begin(), unknown.end());
     }
 }
 
+// Ask ParseAPI for functions starting at addresses that something we already
+// lifted points to. This is the targeted alternative to parseGaps, every
+// address is tried at most once so the fixpoint in Write() terminates.
+void CFGWriter::ParseTargets(const std::set<Address> &targets) {
+  for (auto target : targets) {
+    if (ctx.getInternalFunction(target) || !section_m.IsCode(target) ||
+        !parsed_targets.insert(target).second) {
+      continue;
+    }
+    LOG(INFO) << "Parsing new function at 0x" << std::hex << target;
+    code_object.parse(target, true);
+  }
+}
+
+// Write every function ParseAPI knows about that is not in the module yet.
+// Parsing is recursive, so this includes the callees of parsed targets as well.
+void CFGWriter::WriteNewFunctions() {
+  for (auto func : code_object.funcs()) {
+    if (ctx.getInternalFunction(func->addr()) ||
+        IsExternal(func->entry()->start()) ||
+        section_m.IsInRegions({".got.plt", "plt.got"},
+                              func->entry()->start())) {
+      continue;
+    }
+    WriteFunction(func, module.add_funcs());
+  }
+}
+
 std::set<Address>
 CFGWriter::WriteBlock(ParseAPI::Block *block, ParseAPI::Function *func,
                       mcsema::Function *cfg_internal_func,
@@ -625,10 +646,52 @@ CFGWriter::WriteBlock(ParseAPI::Block *block, ParseAPI::Function *func,
     ip += instruction->size();
   }
 
+  auto last = std::prev(instructions.end());
+  WriteRegisterFacts(block, func, last->first, last->second);
+
   ResolveOffsetTable(successors, cfg_block, offset_tables);
   return unresolved_edges;
 }
 
+// Calls and returns end their blocks, so this is the only place where we
+// need to look for them
+void CFGWriter::WriteRegisterFacts(
+    ParseAPI::Block *block, ParseAPI::Function *func, Address addr,
+    const InstructionAPI::Instruction::Ptr &instruction) {
+
+  auto category = instruction->getCategory();
+  if (category == InstructionAPI::c_ReturnInsn) {
+    reg_facts.WriteDeadRegs(func, block, addr, instruction);
+    return;
+  }
+
+  if (category != InstructionAPI::c_CallInsn) {
+    return;
+  }
+  reg_facts.WriteDeadRegs(func, block, addr, instruction);
+
+  for (auto edge : block->targets()) {
+    if (edge->type() != ParseAPI::EdgeTypeEnum::CALL || edge->sinkEdge()) {
+      continue;
+    }
+
+    auto target = edge->trg()->start();
+    if (IsExternal(target)) {
+      reg_facts.WriteCallPreservedRegs(addr, nullptr);
+      return;
+    }
+
+    std::vector<ParseAPI::Function *> callees;
+    edge->trg()->getFuncs(callees);
+    for (auto callee : callees) {
+      if (callee->addr() == target) {
+        reg_facts.WriteCallPreservedRegs(addr, callee);
+        return;
+      }
+    }
+  }
+}
+
 void CFGWriter::WriteInstruction(InstructionAPI::Instruction *instruction,
                                  Address addr, mcsema::Block *cfg_block,
                                  bool is_last) {
@@ -22,6 +22,7 @@
 #include "MagicSection.h"
 #include "Util.h"
 #include "OffsetTable.h"
+#include "Liveness.h"
 
 #include <CFG.pb.h>
 #include <CodeObject.h>
@@ -66,6 +67,12 @@ private:
       mcsema::Function *cfg_internal_func,
       std::set<Dyninst::ParseAPI::Block *> &written);
 
+  void WriteRegisterFacts(
+      Dyninst::ParseAPI::Block *block,
+      Dyninst::ParseAPI::Function *func,
+      Dyninst::Address addr,
+      const Dyninst::InstructionAPI::Instruction::Ptr &instruction);
+
   void WriteInstruction(Dyninst::InstructionAPI::Instruction *instruction,
                         Dyninst::Address addr, mcsema::Block *cfgBlock,
                         bool is_last=false);
@@ -82,6 +89,8 @@ private:
 
   void WriteFunction(Dyninst::ParseAPI::Function *func,
                      mcsema::Function *cfg_internal_func);
+  void ParseTargets(const std::set<Dyninst::Address> &targets);
+  void WriteNewFunctions();
 
   void WriteExternalFunctions();
   void WriteInternalData();
@@ -113,10 +122,15 @@ private:
   std::map<Dyninst::Address, CrossXref<mcsema::Segment>> code_xrefs_to_resolve;
   std::map<Dyninst::Address, CrossXref<mcsema::Instruction>> inst_xrefs_to_resolve;
 
+  // Targets of direct jumps that leave a function but do not hit any known one
+  std::set<Dyninst::Address> unresolved_succs;
+  std::set<Dyninst::Address> parsed_targets;
+
   std::vector<OffsetTable> offset_tables;
 
   // magic_section is handle into ctx, needs to be initialized in this order
   DisassContext ctx;
   MagicSection &magic_section;
   int ptr_byte_size = 8;
+  RegisterFacts reg_facts;
 };
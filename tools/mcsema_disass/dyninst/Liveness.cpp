@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Liveness.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+
+#include <dyn_regs.h>
+#include <entryIDs.h>
+#include <InstructionCategories.h>
+#include <Location.h>
+#include <Register.h>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+DECLARE_bool(register_liveness);
+
+using namespace Dyninst;
+
+namespace {
+
+using RegList = std::vector<std::pair<MachRegister, std::string>>;
+
+// Registers the lifter is allowed to kill, named the way remill names them.
+// RSP and RIP are never dead. Neither is DF: the ABI guarantees that it is
+// clear at calls and returns, and string instructions rely on that without
+// anything ever writing it.
+static const RegList &KillableRegs() {
+  static const RegList regs = {
+    {x86_64::rax, "RAX"}, {x86_64::rbx, "RBX"}, {x86_64::rcx, "RCX"},
+    {x86_64::rdx, "RDX"}, {x86_64::rsi, "RSI"}, {x86_64::rdi, "RDI"},
+    {x86_64::rbp, "RBP"}, {x86_64::r8, "R8"}, {x86_64::r9, "R9"},
+    {x86_64::r10, "R10"}, {x86_64::r11, "R11"}, {x86_64::r12, "R12"},
+    {x86_64::r13, "R13"}, {x86_64::r14, "R14"}, {x86_64::r15, "R15"},
+
+    {x86_64::cf, "CF"}, {x86_64::pf, "PF"}, {x86_64::af, "AF"},
+    {x86_64::zf, "ZF"}, {x86_64::sf, "SF"}, {x86_64::of, "OF"},
+
+    {x86_64::xmm0, "XMM0"}, {x86_64::xmm1, "XMM1"}, {x86_64::xmm2, "XMM2"},
+    {x86_64::xmm3, "XMM3"}, {x86_64::xmm4, "XMM4"}, {x86_64::xmm5, "XMM5"},
+    {x86_64::xmm6, "XMM6"}, {x86_64::xmm7, "XMM7"}, {x86_64::xmm8, "XMM8"},
+    {x86_64::xmm9, "XMM9"}, {x86_64::xmm10, "XMM10"},
+    {x86_64::xmm11, "XMM11"}, {x86_64::xmm12, "XMM12"},
+    {x86_64::xmm13, "XMM13"}, {x86_64::xmm14, "XMM14"},
+    {x86_64::xmm15, "XMM15"},
+  };
+  return regs;
+}
+
+// Callee-saved registers of the SysV x86-64 ABI
+static const RegList &CalleeSavedRegs() {
+  static const RegList regs = {
+    {x86_64::rbx, "RBX"}, {x86_64::rbp, "RBP"}, {x86_64::r12, "R12"},
+    {x86_64::r13, "R13"}, {x86_64::r14, "R14"}, {x86_64::r15, "R15"},
+  };
+  return regs;
+}
+
+static const std::string *CalleeSavedName(MachRegister reg) {
+  for (const auto &r : CalleeSavedRegs()) {
+    if (r.first == reg) {
+      return &r.second;
+    }
+  }
+  return nullptr;
+}
+
+// Name of the callee-saved register that is the only operand of `push` or
+// `pop`, if it is one
+static const std::string *PushPopOperand(
+    const InstructionAPI::Instruction::Ptr &insn, entryID op) {
+  if (insn->getOperation().getID() != op) {
+    return nullptr;
+  }
+  auto reg = dynamic_cast<InstructionAPI::RegisterAST *>(
+      insn->getOperand(0).getValue().get());
+  if (!reg) {
+    return nullptr;
+  }
+  return CalleeSavedName(reg->getID());
+}
+
+using Insns = std::map<Offset, InstructionAPI::Instruction::Ptr>;
+
+// Pairs up `push`es in the entry block with `pop`s in every returning block.
+// This is what compiler generated prologues and epilogues look like, anything
+// more clever than that is not considered preserved.
+static std::vector<std::pair<Address, RegisterFacts::RegNames>>
+ReturnPreservedRegs(ParseAPI::Function *func) {
+  std::vector<std::pair<Address, RegisterFacts::RegNames>> ret;
+
+  Insns entry_insns;
+  func->entry()->getInsns(entry_insns);
+
+  RegisterFacts::RegNames pushed;
+  for (const auto &insn : entry_insns) {
+    if (auto name = PushPopOperand(insn.second, e_push)) {
+      pushed.push_back(*name);
+    }
+  }
+  if (pushed.empty()) {
+    return ret;
+  }
+
+  for (auto block : func->blocks()) {
+    Insns insns;
+    block->getInsns(insns);
+    if (insns.empty()) {
+      continue;
+    }
+    auto last = std::prev(insns.end());
+    if (last->second->getCategory() != InstructionAPI::c_ReturnInsn) {
+      continue;
+    }
+
+    std::set<std::string> popped;
+    for (const auto &insn : insns) {
+      if (auto name = PushPopOperand(insn.second, e_pop)) {
+        popped.insert(*name);
+      }
+    }
+
+    RegisterFacts::RegNames preserved;
+    for (const auto &name : pushed) {
+      if (popped.count(name)) {
+        preserved.push_back(name);
+      }
+    }
+    ret.emplace_back(last->first, std::move(preserved));
+  }
+  return ret;
+}
+
+}  // namespace
+
+RegisterFacts::RegisterFacts(mcsema::Module &m, int address_width)
+    : module(m),
+      liveness(address_width),
+      enabled(FLAGS_register_liveness && address_width == 8) {
+  LOG_IF(WARNING, FLAGS_register_liveness && !enabled)
+      << "Register liveness is only recovered for amd64 binaries";
+}
+
+mcsema::PreservedRegisters *RegisterFacts::GetRegSet(RegNames regs,
+                                                     bool dead) {
+  std::sort(regs.begin(), regs.end());
+  auto &sets = dead ? dead_sets : preserved_sets;
+  auto &reg_set = sets[regs];
+  if (!reg_set) {
+    reg_set = dead ? module.add_dead_regs() : module.add_preserved_regs();
+    for (const auto &name : regs) {
+      reg_set->add_registers(name);
+    }
+  }
+  return reg_set;
+}
+
+void RegisterFacts::WriteDeadRegs(
+    ParseAPI::Function *func, ParseAPI::Block *block, Address addr,
+    const InstructionAPI::Instruction::Ptr &insn) {
+
+  if (!enabled || !dead_eas.insert(addr).second) {
+    return;
+  }
+
+  // The lifter kills them right before transferring control, so we are
+  // interested only in what is live before the instruction itself. For calls
+  // Dyninst accounts for the arguments of the callee, for returns for the
+  // return values and callee-saved registers.
+  ParseAPI::Location loc(func, ParseAPI::InsnLoc(block, addr, insn));
+  RegNames dead;
+  for (const auto &reg : KillableRegs()) {
+    bool live = true;
+    if (!liveness.query(loc, LivenessAnalyzer::Before, reg.first, live)) {
+      LOG(WARNING) << "Liveness analysis failed at 0x" << std::hex << addr;
+      return;
+    }
+    if (!live) {
+      dead.push_back(reg.second);
+    }
+  }
+
+  if (dead.empty()) {
+    return;
+  }
+  auto range = GetRegSet(std::move(dead), true)->add_ranges();
+  range->set_begin_ea(addr);
+}
+
+const RegisterFacts::RegNames &RegisterFacts::PreservedRegs(
+    ParseAPI::Function *func) {
+
+  auto cached = func_preserved_regs.find(func->addr());
+  if (cached != func_preserved_regs.end()) {
+    return cached->second;
+  }
+
+  // Across a call we can only rely on registers that all returns restore
+  auto &regs = func_preserved_regs[func->addr()];
+  auto rets = ReturnPreservedRegs(func);
+  if (rets.empty()) {
+    return regs;
+  }
+  regs = rets.front().second;
+  for (const auto &ret : rets) {
+    RegNames common;
+    for (const auto &name : regs) {
+      if (std::find(ret.second.begin(), ret.second.end(), name) !=
+          ret.second.end()) {
+        common.push_back(name);
+      }
+    }
+    regs = std::move(common);
+  }
+  return regs;
+}
+
+void RegisterFacts::WriteCallPreservedRegs(Address addr,
+                                           ParseAPI::Function *callee) {
+  if (!enabled || !call_eas.insert(addr).second) {
+    return;
+  }
+
+  RegNames regs;
+  if (callee) {
+    regs = PreservedRegs(callee);
+  } else {
+    for (const auto &reg : CalleeSavedRegs()) {
+      regs.push_back(reg.second);
+    }
+  }
+
+  if (regs.empty()) {
+    return;
+  }
+  auto range = GetRegSet(std::move(regs), false)->add_ranges();
+  range->set_begin_ea(addr);
+}
+
+void RegisterFacts::WriteFunctionPreservedRegs(ParseAPI::Function *func) {
+  if (!enabled) {
+    return;
+  }
+
+  for (auto &ret : ReturnPreservedRegs(func)) {
+    if (ret.second.empty()) {
+      continue;
+    }
+    auto range = GetRegSet(std::move(ret.second), false)->add_ranges();
+    range->set_begin_ea(func->addr());
+    range->set_end_ea(ret.first);
+  }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <CFG.pb.h>
+#include <CodeObject.h>
+#include <Instruction.h>
+#include <liveness.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Computes which registers are dead around call sites and returns and which
+// callee-saved registers a function preserves, and serializes them as
+// `preserved_regs` and `dead_regs` of the module. The lifter uses them to get
+// rid of stores into the `State` structure that nobody reads.
+class RegisterFacts {
+public:
+  using RegNames = std::vector<std::string>;
+
+  RegisterFacts(mcsema::Module &m, int address_width);
+
+  // Registers that are dead right before the call or return at `addr`, which
+  // must be the last instruction of `block`.
+  void WriteDeadRegs(Dyninst::ParseAPI::Function *func,
+                     Dyninst::ParseAPI::Block *block,
+                     Dyninst::Address addr,
+                     const Dyninst::InstructionAPI::Instruction::Ptr &insn);
+
+  // Registers that `callee` preserves, or all callee-saved registers of the
+  // ABI if it is external, are kept alive across the call at `addr`.
+  void WriteCallPreservedRegs(Dyninst::Address addr,
+                              Dyninst::ParseAPI::Function *callee);
+
+  // One range per (entry, return) pair of `func`.
+  void WriteFunctionPreservedRegs(Dyninst::ParseAPI::Function *func);
+
+private:
+  const RegNames &PreservedRegs(Dyninst::ParseAPI::Function *func);
+  mcsema::PreservedRegisters *GetRegSet(RegNames regs, bool dead);
+
+  mcsema::Module &module;
+  LivenessAnalyzer liveness;
+  bool enabled;
+
+  // Functions that save the same registers share one set in the CFG
+  std::map<RegNames, mcsema::PreservedRegisters *> preserved_sets;
+  std::map<RegNames, mcsema::PreservedRegisters *> dead_sets;
+
+  std::unordered_map<Dyninst::Address, RegNames> func_preserved_regs;
+
+  // Blocks shared by several functions are written more than once
+  std::unordered_set<Dyninst::Address> dead_eas;
+  std::unordered_set<Dyninst::Address> call_eas;
+};
@@ -42,6 +42,13 @@ DEFINE_string(output, "", "Path to output file");
 DEFINE_string(binary, "", "Path to binary to be disassembled");
 DEFINE_string(entrypoint, "main", "Name of entrypoint function");
 DEFINE_bool(pie_mode, false, "Need to be true for pie binaries");
+DEFINE_bool(parse_gaps, false,
+            "Speculatively sweep every code region for functions. By default "
+            "only addresses referenced by already discovered code and data "
+            "are parsed");
+DEFINE_bool(register_liveness, true,
+            "Emit dead registers around calls and returns, and registers "
+            "preserved by functions, so the lifter can drop unused stores");
 
 using namespace Dyninst;
 
@@ -87,6 +94,7 @@ int main(int argc, char **argv) {
         "FILE_NAME,...] \\" << std::endl
 
      << "    [--pretty_print] \\" << std::endl
+     << "    [--parse_gaps] \\" << std::endl
      << "    [--dump_cfg] \\" << std::endl;
 
   // Parse the command line arguments
@@ -120,12 +128,17 @@ int main(int argc, char **argv) {
 
   code_object->parse();
 
-  // If binary is stripped we need to try some speculative parsing
-  // We try both options that DynInst provides
-  auto idiom = Dyninst::ParseAPI::GapParsingType::PreambleMatching;
-  for (auto &reg : symtab_cs->regions()) {
-    code_object->parseGaps(reg, idiom);
-    code_object->parseGaps(reg);
+  // Functions that are only reachable through code pointers are picked up
+  // later by CFGWriter, which parses exactly the addresses it finds referenced.
+  // Sweeping the gaps is a lot slower and tends to produce spurious functions
+  // out of padding and data in code, so it is opt-in.
+  if (FLAGS_parse_gaps) {
+    // We try both options that DynInst provides
+    auto idiom = Dyninst::ParseAPI::GapParsingType::PreambleMatching;
+    for (auto &reg : symtab_cs->regions()) {
+      code_object->parseGaps(reg, idiom);
+      code_object->parseGaps(reg);
+    }
   }
 
   auto symtab = symtab_cs->getSymtabObject();
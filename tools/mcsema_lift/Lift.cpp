@@ -76,11 +76,23 @@ DECLARE_bool(keep_memops);
 DECLARE_bool(explicit_args);
 DECLARE_string(pc_annotation);
 DECLARE_uint32(explicit_args_count);
+DECLARE_bool(explicit_args_thread_local);
+DECLARE_bool(force_embed_data_refs);
+DECLARE_bool(disable_adjacent_segment_merging);
+DECLARE_bool(pad_segments);
+DECLARE_bool(lower_hyper_calls);
+DECLARE_bool(minimize_flag_exprs);
+DECLARE_bool(native_segment_access);
+DECLARE_bool(pic);
+DECLARE_bool(huge_pages);
 
 DEFINE_bool(list_supported, false,
             "List instructions that can be lifted.");
 DEFINE_bool(legacy_mode, false,
             "Try to make the output bitcode resemble the original McSema.");
+DEFINE_bool(symbolic_profile, false,
+            "Produce bitcode that is tailored to symbolic executors, e.g. "
+            "KLEE, rather than to native recompilation.");
 
 namespace {
 
@@ -646,6 +658,12 @@ int main(int argc, char *argv[]) {
      // functions into LLVM `load` and `store` instructions.
      << "    [--keep_memops] \\" << std::endl
 
+     // With `--keep_memops`, link in always-inline definitions of the memory
+     // access intrinsics (e.g. `memops_amd64.bc` from the McSema install), so
+     // that the optimizer turns the calls into `load` and `store`
+     // instructions.
+     << "    [--memops_runtime BITCODE_FILE] \\" << std::endl
+
      // There are roughly two ways of using McSema-lifted bitcode. The default
      // use case is to compile the bitcode into an executable that behaves like
      // the original program. The other use case is to do some kind of static
@@ -690,6 +708,12 @@ int main(int argc, char *argv[]) {
      // Try to produce bitcode that looks like McSema version 1. This enables
      // `--explicit_args` and `--pc_annotation`.
      << "    [--legacy_mode] \\" << std::endl
+
+     // Produce bitcode for symbolic executors like KLEE. This enables
+     // `--explicit_args`, models every segment and the emulated stack as
+     // separate, exactly-sized, non-thread-local objects, and folds flag
+     // computations into the branches that use them.
+     << "    [--symbolic_profile] \\" << std::endl
      
      // Print a list of the instructions that can be lifted.
      << "    [--list_supported]" << std::endl
@@ -764,6 +788,45 @@ int main(int argc, char *argv[]) {
     FLAGS_pc_annotation = "mcsema_real_eip";
   }
 
+  if (FLAGS_symbolic_profile) {
+    LOG_IF(WARNING, FLAGS_keep_memops)
+        << "Disabling --keep_memops in the symbolic profile.";
+    FLAGS_keep_memops = false;
+
+    LOG_IF(WARNING, !FLAGS_explicit_args)
+        << "Enabling --explicit_args in the symbolic profile.";
+    FLAGS_explicit_args = true;
+
+    // Lifted code must not depend on inline assembly, thread-local storage,
+    // or on the runtime initializing cross-references, as none of these are
+    // visible to the symbolic executor.
+    FLAGS_lower_hyper_calls = false;
+    FLAGS_explicit_args_thread_local = false;
+    FLAGS_native_segment_access = false;
+    FLAGS_force_embed_data_refs = true;
+
+    // Each segment becomes its own exactly-sized object, so that out-of-bounds
+    // accesses are caught, and so that the executor's memory model doesn't
+    // need to resolve pointers against one large merged object.
+    FLAGS_disable_adjacent_segment_merging = true;
+    FLAGS_pad_segments = false;
+
+    FLAGS_minimize_flag_exprs = true;
+  }
+
+  // There is only an amd64 Linux runtime for shared libraries.
+  if (FLAGS_pic) {
+    CHECK(FLAGS_os == "linux" && FLAGS_arch.rfind("amd64", 0) == 0)
+        << "The --pic option is only supported for amd64 Linux";
+  }
+
+  // Only the x86 runtimes know how to move code and data onto huge pages.
+  if (FLAGS_huge_pages) {
+    CHECK(FLAGS_os == "linux" && (FLAGS_arch.rfind("amd64", 0) == 0 ||
+                                  FLAGS_arch.rfind("x86", 0) == 0))
+        << "The --huge_pages option is only supported for x86 and amd64 Linux";
+  }
+
   mcsema::gModule = remill::LoadArchSemantics(mcsema::gArch);
 
   InitBaselineDecls();